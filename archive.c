@@ -0,0 +1,429 @@
+/*
+ * archive.c
+ * Implementation of the object archive module
+ * Writes archives of assembled modules and looks symbols up through the
+ * hashed index using a single read-only mapping of the archive file
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "archive.h"
+#include "utils.h"
+#include "data_structures.h"
+
+
+typedef struct {
+    char name[ARCHIVE_MEMBER_NAME];
+    char *ob_text;
+    size_t ob_size;
+    char *ent_text;
+    size_t ent_size;
+    char *ext_text;
+    size_t ext_size;
+} ModuleFiles;
+
+
+static int load_module_files(const char *module_path, ModuleFiles *module);
+static void free_module_files(ModuleFiles *modules, int module_count);
+static unsigned long count_lines(const char *text, unsigned long size);
+static int index_module_entries(const char *archive_name, ArchiveSymbol *index, unsigned long slots, const ModuleFiles *module, unsigned long member);
+static int write_archive(const char *archive_name, const ArchiveSymbol *index, unsigned long slots, const ModuleFiles *modules, int module_count);
+static void put_u32(unsigned char *dest, unsigned long value);
+static unsigned long get_u32(const unsigned char *src);
+
+
+/*
+ * Builds an archive from assembled modules
+ * @archive_name: Archive file to create
+ * @module_paths: Module paths without extension (<path>.ob must exist)
+ * @module_count: Number of modules
+ * Returns: 1 on success, 0 on failure
+ */
+int create_archive(const char *archive_name, char *module_paths[], int module_count) {
+    ModuleFiles *modules;
+    ArchiveSymbol *index;
+    unsigned long symbol_count = 0;
+    unsigned long slots = 8;
+    unsigned long i;
+    int j;
+    int result;
+
+    modules = (ModuleFiles *)calloc(module_count > 0 ? module_count : 1, sizeof(ModuleFiles));
+    if (modules == NULL) {
+        print_error(archive_name, 0, "Memory allocation error");
+        return 0;
+    }
+
+    for (j = 0; j < module_count; j++) {
+        if (!load_module_files(module_paths[j], &modules[j])) {
+            free_module_files(modules, module_count);
+            return 0;
+        }
+        symbol_count += count_lines(modules[j].ent_text, modules[j].ent_size);
+    }
+
+    /* Keep the load factor at or below one half so most lookups take one probe */
+    while (slots < symbol_count * 2) {
+        slots *= 2;
+    }
+
+    index = (ArchiveSymbol *)malloc(slots * sizeof(ArchiveSymbol));
+    if (index == NULL) {
+        print_error(archive_name, 0, "Memory allocation error");
+        free_module_files(modules, module_count);
+        return 0;
+    }
+    for (i = 0; i < slots; i++) {
+        memset(index[i].name, 0, ARCHIVE_INDEX_NAME);
+        index[i].member = ARCHIVE_EMPTY_SLOT;
+        index[i].address = 0;
+    }
+
+    result = 1;
+    for (j = 0; j < module_count && result; j++) {
+        result = index_module_entries(archive_name, index, slots, &modules[j], (unsigned long)j);
+    }
+
+    if (result) {
+        result = write_archive(archive_name, index, slots, modules, module_count);
+    }
+
+    free(index);
+    free_module_files(modules, module_count);
+    return result;
+}
+
+
+/*
+ * Maps an archive into memory and validates its header
+ * Returns: 1 on success, 0 on failure
+ */
+int open_archive(const char *archive_name, Archive *archive) {
+    struct stat info;
+    void *mapping;
+    int fd;
+    unsigned long needed;
+
+    archive->base = NULL;
+    archive->size = 0;
+
+    fd = open(archive_name, O_RDONLY);
+    if (fd < 0) {
+        print_error(archive_name, 0, "Cannot open archive");
+        return 0;
+    }
+
+    if (fstat(fd, &info) != 0 || info.st_size < ARCHIVE_HEADER_SIZE) {
+        print_error(archive_name, 0, "Not a valid archive");
+        close(fd);
+        return 0;
+    }
+
+    mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        print_error(archive_name, 0, "Cannot map archive");
+        return 0;
+    }
+
+    archive->base = (const unsigned char *)mapping;
+    archive->size = (unsigned long)info.st_size;
+
+    if (memcmp(archive->base, ARCHIVE_MAGIC, 4) != 0 || get_u32(archive->base + 4) != ARCHIVE_VERSION) {
+        print_error(archive_name, 0, "Not a valid archive");
+        close_archive(archive);
+        return 0;
+    }
+
+    archive->member_count = get_u32(archive->base + 8);
+    archive->index_slots = get_u32(archive->base + 12);
+
+    needed = ARCHIVE_HEADER_SIZE + archive->index_slots * ARCHIVE_INDEX_ENTRY_SIZE +
+             archive->member_count * ARCHIVE_MEMBER_ENTRY_SIZE;
+    if (archive->index_slots == 0 || (archive->index_slots & (archive->index_slots - 1)) != 0 ||
+        needed > archive->size) {
+        print_error(archive_name, 0, "Corrupt archive header");
+        close_archive(archive);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+void close_archive(Archive *archive) {
+    if (archive->base != NULL) {
+        munmap((void *)archive->base, (size_t)archive->size);
+    }
+    archive->base = NULL;
+    archive->size = 0;
+}
+
+
+/*
+ * Finds the member that defines a symbol
+ * Returns: 1 if found (symbol filled in), 0 otherwise
+ */
+int archive_lookup(const Archive *archive, const char *symbol_name, ArchiveSymbol *symbol) {
+    unsigned long mask = archive->index_slots - 1;
+    unsigned long slot = string_hash(symbol_name) & mask;
+    unsigned long probes;
+
+    for (probes = 0; probes < archive->index_slots; probes++) {
+        if (!archive_index_entry(archive, slot, symbol)) {
+            return 0;
+        }
+        if (symbol->member == ARCHIVE_EMPTY_SLOT) {
+            return 0;
+        }
+        if (strncmp(symbol->name, symbol_name, ARCHIVE_INDEX_NAME) == 0) {
+            return 1;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Reads entry number @number of the member table
+ * Returns: 1 on success, 0 if out of range or corrupt
+ */
+int archive_member(const Archive *archive, unsigned long number, ArchiveMember *member) {
+    const unsigned char *entry;
+
+    if (number >= archive->member_count) {
+        return 0;
+    }
+
+    entry = archive->base + ARCHIVE_HEADER_SIZE + archive->index_slots * ARCHIVE_INDEX_ENTRY_SIZE +
+            number * ARCHIVE_MEMBER_ENTRY_SIZE;
+
+    memcpy(member->name, entry, ARCHIVE_MEMBER_NAME);
+    member->name[ARCHIVE_MEMBER_NAME - 1] = '\0';
+    member->offset = get_u32(entry + ARCHIVE_MEMBER_NAME);
+    member->ob_size = get_u32(entry + ARCHIVE_MEMBER_NAME + 4);
+    member->ent_size = get_u32(entry + ARCHIVE_MEMBER_NAME + 8);
+    member->ext_size = get_u32(entry + ARCHIVE_MEMBER_NAME + 12);
+
+    if (member->offset + member->ob_size + member->ent_size + member->ext_size > archive->size) {
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * Reads slot @slot of the symbol index
+ * Returns: 1 on success, 0 if out of range
+ */
+int archive_index_entry(const Archive *archive, unsigned long slot, ArchiveSymbol *symbol) {
+    const unsigned char *entry;
+
+    if (slot >= archive->index_slots) {
+        return 0;
+    }
+
+    entry = archive->base + ARCHIVE_HEADER_SIZE + slot * ARCHIVE_INDEX_ENTRY_SIZE;
+    memcpy(symbol->name, entry, ARCHIVE_INDEX_NAME);
+    symbol->name[ARCHIVE_INDEX_NAME - 1] = '\0';
+    symbol->member = get_u32(entry + ARCHIVE_INDEX_NAME);
+    symbol->address = get_u32(entry + ARCHIVE_INDEX_NAME + 4);
+    return 1;
+}
+
+
+static int load_module_files(const char *module_path, ModuleFiles *module) {
+    char filename[MAX_LINE_LENGTH];
+    const char *base_name;
+
+    base_name = strrchr(module_path, '/');
+    base_name = (base_name == NULL) ? module_path : base_name + 1;
+
+    if (strlen(base_name) == 0 || strlen(base_name) >= ARCHIVE_MEMBER_NAME ||
+        strlen(module_path) + 5 > MAX_LINE_LENGTH) {
+        print_error(module_path, 0, "Invalid module name");
+        return 0;
+    }
+    strcpy(module->name, base_name);
+
+    strcpy(filename, module_path);
+    strcat(filename, ".ob");
+    module->ob_text = read_whole_file(filename, &module->ob_size);
+    if (module->ob_text == NULL) {
+        print_error(filename, 0, "Cannot open object file");
+        return 0;
+    }
+
+    /* Entries and externals files are optional */
+    strcpy(filename, module_path);
+    strcat(filename, ".ent");
+    module->ent_text = read_whole_file(filename, &module->ent_size);
+
+    strcpy(filename, module_path);
+    strcat(filename, ".ext");
+    module->ext_text = read_whole_file(filename, &module->ext_size);
+
+    return 1;
+}
+
+
+static void free_module_files(ModuleFiles *modules, int module_count) {
+    int i;
+
+    for (i = 0; i < module_count; i++) {
+        free(modules[i].ob_text);
+        free(modules[i].ent_text);
+        free(modules[i].ext_text);
+    }
+    free(modules);
+}
+
+
+static unsigned long count_lines(const char *text, unsigned long size) {
+    unsigned long i, lines = 0;
+
+    for (i = 0; i < size; i++) {
+        if (text[i] == '\n') {
+            lines++;
+        }
+    }
+    if (size > 0 && text[size - 1] != '\n') {
+        lines++;
+    }
+    return lines;
+}
+
+
+/* Inserts every "<name> <address>" line of a module's .ent text into the index */
+static int index_module_entries(const char *archive_name, ArchiveSymbol *index, unsigned long slots, const ModuleFiles *module, unsigned long member) {
+    char line[MAX_LINE_LENGTH];
+    char name[MAX_SYMBOL_NAME];
+    char digits[MAX_LINE_LENGTH];
+    unsigned int address;
+    unsigned long pos = 0, len, slot;
+
+    while (pos < module->ent_size) {
+        len = 0;
+        while (pos < module->ent_size && module->ent_text[pos] != '\n') {
+            if (len < MAX_LINE_LENGTH - 1) {
+                line[len++] = module->ent_text[pos];
+            }
+            pos++;
+        }
+        line[len] = '\0';
+        pos++;
+
+        if (is_empty_line(line)) {
+            continue;
+        }
+
+        if (sscanf(line, "%30s %80s", name, digits) != 2 || !from_base4(digits, &address)) {
+            print_error(module->name, 0, "Malformed line in entries file");
+            return 0;
+        }
+
+        slot = string_hash(name) & (slots - 1);
+        while (index[slot].member != ARCHIVE_EMPTY_SLOT) {
+            if (strcmp(index[slot].name, name) == 0) {
+                print_error(archive_name, 0, "Symbol is defined by more than one member");
+                return 0;
+            }
+            slot = (slot + 1) & (slots - 1);
+        }
+
+        strcpy(index[slot].name, name);
+        index[slot].member = member;
+        index[slot].address = address;
+    }
+
+    return 1;
+}
+
+
+static int write_archive(const char *archive_name, const ArchiveSymbol *index, unsigned long slots, const ModuleFiles *modules, int module_count) {
+    FILE *output_file;
+    unsigned char header[ARCHIVE_HEADER_SIZE];
+    unsigned char entry[ARCHIVE_MEMBER_ENTRY_SIZE];
+    unsigned long offset;
+    unsigned long i;
+    int j;
+    int ok = 1;
+
+    output_file = fopen(archive_name, "wb");
+    if (output_file == NULL) {
+        print_error(archive_name, 0, "Cannot create archive file");
+        return 0;
+    }
+
+    memcpy(header, ARCHIVE_MAGIC, 4);
+    put_u32(header + 4, ARCHIVE_VERSION);
+    put_u32(header + 8, (unsigned long)module_count);
+    put_u32(header + 12, slots);
+    ok = ok && fwrite(header, 1, sizeof(header), output_file) == sizeof(header);
+
+    for (i = 0; i < slots; i++) {
+        memset(entry, 0, sizeof(entry));
+        memcpy(entry, index[i].name, ARCHIVE_INDEX_NAME);
+        put_u32(entry + ARCHIVE_INDEX_NAME, index[i].member);
+        put_u32(entry + ARCHIVE_INDEX_NAME + 4, index[i].address);
+        ok = ok && fwrite(entry, 1, ARCHIVE_INDEX_ENTRY_SIZE, output_file) == ARCHIVE_INDEX_ENTRY_SIZE;
+    }
+
+    offset = ARCHIVE_HEADER_SIZE + slots * ARCHIVE_INDEX_ENTRY_SIZE +
+             (unsigned long)module_count * ARCHIVE_MEMBER_ENTRY_SIZE;
+    for (j = 0; j < module_count; j++) {
+        memset(entry, 0, sizeof(entry));
+        strcpy((char *)entry, modules[j].name);
+        put_u32(entry + ARCHIVE_MEMBER_NAME, offset);
+        put_u32(entry + ARCHIVE_MEMBER_NAME + 4, modules[j].ob_size);
+        put_u32(entry + ARCHIVE_MEMBER_NAME + 8, modules[j].ent_size);
+        put_u32(entry + ARCHIVE_MEMBER_NAME + 12, modules[j].ext_size);
+        ok = ok && fwrite(entry, 1, ARCHIVE_MEMBER_ENTRY_SIZE, output_file) == ARCHIVE_MEMBER_ENTRY_SIZE;
+        offset += modules[j].ob_size + modules[j].ent_size + modules[j].ext_size;
+    }
+
+    for (j = 0; j < module_count; j++) {
+        ok = ok && fwrite(modules[j].ob_text, 1, modules[j].ob_size, output_file) == modules[j].ob_size;
+        if (modules[j].ent_size > 0) {
+            ok = ok && fwrite(modules[j].ent_text, 1, modules[j].ent_size, output_file) == modules[j].ent_size;
+        }
+        if (modules[j].ext_size > 0) {
+            ok = ok && fwrite(modules[j].ext_text, 1, modules[j].ext_size, output_file) == modules[j].ext_size;
+        }
+    }
+
+    if (fclose(output_file) != 0) {
+        ok = 0;
+    }
+
+    if (!ok) {
+        print_error(archive_name, 0, "Error writing archive file");
+        remove(archive_name);
+        return 0;
+    }
+    return 1;
+}
+
+
+static void put_u32(unsigned char *dest, unsigned long value) {
+    dest[0] = (unsigned char)((value >> 24) & 0xFF);
+    dest[1] = (unsigned char)((value >> 16) & 0xFF);
+    dest[2] = (unsigned char)((value >> 8) & 0xFF);
+    dest[3] = (unsigned char)(value & 0xFF);
+}
+
+
+static unsigned long get_u32(const unsigned char *src) {
+    return ((unsigned long)src[0] << 24) | ((unsigned long)src[1] << 16) |
+           ((unsigned long)src[2] << 8) | (unsigned long)src[3];
+}
@@ -0,0 +1,67 @@
+/*
+ * archive.h
+ * Object archive module for the assembler project
+ * Bundles assembled modules (.ob, .ent, .ext) into a single archive file
+ * with a hashed symbol index at the front for fast definition lookup
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "data_structures.h"
+
+#define ARCHIVE_MAGIC "M14A"        /* First four bytes of every archive */
+#define ARCHIVE_VERSION 1           /* Current archive format version */
+#define ARCHIVE_HEADER_SIZE 16      /* magic, version, member count, index slots */
+#define ARCHIVE_INDEX_NAME 32       /* Bytes reserved for a symbol name in the index */
+#define ARCHIVE_INDEX_ENTRY_SIZE 40 /* name, member number, address */
+#define ARCHIVE_MEMBER_NAME 48      /* Bytes reserved for a member name */
+#define ARCHIVE_MEMBER_ENTRY_SIZE 64 /* name, offset, .ob size, .ent size, .ext size */
+#define ARCHIVE_EMPTY_SLOT 0xFFFFFFFFUL /* Member number of an unused index slot */
+
+/*
+ * Archive layout (all numbers are 32-bit big-endian):
+ *   header        : "M14A", version, member count, index slot count
+ *   symbol index  : open-addressed hash table of entry symbols, by string_hash
+ *   member table  : name and the offset/size of each member body
+ *   member bodies : .ob text followed by .ent and .ext text
+ */
+
+typedef struct {
+    char name[ARCHIVE_MEMBER_NAME];
+    unsigned long offset;
+    unsigned long ob_size;
+    unsigned long ent_size;
+    unsigned long ext_size;
+} ArchiveMember;
+
+
+typedef struct {
+    char name[ARCHIVE_INDEX_NAME];
+    unsigned long member;
+    unsigned long address;
+} ArchiveSymbol;
+
+
+typedef struct {
+    const unsigned char *base;  /* Mapped archive contents */
+    unsigned long size;
+    unsigned long member_count;
+    unsigned long index_slots;
+} Archive;
+
+
+
+
+int create_archive(const char *archive_name, char *module_paths[], int module_count);
+
+
+int open_archive(const char *archive_name, Archive *archive);
+void close_archive(Archive *archive);
+
+
+int archive_lookup(const Archive *archive, const char *symbol_name, ArchiveSymbol *symbol);
+int archive_member(const Archive *archive, unsigned long number, ArchiveMember *member);
+int archive_index_entry(const Archive *archive, unsigned long slot, ArchiveSymbol *symbol);
+
+#endif /* ARCHIVE_H */
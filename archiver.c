@@ -0,0 +1,134 @@
+/*
+ * archiver.c
+ * Main program for the object archiver
+ * Creates archives of assembled modules, lists them and looks up symbols
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "archive.h"
+#include "diagnostics.h"
+#include "utils.h"
+
+/*
+ * Function prototypes
+ */
+int list_archive(const char *archive_name);
+int lookup_symbol(const char *archive_name, const char *symbol_name);
+void print_archiver_usage(const char *program_name);
+
+/*
+ * main - Entry point of the archiver program
+ * @argc: Number of command line arguments
+ * @argv: Array of command line argument strings
+ * Returns: 0 on success, 1 on failure
+ */
+int main(int argc, char *argv[]) {
+    extern int error_flag;
+    int success;
+
+    if (argc < 3) {
+        print_archiver_usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "-c") == 0 && argc >= 4) {
+        success = create_archive(argv[2], argv + 3, argc - 3);
+        if (success) {
+            printf("Archive '%s' created with %d member(s).\n", argv[2], argc - 3);
+        }
+    } else if (strcmp(argv[1], "-t") == 0 && argc == 3) {
+        success = list_archive(argv[2]);
+    } else if (strcmp(argv[1], "-l") == 0 && argc == 4) {
+        success = lookup_symbol(argv[2], argv[3]);
+    } else {
+        print_archiver_usage(argv[0]);
+        return 1;
+    }
+
+    flush_diagnostics(stderr);
+    return (success && error_flag == 0) ? 0 : 1;
+}
+
+/*
+ * list_archive - Prints the members and the symbol index of an archive
+ * Returns: 1 on success, 0 on failure
+ */
+int list_archive(const char *archive_name) {
+    Archive archive;
+    ArchiveMember member;
+    ArchiveSymbol symbol;
+    char base4_address[6];
+    unsigned long i;
+
+    if (!open_archive(archive_name, &archive)) {
+        return 0;
+    }
+
+    printf("Members:\n");
+    for (i = 0; i < archive.member_count; i++) {
+        if (!archive_member(&archive, i, &member)) {
+            print_error(archive_name, 0, "Corrupt member table");
+            close_archive(&archive);
+            return 0;
+        }
+        printf("  %-20s ob=%lu ent=%lu ext=%lu\n", member.name,
+               member.ob_size, member.ent_size, member.ext_size);
+    }
+
+    printf("Symbols:\n");
+    for (i = 0; i < archive.index_slots; i++) {
+        archive_index_entry(&archive, i, &symbol);
+        if (symbol.member == ARCHIVE_EMPTY_SLOT || !archive_member(&archive, symbol.member, &member)) {
+            continue;
+        }
+        to_base4((unsigned int)symbol.address, base4_address);
+        printf("  %-20s %s %s\n", symbol.name, base4_address, member.name);
+    }
+
+    close_archive(&archive);
+    return 1;
+}
+
+/*
+ * lookup_symbol - Prints the member that defines a symbol and its address
+ * Returns: 1 if the symbol was found, 0 otherwise
+ */
+int lookup_symbol(const char *archive_name, const char *symbol_name) {
+    Archive archive;
+    ArchiveMember member;
+    ArchiveSymbol symbol;
+    char base4_address[6];
+
+    if (!open_archive(archive_name, &archive)) {
+        return 0;
+    }
+
+    if (!archive_lookup(&archive, symbol_name, &symbol) || !archive_member(&archive, symbol.member, &member)) {
+        printf("Symbol '%s' is not defined in '%s'.\n", symbol_name, archive_name);
+        close_archive(&archive);
+        return 0;
+    }
+
+    to_base4((unsigned int)symbol.address, base4_address);
+    printf("%s %s %s\n", symbol.name, base4_address, member.name);
+
+    close_archive(&archive);
+    return 1;
+}
+
+/*
+ * print_archiver_usage - Prints usage information for the archiver
+ */
+void print_archiver_usage(const char *program_name) {
+    printf("Usage: %s -c <archive> <module1> [module2] ...\n", program_name);
+    printf("       %s -t <archive>\n", program_name);
+    printf("       %s -l <archive> <symbol>\n", program_name);
+    printf("\nDescription:\n");
+    printf("  -c  Bundles assembled modules into one archive. For each module\n");
+    printf("      'name', name.ob is required and name.ent/name.ext are included\n");
+    printf("      when present. Entry symbols are indexed at the front of the archive.\n");
+    printf("  -t  Lists the members and the symbol index of an archive.\n");
+    printf("  -l  Prints the member that defines a symbol and its address.\n");
+}
@@ -4,22 +4,65 @@
  * Coordinates all phases of assembly: pre-processing, first pass, and second pass
  */
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "data_structures.h"
 #include "utils.h"
+#include "line_ring.h"
 #include "pre_assembler.h"
 #include "first_pass.h"
 #include "second_pass.h"
+#include "optimizer.h"
+#include "size_report.h"
+#include "source.h"
+#include "jobserver.h"
+#include "file_io.h"
+#include "symbol_names.h"
+#include "region.h"
+#include "diagnostics.h"
 
 /*
  * Function prototypes
  */
 int process_single_file(const char *full_path, const char *base_name);
+int run_pipelined_front_end(const char *full_path, const char *base_name, SymbolTable *symbol_table);
+void* first_pass_consumer(void *arg);
+int parse_options(int argc, char *argv[], char *files[], int *file_count);
+int parse_count(const char *str, int *value);
 void print_usage(const char *program_name);
 int validate_filename(const char *filename);
+void progress(const char *format, ...);
+void drop_intermediate_file(const char *base_name);
+void claim_worker_threads(void);
+char** start_background_io(char *files[], int file_count);
+void write_intermediate_file(const char *base_name);
+
+typedef struct {
+    LineRing *ring;
+    const char *full_path;
+    const char *base_name;
+    SymbolTable *symbol_table;
+} PipelineConsumer;
+
+static int pipeline_mode = 0;  /* 1 = run the first pass while the pre-assembler expands macros */
+static int optimize_mode = 0;  /* 1 = run the peephole optimizer before encoding */
+static int size_report = 0;    /* 1 = print where the words of each file went */
+static const char *macro_library_path = NULL;  /* --macro-lib file shared by every input file */
+static int stream_mode = 0;    /* 1 = source from stdin, outputs to stdout, no files */
+static int stream_sections = 0; /* 1 = also stream entries and externals (--sections) */
+static int check_mode = 0;     /* 1 = report errors only: no files, no progress (--check) */
+static int thread_count = 1;   /* --threads; the most threads a pass may use */
+static int jobserver = 0;      /* 1 = worker threads need tokens from make's jobserver */
+static int pipeline_granted = 1; /* 0 = the jobserver had no token for the pipeline thread */
+static int background_io = 0;  /* 1 = inputs prefetched, outputs written by a writer thread */
+static int if_changed = 0;     /* 1 = leave outputs whose contents did not change untouched */
+static int deferred_am = 0;    /* 1 = each .am is kept in memory and written after its file */
 
 /*
  * main - Entry point of the assembler program
@@ -34,6 +77,10 @@ int main(int argc, char *argv[]) {
     int i;
     int overall_success = 1;
     int file_success;
+    char **files;
+    char **input_paths = NULL;
+    int file_count = 0;
+    MacroLibrary *macro_library = NULL;
     
     /* Check if at least one filename was provided */
     if (argc < 2) {
@@ -41,21 +88,94 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    printf("Assembler started. Processing %d file(s)...\n", argc - 1);
+    files = (char **)malloc(argc * sizeof(char *));
+    if (files == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 1;
+    }
+    
+    if (!parse_options(argc, argv, files, &file_count) || file_count == 0) {
+        print_usage(argv[0]);
+        free(files);
+        return 1;
+    }
+    
+    /* "-" assembles stdin to stdout; stdout then carries nothing but the output */
+    for (i = 0; i < file_count; i++) {
+        if (strcmp(files[i], STDIN_PATH) == 0) {
+            stream_mode = 1;
+        }
+    }
+    if (stream_mode && file_count > 1) {
+        fprintf(stderr, "Error: '%s' must be the only input file\n", STDIN_PATH);
+        free(files);
+        return 1;
+    }
+    if (stream_mode) {
+        keep_sources_in_memory(SOURCES_IN_MEMORY);
+        set_output_stream(stdout, stream_sections);
+    }
+    
+    /* Checking a file is latency bound: one thread, nothing written */
+    if (check_mode) {
+        keep_sources_in_memory(SOURCES_IN_MEMORY);
+        set_second_pass_check_only(1);
+        set_first_pass_threads(1);
+        set_second_pass_threads(1);
+        thread_count = 1;
+        pipeline_mode = 0;
+        optimize_mode = 0;
+        size_report = 0;
+    }
+    
+    /* The library is parsed once; every file sees it read-only under its own macros */
+    if (macro_library_path != NULL) {
+        macro_library = load_macro_library(macro_library_path);
+        if (macro_library == NULL) {
+            flush_diagnostics(stderr);
+            free(files);
+            return 1;
+        }
+        set_macro_library(macro_library);
+        progress("Macro library '%s': %d macro(s).\n", macro_library_path, macro_library_size(macro_library));
+    }
+    
+    /* Under make -jN, threads beyond the first count against make's limit */
+    if (thread_count > 1 || pipeline_mode) {
+        jobserver = connect_jobserver();
+    }
+    
+    /* With several files, reading the next ones and writing finished outputs overlap the work */
+    if (file_count > 1 && !stream_mode && !check_mode) {
+        input_paths = start_background_io(files, file_count);
+    }
+    
+    /* Comparing needs every output in memory, the .am included */
+    if (if_changed && !stream_mode && !check_mode) {
+        set_write_if_changed(1);
+        if (!deferred_am) {
+            keep_sources_in_memory(SOURCES_DEFERRED);
+            deferred_am = 1;
+        }
+    }
+    
+    progress("Assembler started. Processing %d file(s)...\n", file_count);
     
     /* Process each input file */
-    for (i = 1; i < argc; i++) {
-        char *full_path = argv[i];
+    for (i = 0; i < file_count; i++) {
+        char *full_path = files[i];
         char *base_name;
 
-        printf("\n=== Processing file: %s ===\n", full_path);
+        progress("\n=== Processing file: %s ===\n", full_path);
 
-        // Find the last '/' to get the base filename
+        /* Find the last '/' to get the base filename */
         base_name = strrchr(full_path, '/');
-        if (base_name == NULL) {
-            base_name = full_path; // No slash, the argument is the base name
+        if (stream_mode) {
+            base_name = STDIN_NAME;
+        } else if (base_name == NULL) {
+            base_name = full_path; /* No slash, the argument is the base name */
         } else {
-            base_name++; // Move past the '/' to the actual filename
+            base_name++; /* Move past the '/' to the actual filename */
         }
 
         /* Validate ONLY the base name */
@@ -66,32 +186,146 @@ int main(int argc, char *argv[]) {
         }
         
         /* Process the file using both path and base name */
+        claim_worker_threads();
         file_success = process_single_file(full_path, base_name);
+        release_job_tokens();
+        if (deferred_am) {
+            write_intermediate_file(base_name);
+            file_success = file_success && !error_flag;
+        }
+        
+        /* Emit this file's diagnostics in one sorted batch */
+        fflush(stdout);
+        flush_diagnostics(stderr);
         
         if (file_success) {
-            printf("File '%s' processed successfully.\n", full_path);
+            progress("File '%s' processed successfully.\n", full_path);
         } else {
-            printf("File '%s' processing failed.\n", full_path);
+            progress("File '%s' processing failed.\n", full_path);
             overall_success = 0;
         }
         
         /* Clean up for next file */
+        if (check_mode) {
+            drop_intermediate_file(base_name);
+        }
         reset_counters();
         reset_memory_images();
+        clear_symbol_names();
+        reset_region();  /* Symbols, macros and external uses all go at once */
         error_flag = 0;  /* Reset error flag for next file */
     }
     
-    printf("\n=== Assembly complete ===\n");
+    if (background_io) {
+        if (stop_file_io() > 0) {
+            overall_success = 0;
+        } else {
+            progress("Queued output files written.\n");
+        }
+        flush_diagnostics(stderr);
+        for (i = 0; i < file_count; i++) {
+            free(input_paths[i]);
+        }
+        free(input_paths);
+    }
+    
+    free(files);
+    disconnect_jobserver();
+    keep_sources_in_memory(SOURCES_ON_DISK);
+    clear_symbol_names();
+    release_region();
+    set_macro_library(NULL);
+    free_macro_library(macro_library);
+    progress("\n=== Assembly complete ===\n");
     
     if (overall_success) {
-        printf("All files processed successfully.\n");
+        progress("All files processed successfully.\n");
         return 0;
     } else {
-        printf("Some files had errors. Check error messages above.\n");
+        progress("Some files had errors. Check error messages above.\n");
         return 1;
     }
 }
 
+/*
+ * parse_options - Separates command line options from input file names
+ * @argc: Number of command line arguments
+ * @argv: Array of command line argument strings
+ * @files: Receives the input file arguments, in order
+ * @file_count: Receives the number of input files
+ * Returns: 1 on success, 0 on an invalid option
+ */
+int parse_options(int argc, char *argv[], char *files[], int *file_count) {
+    int i;
+    int value;
+    
+    *file_count = 0;
+    
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--max-errors") == 0) {
+            if (i + 1 >= argc || !parse_count(argv[i + 1], &value)) {
+                fprintf(stderr, "Error: --max-errors requires a positive number\n");
+                return 0;
+            }
+            set_max_errors(value);
+            i++;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            if (i + 1 >= argc || !parse_count(argv[i + 1], &value)) {
+                fprintf(stderr, "Error: --threads requires a positive number\n");
+                return 0;
+            }
+            set_first_pass_threads(value);
+            set_second_pass_threads(value);
+            thread_count = value;
+            i++;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            pipeline_mode = 1;
+        } else if (strcmp(argv[i], "-O") == 0) {
+            optimize_mode = 1;
+        } else if (strcmp(argv[i], "--size-report") == 0) {
+            size_report = 1;
+        } else if (strcmp(argv[i], "--macro-lib") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --macro-lib requires a file name\n");
+                return 0;
+            }
+            macro_library_path = argv[++i];
+        } else if (strcmp(argv[i], "--if-changed") == 0) {
+            if_changed = 1;
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check_mode = 1;
+        } else if (strcmp(argv[i], "--sections") == 0) {
+            stream_sections = 1;
+        } else if (strcmp(argv[i], "--ext-grouped") == 0) {
+            set_grouped_externals(1);
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            return 0;
+        } else {
+            files[(*file_count)++] = argv[i];
+        }
+    }
+    
+    return 1;
+}
+
+/*
+ * parse_count - Parses a positive decimal option value
+ * Returns: 1 on success, 0 if @str is not a positive number
+ */
+int parse_count(const char *str, int *value) {
+    char *endptr;
+    long result;
+    
+    result = strtol(str, &endptr, 10);
+    if (*str == '\0' || *endptr != '\0' || result <= 0 || result > 1000000L) {
+        return 0;
+    }
+    
+    *value = (int)result;
+    return 1;
+}
+
 /*
  * Processes a single input file through all assembly phases
  * @full_path: Full path to input file (without .as extension)
@@ -100,76 +334,202 @@ int main(int argc, char *argv[]) {
  */
 int process_single_file(const char *full_path, const char *base_name) {
     extern int error_flag;  /* Access global error flag */
-    SymbolNode *symbol_table = NULL;  /* Local symbol table for this file */
-    ExternalUsage *externals_list = NULL;  /* Local external usage list for this file */
+    SymbolTable symbol_table;  /* Local symbol table for this file */
+    ExternalTable externals;  /* Local external use table for this file */
+    int words_saved;
     
-    printf("Phase 1: Pre-assembler (macro processing)...\n");
+    init_symbol_table(&symbol_table);
+    init_external_table(&externals);
     
-    /* Phase 1: Pre-assembler */
-    if (!process_file(full_path, base_name) || error_flag) {
-        printf("Pre-assembler phase failed.\n");
-        return 0;
+    progress("Phase 1: Pre-assembler (macro processing)...\n");
+    
+    if (pipeline_mode && pipeline_granted) {
+        /* Phases 1 and 2 overlap; the helper reports both */
+        if (!run_pipelined_front_end(full_path, base_name, &symbol_table)) {
+            free_symbol_table(&symbol_table);
+            return 0;
+        }
+    } else {
+        /* Phase 1: Pre-assembler */
+        if (!process_file(full_path, base_name) || error_flag) {
+            progress("Pre-assembler phase failed.\n");
+            return 0;
+        }
+        
+        progress("Phase 1 completed successfully.\n");
+        progress("Phase 2: First pass (symbol table building)...\n");
+        
+        /* Phase 2: First pass */
+        if (!first_pass(full_path, base_name, &symbol_table) || error_flag) {
+            progress("First pass failed.\n");
+            free_symbol_table(&symbol_table);
+            return 0;
+        }
     }
     
-    printf("Phase 1 completed successfully.\n");
-    printf("Phase 2: First pass (symbol table building)...\n");
+    progress("Phase 2 completed successfully.\n");
     
-    /* Phase 2: First pass */
-    if (!first_pass(full_path, base_name, &symbol_table) || error_flag) {
-        printf("First pass failed.\n");
-        free_symbol_table(&symbol_table);
-        return 0;
+    if (optimize_mode) {
+        if (!optimize_program(base_name, &symbol_table, &words_saved) || error_flag) {
+            progress("Optimizer failed.\n");
+            free_symbol_table(&symbol_table);
+            return 0;
+        }
+        progress("Optimizer: %d code word(s) saved.\n", words_saved);
     }
     
-    printf("Phase 2 completed successfully.\n");
-    printf("Phase 3: Second pass (code generation)...\n");
+    progress("Phase 3: Second pass (code generation)...\n");
     
     /* Phase 3: Second pass */
-    if (!second_pass(full_path, base_name, symbol_table, &externals_list) || error_flag) {
-        printf("Second pass failed.\n");
+    if (!second_pass(full_path, base_name, &symbol_table, &externals) || error_flag) {
+        progress("Second pass failed.\n");
         free_symbol_table(&symbol_table);  /* Clean up on error */
-        cleanup_external_usage(&externals_list);  /* Clean up externals list */
+        cleanup_external_usage(&externals);  /* Clean up externals table */
         return 0;
     }
     
     /* Only create output files if no errors found */
     if (error_flag == 0) {
-        printf("Phase 3 completed successfully.\n");
-        printf("Output files generated:\n");
-        printf("  - %s.ob (object file)\n", base_name);
+        progress("Phase 3 completed successfully.\n");
+        /* With background I/O the writer thread has not written them yet */
+        if (stream_mode) {
+            progress("Output written to standard output:\n");
+        } else if (background_io) {
+            progress("Output files queued for writing:\n");
+        } else {
+            progress("Output files generated:\n");
+        }
+        progress("  - %s.ob (object file)\n", base_name);
         
         /* Check for optional output files */
-        if (has_entry_symbols(symbol_table)) {
-            printf("  - %s.ent (entries file)\n", base_name);
+        if (has_entry_symbols(&symbol_table)) {
+            progress("  - %s.ent (entries file)\n", base_name);
         }
         
-        if (has_external_usage(externals_list)) {
-            printf("  - %s.ext (externals file)\n", base_name);
+        if (has_external_usage(&externals)) {
+            progress("  - %s.ext (externals file)\n", base_name);
+        }
+        
+        if (size_report) {
+            print_size_report(stream_mode ? stderr : stdout, base_name, &symbol_table);
         }
         
         free_symbol_table(&symbol_table);
-        cleanup_external_usage(&externals_list);
+        cleanup_external_usage(&externals);
         return 1;
     } else {
-        printf("Errors found during assembly. Output files will not be created.\n");
+        progress("Errors found during assembly. Output files will not be created.\n");
         free_symbol_table(&symbol_table);  /* Clean up on error */
-        cleanup_external_usage(&externals_list);  /* Clean up externals list */
+        cleanup_external_usage(&externals);  /* Clean up externals table */
         return 0;
     }
 }
 
+/*
+ * run_pipelined_front_end - Runs the pre-assembler and the first pass together
+ * @full_path: Full path to input file (without .as extension)
+ * @base_name: Base filename for output files
+ * @symbol_table: Receives the symbols found by the first pass
+ * Returns: 1 on success, 0 on failure
+ *
+ * The pre-assembler streams each expanded line through a ring buffer to a
+ * first pass running on its own thread. First pass errors are held back
+ * until the pre-assembler has finished, so the output matches running the
+ * two phases one after the other.
+ */
+int run_pipelined_front_end(const char *full_path, const char *base_name, SymbolTable *symbol_table) {
+    extern int error_flag;
+    PipelineConsumer consumer;
+    pthread_t thread;
+    int pre_assembler_ok;
+    
+    consumer.ring = create_line_ring(LINE_RING_SLOTS);
+    consumer.full_path = full_path;
+    consumer.base_name = base_name;
+    consumer.symbol_table = symbol_table;
+    
+    if (consumer.ring == NULL || pthread_create(&thread, NULL, first_pass_consumer, &consumer) != 0) {
+        free_line_ring(consumer.ring);
+        
+        /* Fall back to running the phases in order */
+        if (!process_file(full_path, base_name) || error_flag) {
+            progress("Pre-assembler phase failed.\n");
+            return 0;
+        }
+        progress("Phase 1 completed successfully.\n");
+        progress("Phase 2: First pass (symbol table building)...\n");
+        if (!first_pass(full_path, base_name, symbol_table) || error_flag) {
+            progress("First pass failed.\n");
+            return 0;
+        }
+        return 1;
+    }
+    
+    set_pre_assembler_ring(consumer.ring);
+    pre_assembler_ok = process_file(full_path, base_name) && !error_flag;
+    set_pre_assembler_ring(NULL);
+    close_line_ring(consumer.ring);
+    pthread_join(thread, NULL);
+    free_line_ring(consumer.ring);
+    
+    if (!pre_assembler_ok) {
+        finish_first_pass_stream(0, symbol_table);
+        progress("Pre-assembler phase failed.\n");
+        return 0;
+    }
+    
+    progress("Phase 1 completed successfully.\n");
+    progress("Phase 2: First pass (symbol table building)...\n");
+    
+    if (!finish_first_pass_stream(1, symbol_table) || error_flag) {
+        progress("First pass failed.\n");
+        return 0;
+    }
+    
+    return 1;
+}
+
+/*
+ * first_pass_consumer - Thread body running the first pass on streamed lines
+ * @arg: The PipelineConsumer describing the stream
+ */
+void* first_pass_consumer(void *arg) {
+    PipelineConsumer *consumer = (PipelineConsumer *)arg;
+    
+    first_pass_stream(consumer->ring, consumer->full_path, consumer->base_name, consumer->symbol_table);
+    return NULL;
+}
+
 /*
  * print_usage - Prints usage information for the program
  * @program_name: Name of the program executable
  */
 void print_usage(const char *program_name) {
-    printf("Usage: %s <filename1> [filename2] [filename3] ...\n", program_name);
+    printf("Usage: %s [options] <filename1> [filename2] [filename3] ...\n", program_name);
     printf("\nDescription:\n");
     printf("  Assembles one or more assembly source files.\n");
     printf("  Input files should have .as extension (extension not included in argument).\n");
+    printf("\nOptions:\n");
+    printf("  --max-errors N  Stop a file's current phase after N errors\n");
+    printf("  --ext-grouped   Write each external once, followed by all its use addresses\n");
+    printf("  --threads N     Split large files across N threads\n");
+    printf("                  (under make -j, only as many as make has job slots free)\n");
+    printf("  --pipeline      Run the first pass while macros are being expanded\n");
+    printf("  -O              Remove and shorten redundant instructions before encoding\n");
+    printf("  --size-report   Show the words used per label and per macro call\n");
+    printf("  --macro-lib F   Read the macros of file F once and offer them to every file;\n");
+    printf("                  a file's own macro hides the library one of the same name,\n");
+    printf("                  but a macro called inside a library macro is always the\n");
+    printf("                  library's\n");
+    printf("  --if-changed    Leave output files whose contents did not change untouched\n");
+    printf("  --check         Only report errors; write no files (exit status 0 = valid)\n");
+    printf("  --sections      With '-', also write entries and externals, under [ob],\n");
+    printf("                  [ent] and [ext] header lines\n");
     printf("\nExample:\n");
     printf("  %s test1 test2 test3\n", program_name);
     printf("  This will process test1.as, test2.as, and test3.as\n");
+    printf("  %s - < prog.as > prog.ob\n", program_name);
+    printf("  This reads the source from stdin and writes the object to stdout\n");
     printf("\nOutput Files:\n");
     printf("  For each input file 'filename':\n");
     printf("  - filename.am  : Macro-expanded intermediate file\n");
@@ -216,3 +576,118 @@ int validate_filename(const char *filename) {
     
     return 1;
 }
+
+/*
+ * progress - Prints a progress message on stdout
+ * @format: printf format of the message
+ *
+ * Does nothing in stream mode, where stdout carries the assembled output,
+ * and in check mode, where only the diagnostics matter.
+ */
+void progress(const char *format, ...) {
+    va_list args;
+    
+    if (stream_mode || check_mode) {
+        return;
+    }
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/*
+ * drop_intermediate_file - Frees the in-memory .am of a checked file
+ * @base_name: Base filename of the file
+ */
+void drop_intermediate_file(const char *base_name) {
+    char am_filename[MAX_LINE_LENGTH];
+    
+    create_output_filename(base_name, AM_EXTENSION, am_filename);
+    remove_source_file(am_filename);
+}
+
+/*
+ * claim_worker_threads - Takes jobserver tokens for the next file's threads
+ *
+ * The main thread runs on the token make gave this process; every other
+ * thread a pass starts needs one more. Threads are cut down to the tokens
+ * that are free now, so a busy build assembles serially instead of waiting.
+ * The tokens are returned with release_job_tokens once the file is done.
+ */
+void claim_worker_threads(void) {
+    int wanted, granted, threads;
+    
+    if (!jobserver) {
+        return;
+    }
+    
+    /* The pipeline's first pass thread and the pass workers never run together */
+    wanted = (thread_count - 1 > pipeline_mode) ? thread_count - 1 : pipeline_mode;
+    granted = acquire_job_tokens(wanted);
+    threads = 1 + ((granted < thread_count - 1) ? granted : thread_count - 1);
+    
+    set_first_pass_threads(threads);
+    set_second_pass_threads(threads);
+    pipeline_granted = (granted > 0);
+    progress("Jobserver: %d of %d extra thread(s) granted.\n", granted, wanted);
+}
+
+/*
+ * start_background_io - Starts the prefetch and writer threads for a batch
+ * @files: Input file arguments (without the .as extension)
+ * @file_count: Number of input files
+ * Returns: the .as paths given to the prefetcher (freed after stop_file_io),
+ * or NULL if all I/O stays on the main thread
+ *
+ * The .am files are then kept in memory while each file is assembled and
+ * handed to the writer thread afterwards.
+ */
+char** start_background_io(char *files[], int file_count) {
+    char **input_paths;
+    int i, j;
+    
+    input_paths = (char **)malloc(file_count * sizeof(char *));
+    if (input_paths == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < file_count; i++) {
+        input_paths[i] = (char *)malloc(strlen(files[i]) + strlen(AS_EXTENSION) + 1);
+        if (input_paths[i] == NULL) {
+            for (j = 0; j < i; j++) {
+                free(input_paths[j]);
+            }
+            free(input_paths);
+            return NULL;
+        }
+        strcpy(input_paths[i], files[i]);
+        strcat(input_paths[i], AS_EXTENSION);
+    }
+    
+    if (!start_file_io(input_paths, file_count)) {
+        for (i = 0; i < file_count; i++) {
+            free(input_paths[i]);
+        }
+        free(input_paths);
+        return NULL;
+    }
+    keep_sources_in_memory(SOURCES_DEFERRED);
+    background_io = 1;
+    deferred_am = 1;
+    return input_paths;
+}
+
+/*
+ * write_intermediate_file - Writes (or queues) a file's in-memory .am
+ * @base_name: Base filename of the file
+ */
+void write_intermediate_file(const char *base_name) {
+    char am_filename[MAX_LINE_LENGTH];
+    char *text;
+    size_t size;
+    
+    create_output_filename(base_name, AM_EXTENSION, am_filename);
+    text = take_source_file(am_filename, &size);
+    if (text != NULL) {
+        write_output_buffer(am_filename, text, size);
+    }
+}
@@ -5,9 +5,10 @@
  */
 
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 #include "data_structures.h"
+#include "symbol_names.h"
+#include "region.h"
 
 /* Global Variables Definitions */
 unsigned int instruction_image[MEMORY_SIZE];  /* Machine instruction storage */
@@ -20,50 +21,60 @@ int error_flag = 0;                           /* 0 = no errors, 1 = errors found
 
 
 
+static int grow_symbol_index(SymbolTable *table, int name_id);
+
 /* Symbol Table Functions */
 
+/* Starts an empty symbol table */
+void init_symbol_table(SymbolTable *table) {
+    table->head = NULL;
+    table->by_id = NULL;
+    table->id_capacity = 0;
+}
+
 /* Adds a new symbol to the symbol table */
-SymbolNode* add_symbol(SymbolNode **head, const char *name, int address, SymbolAttribute attribute) {
+SymbolNode* add_symbol(SymbolTable *table, int name_id, int address, SymbolAttribute attribute) {
     SymbolNode *new_node;
     
-    if (find_symbol(*head, name) != NULL) {
+    if (name_id == NO_NAME_ID || find_symbol(table, name_id) != NULL) {
+        return NULL;
+    }
+    if (name_id >= table->id_capacity && !grow_symbol_index(table, name_id)) {
         return NULL;
     }
     
-    new_node = (SymbolNode *)malloc(sizeof(SymbolNode));
+    new_node = (SymbolNode *)region_alloc(sizeof(SymbolNode));
     if (new_node == NULL) {
         return NULL;
     }
     
     /* Initialize the new symbol node */
-    strcpy(new_node->name, name);
+    new_node->name_id = name_id;
+    new_node->name = name_text(name_id);
     new_node->address = address;
     new_node->attribute = attribute;
+    new_node->external_id = -1;
+    new_node->columns = 0;
     new_node->next = NULL;
     
 
-    new_node->next = *head;
-    *head = new_node;
+    new_node->next = table->head;
+    table->head = new_node;
+    table->by_id[name_id] = new_node;
     return new_node;
 }
 
-/* Searches for a symbol in the symbol table */
-SymbolNode* find_symbol(SymbolNode *head, const char *name) {
-    SymbolNode *current = head;
-    
-    while (current != NULL) {
-        if (strcmp(current->name, name) == 0) {
-            return current;
-        }
-        current = current->next;
+/* Returns the symbol named by @name_id, or NULL; a single index lookup */
+SymbolNode* find_symbol(const SymbolTable *table, int name_id) {
+    if (name_id < 0 || name_id >= table->id_capacity) {
+        return NULL;
     }
-    
-    return NULL;
+    return table->by_id[name_id];
 }
 
 /* Updates all data symbol addresses by adding ICF */
-void update_data_symbols(SymbolNode *head, int icf) {
-    SymbolNode *current = head;
+void update_data_symbols(SymbolTable *table, int icf) {
+    SymbolNode *current = table->head;
     
     while (current != NULL) {
         if (current->attribute == DATA_SYMBOL) {
@@ -73,18 +84,34 @@ void update_data_symbols(SymbolNode *head, int icf) {
     }
 }
 
-/* Frees all memory allocated for the symbol table */
-void free_symbol_table(SymbolNode **head) {
-    SymbolNode *current = *head;
-    SymbolNode *next;
+/* Empties the symbol table; its nodes and index live in the file region */
+void free_symbol_table(SymbolTable *table) {
+    init_symbol_table(table);
+}
+
+/*
+ * Makes the id index large enough for @name_id; the old index is left to
+ * the next region reset
+ * Returns: 1 on success, 0 on allocation failure
+ */
+static int grow_symbol_index(SymbolTable *table, int name_id) {
+    SymbolNode **grown;
+    int capacity = table->id_capacity ? table->id_capacity : SYMBOL_INDEX_INITIAL_CAPACITY;
     
-    while (current != NULL) {
-        next = current->next;
-        free(current);
-        current = next;
+    while (capacity <= name_id) {
+        capacity *= 2;
     }
-    
-    *head = NULL;
+    grown = (SymbolNode **)region_alloc(capacity * sizeof(SymbolNode *));
+    if (grown == NULL) {
+        return 0;
+    }
+    if (table->id_capacity > 0) {
+        memcpy(grown, table->by_id, table->id_capacity * sizeof(SymbolNode *));
+    }
+    memset(grown + table->id_capacity, 0, (capacity - table->id_capacity) * sizeof(SymbolNode *));
+    table->by_id = grown;
+    table->id_capacity = capacity;
+    return 1;
 }
 
 /* Macro Table Functions */
@@ -97,20 +124,22 @@ MacroNode* add_macro(MacroNode **head, const char *name, const char *content) {
         return NULL;
     }
     
-    new_node = (MacroNode *)malloc(sizeof(MacroNode));
+    new_node = (MacroNode *)region_alloc(sizeof(MacroNode));
     if (new_node == NULL) {
         return NULL;
     }
     
-    new_node->content = (char *)malloc(strlen(content) + 1);
+    new_node->content = (char *)region_alloc(strlen(content) + 1);
     if (new_node->content == NULL) {
-        free(new_node);
         return NULL;
     }
     
     /* Initialize the new macro node */
     strcpy(new_node->name, name);
     strcpy(new_node->content, content);
+    new_node->expansion = NULL;
+    new_node->expanding = 0;
+    new_node->line_number = 0;
     new_node->next = NULL;
     
 
@@ -134,18 +163,8 @@ MacroNode* find_macro(MacroNode *head, const char *name) {
     return NULL;
 }
 
-/* Frees all memory allocated for the macro table */
+/* Empties the macro table; its nodes and texts live in the file region */
 void free_macro_table(MacroNode **head) {
-    MacroNode *current = *head;
-    MacroNode *next;
-    
-    while (current != NULL) {
-        next = current->next;
-        free(current->content); /* Free the content string */
-        free(current);
-        current = next;
-    }
-    
     *head = NULL;
 }
 
@@ -8,6 +8,7 @@
 #define DATA_STRUCTURES_H
 
 #define MAX_SYMBOL_NAME 31    /* Maximum length for symbol names */
+#define SYMBOL_INDEX_INITIAL_CAPACITY 64  /* Initial size of a symbol table's id index */
 #define MAX_MACRO_NAME 31     /* Maximum length for macro names */
 #define MAX_LINE_LENGTH 81    /* Maximum length for input lines */
 #define MEMORY_SIZE 256       /* Total memory size available */
@@ -31,16 +32,29 @@ typedef enum {
 
 
 typedef struct SymbolNode {
-    char name[MAX_SYMBOL_NAME];
+    int name_id;        /* Interned name, see symbol_names.h */
+    const char *name;   /* Text of the name, for output only */
     int address;
     SymbolAttribute attribute;
+    int external_id;    /* Index in the external use table, -1 until first use */
+    int columns;        /* Row length of a .mat symbol, 0 for other symbols */
     struct SymbolNode *next;
 } SymbolNode;
 
 
+typedef struct {
+    SymbolNode *head;       /* Every symbol, newest first */
+    SymbolNode **by_id;     /* Symbol of each name id, NULL where the name is not defined */
+    int id_capacity;
+} SymbolTable;
+
+
 typedef struct MacroNode {
     char name[MAX_MACRO_NAME];
     char *content;
+    char *expansion;    /* Content with nested calls expanded, NULL until first needed */
+    int expanding;      /* 1 while the expansion is being built, to catch call cycles */
+    int line_number;    /* Line of the definition */
     struct MacroNode *next;
 } MacroNode;
 
@@ -58,10 +72,11 @@ extern int error_flag;
 
 
 
-SymbolNode* add_symbol(SymbolNode **head, const char *name, int address, SymbolAttribute attribute);
-SymbolNode* find_symbol(SymbolNode *head, const char *name);
-void update_data_symbols(SymbolNode *head, int icf);
-void free_symbol_table(SymbolNode **head);
+void init_symbol_table(SymbolTable *table);
+SymbolNode* add_symbol(SymbolTable *table, int name_id, int address, SymbolAttribute attribute);
+SymbolNode* find_symbol(const SymbolTable *table, int name_id);
+void update_data_symbols(SymbolTable *table, int icf);
+void free_symbol_table(SymbolTable *table);
 
 
 MacroNode* add_macro(MacroNode **head, const char *name, const char *content);
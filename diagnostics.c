@@ -0,0 +1,257 @@
+/*
+ * diagnostics.c
+ * Implementation of the buffered diagnostics engine
+ * All access to the buffer is serialized so parallel drivers can report
+ * from several threads at once
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "diagnostics.h"
+
+
+static Diagnostic *diagnostics = NULL;     /* Buffered diagnostics of the current file */
+static int diagnostics_count = 0;
+static int diagnostics_capacity = 0;
+static char **file_names = NULL;           /* Distinct file names, in order of first report */
+static int file_count = 0;
+static unsigned long next_sequence = 0;
+static int max_errors = 0;                 /* 0 = unlimited */
+static int reported_errors = 0;            /* Reports received, including dropped ones */
+static pthread_mutex_t diagnostics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void record_diagnostic(const char *filename, int line_number, const char *message);
+static int find_file_rank(const char *filename);
+static char* copy_string(const char *str);
+static int compare_diagnostics(const void *a, const void *b);
+static void clear_diagnostics(void);
+
+
+/*
+ * Records one diagnostic for later output
+ * Once the --max-errors limit is reached further reports are dropped
+ */
+void report_diagnostic(const char *filename, int line_number, const char *message) {
+    pthread_mutex_lock(&diagnostics_lock);
+    record_diagnostic(filename, line_number, message);
+    pthread_mutex_unlock(&diagnostics_lock);
+}
+
+
+/*
+ * Records an error and raises @flag under the same lock, so worker threads
+ * can fail a file without racing the threads that read or reset the flag
+ */
+void report_error(const char *filename, int line_number, const char *message, int *flag) {
+    pthread_mutex_lock(&diagnostics_lock);
+    record_diagnostic(filename, line_number, message);
+    *flag = 1;
+    pthread_mutex_unlock(&diagnostics_lock);
+}
+
+
+/* Sets how many errors a file may report before its phases stop early */
+void set_max_errors(int limit) {
+    pthread_mutex_lock(&diagnostics_lock);
+    max_errors = (limit > 0) ? limit : 0;
+    pthread_mutex_unlock(&diagnostics_lock);
+}
+
+
+/* Returns 1 when the current file has reported --max-errors errors */
+int error_limit_reached(void) {
+    int reached;
+
+    pthread_mutex_lock(&diagnostics_lock);
+    reached = (max_errors > 0 && reported_errors >= max_errors);
+    pthread_mutex_unlock(&diagnostics_lock);
+    return reached;
+}
+
+
+/* Returns the --max-errors limit (0 = unlimited) */
+int get_max_errors(void) {
+    int limit;
+
+    pthread_mutex_lock(&diagnostics_lock);
+    limit = max_errors;
+    pthread_mutex_unlock(&diagnostics_lock);
+    return limit;
+}
+
+
+/* Returns the number of diagnostics currently buffered */
+int diagnostic_count(void) {
+    int count;
+
+    pthread_mutex_lock(&diagnostics_lock);
+    count = diagnostics_count;
+    pthread_mutex_unlock(&diagnostics_lock);
+    return count;
+}
+
+
+/*
+ * Writes the buffered diagnostics in (file, line) order, skipping exact
+ * duplicates, and empties the buffer for the next file
+ * Returns: number of diagnostics written
+ */
+int flush_diagnostics(FILE *stream) {
+    int i, j;
+    int written = 0;
+    int duplicate;
+
+    pthread_mutex_lock(&diagnostics_lock);
+
+    if (diagnostics_count > 1) {
+        qsort(diagnostics, diagnostics_count, sizeof(Diagnostic), compare_diagnostics);
+    }
+
+    for (i = 0; i < diagnostics_count; i++) {
+        /* Duplicates can only appear earlier on the same (file, line) */
+        duplicate = 0;
+        for (j = i - 1; j >= 0 && !duplicate; j--) {
+            if (diagnostics[j].file_rank != diagnostics[i].file_rank ||
+                diagnostics[j].line_number != diagnostics[i].line_number) {
+                break;
+            }
+            duplicate = (strcmp(diagnostics[j].message, diagnostics[i].message) == 0);
+        }
+        if (duplicate) {
+            continue;
+        }
+        fprintf(stream, "Error in file %s, line %d: %s\n",
+                diagnostics[i].filename, diagnostics[i].line_number, diagnostics[i].message);
+        written++;
+    }
+
+    if (max_errors > 0 && reported_errors > max_errors) {
+        fprintf(stream, "Too many errors (limit is %d); remaining diagnostics suppressed\n", max_errors);
+    }
+    fflush(stream);
+
+    clear_diagnostics();
+
+    pthread_mutex_unlock(&diagnostics_lock);
+    return written;
+}
+
+
+/* Returns the rank of a file name, registering it on first use (-1 on allocation failure) */
+static int find_file_rank(const char *filename) {
+    char **grown;
+    int i;
+
+    for (i = 0; i < file_count; i++) {
+        if (strcmp(file_names[i], filename) == 0) {
+            return i;
+        }
+    }
+
+    grown = (char **)realloc(file_names, (file_count + 1) * sizeof(char *));
+    if (grown == NULL) {
+        return -1;
+    }
+    file_names = grown;
+
+    file_names[file_count] = copy_string(filename);
+    if (file_names[file_count] == NULL) {
+        return -1;
+    }
+    return file_count++;
+}
+
+
+static char* copy_string(const char *str) {
+    char *copy = (char *)malloc(strlen(str) + 1);
+
+    if (copy != NULL) {
+        strcpy(copy, str);
+    }
+    return copy;
+}
+
+
+static int compare_diagnostics(const void *a, const void *b) {
+    const Diagnostic *first = (const Diagnostic *)a;
+    const Diagnostic *second = (const Diagnostic *)b;
+
+    if (first->file_rank != second->file_rank) {
+        return (first->file_rank < second->file_rank) ? -1 : 1;
+    }
+    if (first->line_number != second->line_number) {
+        return (first->line_number < second->line_number) ? -1 : 1;
+    }
+    if (first->sequence != second->sequence) {
+        return (first->sequence < second->sequence) ? -1 : 1;
+    }
+    return 0;
+}
+
+
+/* Releases every buffered diagnostic; called with the lock held */
+static void clear_diagnostics(void) {
+    int i;
+
+    for (i = 0; i < diagnostics_count; i++) {
+        free(diagnostics[i].message);
+    }
+    for (i = 0; i < file_count; i++) {
+        free(file_names[i]);
+    }
+
+    free(diagnostics);
+    free(file_names);
+    diagnostics = NULL;
+    file_names = NULL;
+    diagnostics_count = 0;
+    diagnostics_capacity = 0;
+    file_count = 0;
+    next_sequence = 0;
+    reported_errors = 0;
+}
+
+
+/* Adds one diagnostic to the buffer; the caller holds diagnostics_lock */
+static void record_diagnostic(const char *filename, int line_number, const char *message) {
+    Diagnostic *grown;
+    Diagnostic *entry;
+    int rank;
+
+    reported_errors++;
+    if (max_errors > 0 && reported_errors > max_errors) {
+        return;
+    }
+
+    if (diagnostics_count == diagnostics_capacity) {
+        int new_capacity = diagnostics_capacity ? diagnostics_capacity * 2 : DIAG_INITIAL_CAPACITY;
+        grown = (Diagnostic *)realloc(diagnostics, new_capacity * sizeof(Diagnostic));
+        if (grown == NULL) {
+            /* Out of memory: fall back to unbuffered output */
+            fprintf(stderr, "Error in file %s, line %d: %s\n", filename, line_number, message);
+            return;
+        }
+        diagnostics = grown;
+        diagnostics_capacity = new_capacity;
+    }
+
+    rank = find_file_rank(filename);
+    entry = &diagnostics[diagnostics_count];
+    entry->filename = (rank >= 0) ? file_names[rank] : NULL;
+    entry->message = copy_string(message);
+    entry->line_number = line_number;
+    entry->file_rank = rank;
+    entry->sequence = next_sequence++;
+
+    if (entry->filename == NULL || entry->message == NULL) {
+        free(entry->message);
+        fprintf(stderr, "Error in file %s, line %d: %s\n", filename, line_number, message);
+    } else {
+        diagnostics_count++;
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ * diagnostics.h
+ * Buffered diagnostics engine for the assembler project
+ * Collects error messages for the file being assembled and emits them once,
+ * sorted by (file, line) and deduplicated
+ */
+
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stdio.h>
+
+#define DIAG_INITIAL_CAPACITY 32   /* Initial number of buffered diagnostics */
+
+
+typedef struct {
+    char *filename;
+    char *message;
+    int line_number;
+    int file_rank;          /* Order in which the file first reported an error */
+    unsigned long sequence; /* Order of reporting, keeps the sort stable */
+} Diagnostic;
+
+
+
+
+void report_diagnostic(const char *filename, int line_number, const char *message);
+
+
+void report_error(const char *filename, int line_number, const char *message, int *flag);
+
+
+void set_max_errors(int limit);
+
+
+int error_limit_reached(void);
+
+
+int get_max_errors(void);
+
+
+int diagnostic_count(void);
+
+
+int flush_diagnostics(FILE *stream);
+
+#endif /* DIAGNOSTICS_H */
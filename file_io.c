@@ -0,0 +1,452 @@
+/*
+ * file_io.c
+ * Implementation of background file I/O
+ * Inputs are read whole, in command line order, at most PREFETCH_DEPTH
+ * files ahead, and handed out as memory streams. Outputs are collected in
+ * memory streams and queued on close; the writer thread writes them in
+ * queue order. Without start_file_io every call falls back to plain files.
+ * With set_write_if_changed, outputs are always built in memory and a file
+ * is only replaced (through a temporary file and rename) if its contents
+ * differ, so unchanged outputs keep their modification time.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "file_io.h"
+#include "diagnostics.h"
+#include "utils.h"
+
+
+/* An input file read ahead; text is NULL if it could not be read */
+typedef struct {
+    const char *filename;
+    char *text;
+    size_t size;
+    int ready;
+} PrefetchSlot;
+
+
+/* An output file waiting to be written */
+typedef struct OutputBuffer {
+    char *filename;
+    char *text;
+    size_t size;
+    FILE *stream;              /* Memory stream while still open, else NULL */
+    struct OutputBuffer *next;
+} OutputBuffer;
+
+
+static void* prefetch_worker(void *arg);
+static void* writer_worker(void *arg);
+static void queue_output(OutputBuffer *output);
+static void deliver_output(OutputBuffer *output);
+static int store_output(const char *filename, const char *text, size_t size);
+static int has_contents(const char *filename, const char *text, size_t size);
+
+
+static int io_active = 0;
+static int only_changed = 0;       /* 1 = leave files whose contents are unchanged alone */
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefetch_changed = PTHREAD_COND_INITIALIZER;  /* Slot ready or consumed */
+static pthread_cond_t output_queued = PTHREAD_COND_INITIALIZER;
+static int stopping = 0;
+
+static pthread_t prefetch_thread;
+static PrefetchSlot *slots = NULL;
+static int slot_count = 0;
+static int next_slot = 0;          /* First slot not yet handed out */
+
+static pthread_t writer_thread;
+static OutputBuffer *open_outputs = NULL;
+static OutputBuffer *queue_head = NULL;
+static OutputBuffer *queue_tail = NULL;
+static int write_failures = 0;
+
+
+/*
+ * Starts the prefetch and writer threads for @input_files, in the order
+ * they will be opened
+ * Returns: 1 if the threads run, 0 if I/O stays on the calling thread
+ */
+int start_file_io(char **input_files, int count) {
+    int i;
+
+    slots = (PrefetchSlot *)calloc(count > 0 ? count : 1, sizeof(PrefetchSlot));
+    if (slots == NULL) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        slots[i].filename = input_files[i];
+    }
+    slot_count = count;
+    next_slot = 0;
+    stopping = 0;
+    write_failures = 0;
+
+    if (pthread_create(&prefetch_thread, NULL, prefetch_worker, NULL) != 0) {
+        free(slots);
+        slots = NULL;
+        return 0;
+    }
+    if (pthread_create(&writer_thread, NULL, writer_worker, NULL) != 0) {
+        pthread_mutex_lock(&io_lock);
+        stopping = 1;
+        pthread_cond_broadcast(&prefetch_changed);
+        pthread_mutex_unlock(&io_lock);
+        pthread_join(prefetch_thread, NULL);
+        free(slots);
+        slots = NULL;
+        return 0;
+    }
+
+    io_active = 1;
+    return 1;
+}
+
+
+/* Replaces output files only when their contents change (enabled = 1) */
+void set_write_if_changed(int enabled) {
+    only_changed = enabled;
+}
+
+
+/*
+ * Opens an input file for reading, from memory if it was prefetched. Files
+ * listed before it are taken as skipped, and the previous file's memory is
+ * released, so open them in order and close each before the next
+ * Returns: the stream, or NULL if the file cannot be read
+ */
+FILE* open_input_file(const char *filename) {
+    FILE *file = NULL;
+    int i, found = -1;
+
+    if (!io_active) {
+        return fopen(filename, "r");
+    }
+
+    pthread_mutex_lock(&io_lock);
+    for (i = next_slot; i < slot_count && found < 0; i++) {
+        if (strcmp(slots[i].filename, filename) == 0) {
+            found = i;
+        }
+    }
+    if (found < 0) {
+        pthread_mutex_unlock(&io_lock);
+        return fopen(filename, "r");
+    }
+
+    /* Earlier files are done with (or were skipped) */
+    for (i = 0; i < found; i++) {
+        free(slots[i].text);
+        slots[i].text = NULL;
+    }
+    next_slot = found + 1;
+    pthread_cond_broadcast(&prefetch_changed);
+
+    while (!slots[found].ready) {
+        pthread_cond_wait(&prefetch_changed, &io_lock);
+    }
+    /* An empty memory stream cannot be opened; those go to the file */
+    if (slots[found].text != NULL && slots[found].size > 0) {
+        file = fmemopen(slots[found].text, slots[found].size, "r");
+    }
+    pthread_mutex_unlock(&io_lock);
+
+    return (file != NULL) ? file : fopen(filename, "r");
+}
+
+
+/*
+ * Opens an output file for writing; with the writer thread running (or in
+ * write-if-changed mode) it is collected in memory and stored once
+ * close_output_file is called
+ * Returns: the stream, or NULL on failure
+ */
+FILE* open_output_file(const char *filename) {
+    OutputBuffer *output;
+
+    if (!io_active && !only_changed) {
+        return fopen(filename, "w");
+    }
+
+    output = (OutputBuffer *)calloc(1, sizeof(OutputBuffer));
+    if (output == NULL) {
+        return NULL;
+    }
+    output->filename = (char *)malloc(strlen(filename) + 1);
+    if (output->filename != NULL) {
+        strcpy(output->filename, filename);
+        output->stream = open_memstream(&output->text, &output->size);
+    }
+    if (output->stream == NULL) {
+        free(output->filename);
+        free(output);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&io_lock);
+    output->next = open_outputs;
+    open_outputs = output;
+    pthread_mutex_unlock(&io_lock);
+    return output->stream;
+}
+
+
+/*
+ * Closes a stream from open_output_file, passing it to the writer
+ * Returns: 1 on success, 0 on failure
+ */
+int close_output_file(FILE *file) {
+    OutputBuffer **link, *output = NULL;
+
+    pthread_mutex_lock(&io_lock);
+    for (link = &open_outputs; *link != NULL; link = &(*link)->next) {
+        if ((*link)->stream == file) {
+            output = *link;
+            *link = output->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&io_lock);
+
+    if (output == NULL) {
+        return (fclose(file) == 0);
+    }
+    if (fclose(file) != 0) {
+        free(output->text);
+        free(output->filename);
+        free(output);
+        return 0;
+    }
+    output->stream = NULL;
+    deliver_output(output);
+    return 1;
+}
+
+
+/*
+ * Writes @size bytes of @text (malloc'd; taken over) to @filename, on the
+ * writer thread if it runs
+ */
+void write_output_buffer(const char *filename, char *text, size_t size) {
+    OutputBuffer *output;
+
+    output = (OutputBuffer *)calloc(1, sizeof(OutputBuffer));
+    if (output != NULL && (output->filename = (char *)malloc(strlen(filename) + 1)) != NULL) {
+        strcpy(output->filename, filename);
+        output->text = text;
+        output->size = size;
+        deliver_output(output);
+        return;
+    }
+
+    free(output);
+    if (!store_output(filename, text, size)) {
+        print_error(filename, 0, "Cannot write output file");
+    }
+    free(text);
+}
+
+
+/*
+ * Waits for the queued outputs to be written and stops both threads
+ * Returns: the number of outputs that could not be written (reported)
+ */
+int stop_file_io(void) {
+    int i;
+
+    if (!io_active) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&io_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&prefetch_changed);
+    pthread_cond_broadcast(&output_queued);
+    pthread_mutex_unlock(&io_lock);
+    pthread_join(prefetch_thread, NULL);
+    pthread_join(writer_thread, NULL);
+
+    for (i = 0; i < slot_count; i++) {
+        free(slots[i].text);
+    }
+    free(slots);
+    slots = NULL;
+    slot_count = 0;
+    io_active = 0;
+    return write_failures;
+}
+
+
+/* Reads the inputs in order, staying at most PREFETCH_DEPTH files ahead */
+static void* prefetch_worker(void *arg) {
+    int i;
+    char *text;
+    size_t size;
+
+    (void)arg;
+    for (i = 0; i < slot_count; i++) {
+        pthread_mutex_lock(&io_lock);
+        while (i >= next_slot + PREFETCH_DEPTH && !stopping) {
+            pthread_cond_wait(&prefetch_changed, &io_lock);
+        }
+        if (stopping) {
+            pthread_mutex_unlock(&io_lock);
+            break;
+        }
+        pthread_mutex_unlock(&io_lock);
+
+        size = 0;
+        text = read_whole_file(slots[i].filename, &size);
+
+        pthread_mutex_lock(&io_lock);
+        slots[i].text = text;
+        slots[i].size = size;
+        slots[i].ready = 1;
+        if (i < next_slot - 1) {
+            /* Skipped while it was being read */
+            free(slots[i].text);
+            slots[i].text = NULL;
+        }
+        pthread_cond_broadcast(&prefetch_changed);
+        pthread_mutex_unlock(&io_lock);
+    }
+    return NULL;
+}
+
+
+/* Writes queued outputs until stopped and the queue is empty */
+static void* writer_worker(void *arg) {
+    OutputBuffer *output;
+
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&io_lock);
+        while (queue_head == NULL && !stopping) {
+            pthread_cond_wait(&output_queued, &io_lock);
+        }
+        output = queue_head;
+        if (output == NULL) {
+            pthread_mutex_unlock(&io_lock);
+            break;
+        }
+        queue_head = output->next;
+        if (queue_head == NULL) {
+            queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&io_lock);
+
+        if (!store_output(output->filename, output->text, output->size)) {
+            /* Not print_error: error_flag belongs to the file being assembled */
+            report_diagnostic(output->filename, 0, "Cannot write output file");
+            pthread_mutex_lock(&io_lock);
+            write_failures++;
+            pthread_mutex_unlock(&io_lock);
+        }
+
+        free(output->text);
+        free(output->filename);
+        free(output);
+    }
+    return NULL;
+}
+
+
+static void queue_output(OutputBuffer *output) {
+    pthread_mutex_lock(&io_lock);
+    output->next = NULL;
+    if (queue_tail == NULL) {
+        queue_head = output;
+    } else {
+        queue_tail->next = output;
+    }
+    queue_tail = output;
+    pthread_cond_signal(&output_queued);
+    pthread_mutex_unlock(&io_lock);
+}
+
+
+/* Queues @output for the writer thread, or stores it at once if there is none */
+static void deliver_output(OutputBuffer *output) {
+    if (io_active) {
+        queue_output(output);
+        return;
+    }
+    if (!store_output(output->filename, output->text, output->size)) {
+        print_error(output->filename, 0, "Cannot write output file");
+    }
+    free(output->text);
+    free(output->filename);
+    free(output);
+}
+
+
+/*
+ * Writes @size bytes of @text to @filename; in write-if-changed mode an
+ * identical file is left alone and a different one is replaced by rename,
+ * so readers never see it half written
+ * Returns: 1 on success, 0 on failure
+ */
+static int store_output(const char *filename, const char *text, size_t size) {
+    char temp_filename[FILENAME_MAX];
+    const char *target = filename;
+    FILE *file;
+    int written;
+
+    if (only_changed) {
+        if (has_contents(filename, text, size)) {
+            return 1;
+        }
+        if (strlen(filename) + 32 > sizeof(temp_filename)) {
+            return 0;
+        }
+        sprintf(temp_filename, "%s.%ld.tmp", filename, (long)getpid());
+        target = temp_filename;
+    }
+
+    file = fopen(target, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    written = (fwrite(text, 1, size, file) == size);
+    if (fclose(file) != 0) {
+        written = 0;
+    }
+
+    if (target != filename && (!written || rename(target, filename) != 0)) {
+        remove(target);
+        return 0;
+    }
+    return written;
+}
+
+
+/* Returns 1 if @filename is a regular file holding exactly @size bytes of @text */
+static int has_contents(const char *filename, const char *text, size_t size) {
+    struct stat status;
+    char block[4096];
+    FILE *file;
+    size_t offset = 0, length;
+    int same = 1;
+
+    if (stat(filename, &status) != 0 || !S_ISREG(status.st_mode) || (size_t)status.st_size != size) {
+        return 0;
+    }
+
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    while (same && (length = fread(block, 1, sizeof(block), file)) > 0) {
+        same = (offset + length <= size && memcmp(block, text + offset, length) == 0);
+        offset += length;
+    }
+    fclose(file);
+    return same && offset == size;
+}
@@ -0,0 +1,38 @@
+/*
+ * file_io.h
+ * Background file I/O for multi-file runs
+ * A prefetch thread reads the next input files into memory and a writer
+ * thread writes finished output files, so the assembling thread does not
+ * wait on the disk; outputs can also be written only when they change
+ */
+
+#ifndef FILE_IO_H
+#define FILE_IO_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define PREFETCH_DEPTH 4   /* Input files read ahead of the one being assembled */
+
+
+int start_file_io(char **input_files, int count);
+
+
+void set_write_if_changed(int enabled);
+
+
+FILE* open_input_file(const char *filename);
+
+
+FILE* open_output_file(const char *filename);
+
+
+int close_output_file(FILE *file);
+
+
+void write_output_buffer(const char *filename, char *text, size_t size);
+
+
+int stop_file_io(void);
+
+#endif /* FILE_IO_H */
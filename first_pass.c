@@ -4,89 +4,618 @@
  * Builds symbol table and calculates memory requirements
  */
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "first_pass.h"
 #include "utils.h"
 #include "data_structures.h"
+#include "diagnostics.h"
+#include "source.h"
+#include "line_ring.h"
+#include "opcode_table.h"
+
+#define MIN_LINES_PER_CHUNK 64   /* Smaller chunks are not worth a thread */
+
+#define INCBIN_WORD_SIZE 2   /* Bytes per word in an .incbin file (little-endian) */
+
+#define LIST_CLOSED 0       /* No value list is open */
+#define LIST_OPEN 1         /* The last .data/.mat line ended with a comma */
+#define LIST_ABANDONED 2    /* As LIST_OPEN, but the list had an error; skip the rest */
+
+
+/*
+ * Counters and outputs of a first pass over a range of lines.
+ * The sequential pass works on the global IC, DC and data_image; a
+ * parallel chunk works on its own copies and is stitched in afterwards.
+ */
+typedef struct {
+    const char *filename;
+    SymbolTable *symbol_table;
+    int ic;
+    int dc;
+    unsigned int *data;
+    int *line_addresses;    /* IC at the start of each line */
+    int *line_data_offsets; /* DC at the start of each line */
+    int list_state;     /* LIST_OPEN while a value list continues on the next line */
+    int list_remaining; /* Values a continued .mat still needs, -1 for .data */
+    int speculative;    /* 1 = abandon the chunk on the first error instead of reporting it */
+    int deferred;       /* 1 = hold errors until finish_first_pass_stream decides to keep them */
+    int failed;
+} FirstPassState;
+
+
+typedef struct {
+    int line_number;
+    const char *message;
+} DeferredError;
 
 
-static int process_line_first_pass(char *line, int line_number, const char *filename, SymbolNode **symbol_table);
-static int handle_label_definition(ParsedLine *parsed, int line_number, const char *filename, SymbolNode **symbol_table);
-static int process_data_directive_parsed(ParsedLine *parsed, int line_number, const char *filename);
-static int process_string_directive_parsed(ParsedLine *parsed, int line_number, const char *filename);
-static int process_extern_directive_parsed(ParsedLine *parsed, int line_number, const char *filename, SymbolNode **symbol_table);
-static int process_mat_directive_parsed(ParsedLine *parsed, int line_number, const char *filename);
-static int handle_directive_first_pass(ParsedLine *parsed, int line_number, const char *filename, SymbolNode **symbol_table);
-static int process_instruction_parsed(ParsedLine *parsed, int line_number, const char *filename);
-static int handle_instruction_first_pass(ParsedLine *parsed, int line_number, const char *filename);
-static int finalize_first_pass(SymbolNode *symbol_table);
+typedef struct {
+    const SourceFile *source;
+    int first_line;
+    int last_line;
+    SymbolTable symbols;
+    unsigned int data[MEMORY_SIZE];
+    FirstPassState state;
+    pthread_t thread;
+    int started;
+    int ic_base;
+    int dc_base;
+} FirstPassChunk;
 
 
-int first_pass(const char *full_path, const char *base_name, SymbolNode **symbol_table) {
-    FILE *input_file;
+static int first_pass_threads = 1;
+static int *line_addresses = NULL;  /* IC at the start of every line of the last file */
+static int *line_data_offsets = NULL;  /* DC at the start of every line of the last file */
+static int line_address_count = 0;
+static DeferredError *deferred_errors = NULL;  /* Errors of a pipelined first pass */
+static int deferred_count = 0;
+static int deferred_capacity = 0;
+static DeferredError lost_error;     /* First deferred error that found no room */
+static int errors_lost = 0;          /* 1 once a deferred error could not be queued */
+static char stream_filename[MAX_LINE_LENGTH];
+static char source_directory[MAX_LINE_LENGTH];  /* Directory of the .as file, with its '/', or "" */
+
+
+static void first_pass_lines(const SourceFile *source, int first_line, int last_line, FirstPassState *state);
+static void first_pass_line(char *line, int index, FirstPassState *state);
+static int first_pass_should_stop(FirstPassState *state);
+static int process_line_first_pass(char *line, int line_number, FirstPassState *state);
+static const InstructionForm* validate_instruction_operands(int opcode, const char *src_operand, const char *dest_operand, int line_number, FirstPassState *state);
+static int handle_label_definition(ParsedLine *parsed, int line_number, FirstPassState *state);
+static int process_data_directive_parsed(ParsedLine *parsed, int line_number, FirstPassState *state);
+static int process_string_directive_parsed(ParsedLine *parsed, int line_number, FirstPassState *state);
+static int process_extern_directive_parsed(ParsedLine *parsed, int line_number, FirstPassState *state);
+static int process_mat_directive_parsed(ParsedLine *parsed, int line_number, FirstPassState *state);
+static int store_value_list(const char *text, int line_number, FirstPassState *state);
+static int process_incbin_directive_parsed(ParsedLine *parsed, int line_number, FirstPassState *state);
+static int process_fill_directive_parsed(ParsedLine *parsed, int line_number, FirstPassState *state);
+static int fill_data(long count, unsigned int word, int line_number, FirstPassState *state);
+static int scan_fill_value(const char *text, unsigned int *word);
+static int parse_incbin_operands(const char *text, char *filename, long *offset, long *length);
+static void set_source_directory(const char *full_path);
+static void continue_value_list(char *line, int line_number, FirstPassState *state);
+static void close_value_list(int line_number, FirstPassState *state);
+static int handle_directive_first_pass(ParsedLine *parsed, int line_number, FirstPassState *state);
+static int process_instruction_parsed(ParsedLine *parsed, int line_number, FirstPassState *state);
+static int handle_instruction_first_pass(ParsedLine *parsed, int line_number, FirstPassState *state);
+static int finalize_first_pass(SymbolTable *symbol_table);
+static int data_fits(const FirstPassState *state, long count);
+static int store_string_data(const char *string_literal, int line_number, FirstPassState *state);
+static void report_first_pass_error(FirstPassState *state, int line_number, const char *error_message);
+static int parallel_first_pass(const SourceFile *source, const char *filename, SymbolTable *symbol_table);
+static void* first_pass_worker(void *arg);
+static int stitch_chunk_symbols(FirstPassChunk *chunk, SymbolTable *symbol_table);
+
+
+int first_pass(const char *full_path, const char *base_name, SymbolTable *symbol_table) {
+    SourceFile source;
+    FirstPassState state;
     char input_filename[MAX_LINE_LENGTH];
-    char line[MAX_LINE_LENGTH];
-    int line_number = 0;
-    int c;
     extern int error_flag;
     
     /* Reset counters and memory */
     reset_counters();
     reset_memory_images();
+    set_source_directory(full_path);
     
     /* Create input filename with .am extension - use base_name since .am is already in same dir as executable */
     strcpy(input_filename, base_name);
     strcat(input_filename, ".am");
     
-    /* Open input file */
-    input_file = fopen(input_filename, "r");
-    if (input_file == NULL) {
+    /* Read the whole input file */
+    free(line_addresses);
+    free(line_data_offsets);
+    line_addresses = NULL;
+    line_data_offsets = NULL;
+    line_address_count = 0;
+    if (!load_source_file(input_filename, &source)) {
         print_error(input_filename, 0, "Cannot open input file");
         return 0;
     }
     
-    /* Process each line of the input file - simple approach */
-    while (fgets(line, sizeof(line), input_file) != NULL) {
-        line_number++;
+    /* One extra entry holds the final IC */
+    line_addresses = (int *)malloc((source.line_count + 1) * sizeof(int));
+    line_data_offsets = (int *)malloc((source.line_count + 1) * sizeof(int));
+    if (line_addresses == NULL || line_data_offsets == NULL) {
+        free(line_addresses);
+        free(line_data_offsets);
+        line_addresses = NULL;
+        line_data_offsets = NULL;
+    } else {
+        line_address_count = source.line_count;
+    }
+    
+    /* Try the parallel pass first; it backs off to the sequential one on any error */
+    if (first_pass_threads < 2 || !parallel_first_pass(&source, input_filename, symbol_table)) {
+        state.filename = input_filename;
+        state.symbol_table = symbol_table;
+        state.ic = IC;
+        state.dc = DC;
+        state.data = data_image;
+        state.line_addresses = line_addresses;
+        state.line_data_offsets = line_data_offsets;
+        state.list_state = LIST_CLOSED;
+        state.list_remaining = -1;
+        state.speculative = 0;
+        state.deferred = 0;
+        state.failed = 0;
         
-        /* Check line length - must not exceed 80 characters */
-                 if (strchr(line, '\n') == NULL && !feof(input_file)) {
-             print_error(input_filename, line_number, "Line is longer than 80 characters");
-             /* Read rest of line to start clean on next line */
-             while ((c = fgetc(input_file)) != '\n' && c != EOF);
-            continue; /* Skip processing the invalid line */
+        first_pass_lines(&source, 0, source.line_count, &state);
+        if (line_addresses != NULL) {
+            line_addresses[source.line_count] = state.ic;
+            line_data_offsets[source.line_count] = state.dc;
         }
         
-        /* Skip empty lines and comments */
-        if (is_empty_line(line) || is_comment_line(line)) {
+        IC = state.ic;
+        DC = state.dc;
+    }
+    
+    free_source_file(&source);
+    
+    /* Finalize the first pass if no errors found so far */
+    if (error_flag == 0) {
+        finalize_first_pass(symbol_table);
+    }
+    return (error_flag == 0);
+}
+
+
+/*
+ * Returns the IC at the start of each line of the last file, plus the final
+ * IC at index *line_count, so the second pass can place lines directly
+ * Returns NULL if the addresses are not available
+ */
+const int* get_line_addresses(int *line_count) {
+    *line_count = line_address_count;
+    return line_addresses;
+}
+
+
+/*
+ * Returns the DC at the start of each line of the last file, plus the
+ * final DC, laid out like get_line_addresses
+ */
+const int* get_line_data_offsets(int *line_count) {
+    *line_count = line_address_count;
+    return line_data_offsets;
+}
+
+
+/*
+ * Replaces the line addresses after the optimizer moved code
+ * @addresses: line_count + 1 entries, laid out like get_line_addresses
+ */
+void set_line_addresses(const int *addresses) {
+    if (line_addresses != NULL) {
+        memcpy(line_addresses, addresses, (line_address_count + 1) * sizeof(int));
+    }
+}
+
+
+/* Sets how many threads the first pass may split a file across */
+void set_first_pass_threads(int count) {
+    first_pass_threads = (count > 0) ? count : 1;
+}
+
+
+/* Runs the first pass over lines [first_line, last_line) of the source */
+static void first_pass_lines(const SourceFile *source, int first_line, int last_line, FirstPassState *state) {
+    int i;
+    
+    for (i = first_line; i < last_line && !state->failed; i++) {
+        /* Stop early once the --max-errors limit has been reached */
+        if (first_pass_should_stop(state)) {
+            break;
+        }
+        first_pass_line(source->lines[i], i, state);
+    }
+    
+    if (i == last_line) {
+        close_value_list(last_line, state);
+    }
+}
+
+
+/* Runs the first pass on one line; @index is its zero-based position in the file */
+static void first_pass_line(char *line, int index, FirstPassState *state) {
+    int line_number = index + 1;
+    
+    if (state->line_addresses != NULL) {
+        state->line_addresses[index] = state->ic;
+        state->line_data_offsets[index] = state->dc;
+    }
+    
+    /* Check line length - must not exceed 80 characters */
+    if (is_line_too_long(line)) {
+        report_first_pass_error(state, line_number, "Line is longer than 80 characters");
+        if (state->list_state != LIST_CLOSED) {
+            state->list_state = ends_with_comma(line) ? LIST_ABANDONED : LIST_CLOSED;
+        }
+        return; /* Skip processing the invalid line */
+    }
+    
+    /* Skip empty lines and comments */
+    if (is_empty_line(line) || is_comment_line(line)) {
+        return;
+    }
+    
+    /* A line after a trailing comma holds more values of the same list */
+    if (state->list_state != LIST_CLOSED) {
+        continue_value_list(line, line_number, state);
+        return;
+    }
+    
+    /* Process the line - continue even if errors found (as required) */
+    process_line_first_pass(line, line_number, state);
+}
+
+
+/* Returns 1 once the --max-errors limit has been reached */
+static int first_pass_should_stop(FirstPassState *state) {
+    if (state->speculative) {
+        return 0;
+    }
+    if (state->deferred) {
+        return errors_lost || (get_max_errors() > 0 && deferred_count >= get_max_errors());
+    }
+    return error_limit_reached();
+}
+
+
+/*
+ * Runs the first pass on lines streamed from the pre-assembler (pipeline mode).
+ * Errors are held back, because they only count if the pre-assembler
+ * succeeds; call finish_first_pass_stream once the pre-assembler is done.
+ * The ring is always drained so the producer never blocks.
+ * Returns: 1 if no errors were found
+ */
+int first_pass_stream(LineRing *ring, const char *full_path, const char *base_name, SymbolTable *symbol_table) {
+    FirstPassState state;
+    char line[LINE_RING_LINE_SIZE];
+    int *grown;
+    int capacity = 0;
+    int index = 0;
+    
+    reset_counters();
+    reset_memory_images();
+    set_source_directory(full_path);
+    
+    free(line_addresses);
+    free(line_data_offsets);
+    line_addresses = NULL;
+    line_data_offsets = NULL;
+    line_address_count = 0;
+    deferred_count = 0;
+    errors_lost = 0;
+    
+    strcpy(stream_filename, base_name);
+    strcat(stream_filename, ".am");
+    
+    state.filename = stream_filename;
+    state.symbol_table = symbol_table;
+    state.ic = IC;
+    state.dc = DC;
+    state.data = data_image;
+    state.line_addresses = NULL;
+    state.line_data_offsets = NULL;
+    state.list_state = LIST_CLOSED;
+    state.list_remaining = -1;
+    state.speculative = 0;
+    state.deferred = 1;
+    state.failed = 0;
+    
+    while (pop_line(ring, line)) {
+        if (first_pass_should_stop(&state)) {
             continue;
         }
         
-        /* Process the line - continue even if errors found (as required) */
-        process_line_first_pass(line, line_number, input_filename, symbol_table);
+        /* Keep room for this line and the final IC */
+        if (index + 2 > capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            grown = (int *)realloc(line_addresses, capacity * sizeof(int));
+            if (grown != NULL) {
+                line_addresses = grown;
+                grown = (int *)realloc(line_data_offsets, capacity * sizeof(int));
+                if (grown != NULL) {
+                    line_data_offsets = grown;
+                }
+            }
+            if (grown == NULL) {
+                free(line_addresses);
+                free(line_data_offsets);
+                line_addresses = NULL;
+                line_data_offsets = NULL;
+                capacity = -1;
+            }
+        }
+        state.line_addresses = (capacity > 0) ? line_addresses : NULL;
+        state.line_data_offsets = (capacity > 0) ? line_data_offsets : NULL;
+        
+        first_pass_line(line, index, &state);
+        index++;
     }
     
-    fclose(input_file);
+    if (!first_pass_should_stop(&state)) {
+        close_value_list(index, &state);
+    }
+    
+    if (line_addresses != NULL && capacity > 0) {
+        line_addresses[index] = state.ic;
+        line_data_offsets[index] = state.dc;
+        line_address_count = index;
+    }
+    
+    IC = state.ic;
+    DC = state.dc;
+    return (deferred_count == 0 && !errors_lost);
+}
+
+
+/*
+ * Completes a pipelined first pass: with @keep_results the held-back errors
+ * are reported and the pass is finalized; otherwise they are dropped
+ * Returns: 1 if the first pass succeeded
+ */
+int finish_first_pass_stream(int keep_results, SymbolTable *symbol_table) {
+    extern int error_flag;
+    int i;
+    
+    if (keep_results) {
+        for (i = 0; i < deferred_count; i++) {
+            print_error(stream_filename, deferred_errors[i].line_number, deferred_errors[i].message);
+        }
+        if (errors_lost) {
+            print_error(stream_filename, lost_error.line_number, lost_error.message);
+        }
+    }
+    
+    free(deferred_errors);
+    deferred_errors = NULL;
+    deferred_count = 0;
+    deferred_capacity = 0;
+    errors_lost = 0;
+    
+    if (!keep_results) {
+        return 0;
+    }
     
-    /* Finalize the first pass if no errors found so far */
     if (error_flag == 0) {
-        finalize_first_pass(*symbol_table);
+        finalize_first_pass(symbol_table);
     }
     return (error_flag == 0);
 }
 
 
-static int process_line_first_pass(char *line, int line_number, const char *filename, SymbolNode **symbol_table) {
+/*
+ * Reports a first pass error; a speculative chunk only marks itself failed
+ * so that the sequential pass can report the error with the right context,
+ * and a pipelined pass holds it until the pre-assembler result is known
+ */
+static void report_first_pass_error(FirstPassState *state, int line_number, const char *error_message) {
+    DeferredError *grown;
+    int new_capacity;
+    
+    if (state->speculative) {
+        state->failed = 1;
+    } else if (state->deferred) {
+        if (deferred_count == deferred_capacity) {
+            new_capacity = deferred_capacity ? deferred_capacity * 2 : 16;
+            grown = (DeferredError *)realloc(deferred_errors, new_capacity * sizeof(DeferredError));
+            if (grown == NULL) {
+                /* Keep this error and stop; the file must still fail */
+                if (!errors_lost) {
+                    lost_error.line_number = line_number;
+                    lost_error.message = error_message;
+                    errors_lost = 1;
+                }
+                return;
+            }
+            deferred_errors = grown;
+            deferred_capacity = new_capacity;
+        }
+        deferred_errors[deferred_count].line_number = line_number;
+        deferred_errors[deferred_count].message = error_message;
+        deferred_count++;
+    } else {
+        print_error(state->filename, line_number, error_message);
+    }
+}
+
+
+/*
+ * Splits the source at line boundaries and runs the chunks on worker threads.
+ * Each chunk counts from IC = DC = 0; a prefix sum over the chunk deltas then
+ * gives every chunk its real base, so labels and data words can be stitched
+ * into the symbol table and data_image in source order.
+ * Returns: 1 if the parallel result was committed, 0 if the caller must run
+ * the sequential pass instead (any error, or a possible memory overflow)
+ */
+static int parallel_first_pass(const SourceFile *source, const char *filename, SymbolTable *symbol_table) {
+    FirstPassChunk *chunks;
+    int chunk_count = first_pass_threads;
+    int ic_base = IC_INITIAL_VALUE;
+    int dc_base = 0;
+    int committed = 1;
+    int i, j;
+    
+    if (source->line_count / chunk_count < MIN_LINES_PER_CHUNK) {
+        chunk_count = source->line_count / MIN_LINES_PER_CHUNK;
+    }
+    if (chunk_count < 2) {
+        return 0;
+    }
+    
+    chunks = (FirstPassChunk *)calloc(chunk_count, sizeof(FirstPassChunk));
+    if (chunks == NULL) {
+        return 0;
+    }
+    
+    for (i = 0; i < chunk_count; i++) {
+        chunks[i].source = source;
+        chunks[i].first_line = chunk_boundary(source, (int)((long)source->line_count * i / chunk_count));
+        chunks[i].last_line = chunk_boundary(source, (int)((long)source->line_count * (i + 1) / chunk_count));
+        init_symbol_table(&chunks[i].symbols);
+        chunks[i].state.filename = filename;
+        chunks[i].state.symbol_table = &chunks[i].symbols;
+        chunks[i].state.ic = 0;
+        chunks[i].state.dc = 0;
+        chunks[i].state.data = chunks[i].data;
+        chunks[i].state.line_addresses = line_addresses;
+        chunks[i].state.line_data_offsets = line_data_offsets;
+        chunks[i].state.list_state = LIST_CLOSED;
+        chunks[i].state.list_remaining = -1;
+        chunks[i].state.speculative = 1;
+        chunks[i].state.deferred = 0;
+        chunks[i].state.failed = 0;
+    }
+    
+    /* Chunk 0 runs on this thread; the others get their own (or run here if none can be started) */
+    for (i = 1; i < chunk_count; i++) {
+        chunks[i].started = (pthread_create(&chunks[i].thread, NULL, first_pass_worker, &chunks[i]) == 0);
+        if (!chunks[i].started) {
+            first_pass_worker(&chunks[i]);
+        }
+    }
+    first_pass_worker(&chunks[0]);
+    for (i = 1; i < chunk_count; i++) {
+        if (chunks[i].started) {
+            pthread_join(chunks[i].thread, NULL);
+        }
+    }
+    
+    /* Prefix sum over the IC and DC deltas */
+    for (i = 0; i < chunk_count; i++) {
+        if (chunks[i].state.failed) {
+            committed = 0;
+        }
+        chunks[i].ic_base = ic_base;
+        chunks[i].dc_base = dc_base;
+        ic_base += chunks[i].state.ic;
+        dc_base += chunks[i].state.dc;
+    }
+    
+    /* Overflow checks depend on the absolute DC, so leave them to the sequential pass */
+    if (dc_base + 1 >= MEMORY_SIZE) {
+        committed = 0;
+    }
+    
+    /* Labels are added in source order so the table matches the sequential one */
+    for (i = 0; i < chunk_count && committed; i++) {
+        committed = stitch_chunk_symbols(&chunks[i], symbol_table);
+    }
+    
+    if (committed) {
+        for (i = 0; i < chunk_count; i++) {
+            memcpy(data_image + chunks[i].dc_base, chunks[i].data, chunks[i].state.dc * sizeof(unsigned int));
+            if (line_addresses != NULL) {
+                for (j = chunks[i].first_line; j < chunks[i].last_line; j++) {
+                    line_addresses[j] += chunks[i].ic_base;
+                    line_data_offsets[j] += chunks[i].dc_base;
+                }
+            }
+        }
+        if (line_addresses != NULL) {
+            line_addresses[source->line_count] = ic_base;
+            line_data_offsets[source->line_count] = dc_base;
+        }
+        IC = ic_base;
+        DC = dc_base;
+    } else {
+        free_symbol_table(symbol_table);
+    }
+    
+    for (i = 0; i < chunk_count; i++) {
+        free_symbol_table(&chunks[i].symbols);
+    }
+    free(chunks);
+    return committed;
+}
+
+
+static void* first_pass_worker(void *arg) {
+    FirstPassChunk *chunk = (FirstPassChunk *)arg;
+    
+    first_pass_lines(chunk->source, chunk->first_line, chunk->last_line, &chunk->state);
+    return NULL;
+}
+
+
+/*
+ * Adds a chunk's labels to the file's symbol table, relocated by the chunk's
+ * IC/DC bases. Returns 0 if a label clashes with one from an earlier chunk.
+ */
+static int stitch_chunk_symbols(FirstPassChunk *chunk, SymbolTable *symbol_table) {
+    SymbolNode *reversed = NULL;
+    SymbolNode *current, *next, *added;
+    int address;
+    
+    /* The chunk list is newest first; reverse it to walk in definition order */
+    for (current = chunk->symbols.head; current != NULL; current = next) {
+        next = current->next;
+        current->next = reversed;
+        reversed = current;
+    }
+    chunk->symbols.head = reversed;
+    
+    for (current = chunk->symbols.head; current != NULL; current = current->next) {
+        if (current->attribute == CODE_SYMBOL) {
+            address = current->address + chunk->ic_base;
+        } else if (current->attribute == DATA_SYMBOL) {
+            address = current->address + chunk->dc_base;
+        } else {
+            address = current->address;
+        }
+        
+        added = add_symbol(symbol_table, current->name_id, address, current->attribute);
+        if (added == NULL) {
+            return 0;
+        }
+        added->columns = current->columns;
+    }
+    
+    return 1;
+}
+
+
+static int process_line_first_pass(char *line, int line_number, FirstPassState *state) {
     ParsedLine *parsed;
     int result;
     
     /* Parse the line using our elegant parsing function */
     parsed = parse_line(line);
     if (parsed == NULL) {
-        print_error(filename, line_number, "Memory allocation error during parsing");
+        report_first_pass_error(state, line_number, "Memory allocation error during parsing");
         return 0;
     }
     
@@ -97,14 +626,14 @@ static int process_line_first_pass(char *line, int line_number, const char *file
     }
     
     if (parsed->is_error) {
-        print_error(filename, line_number, "Invalid line format");
+        report_first_pass_error(state, line_number, "Invalid line format");
         free_parsed_line(parsed);
         return 0;
     }
     
     /* Handle label definition if present */
     if (parsed->label) {
-        if (!handle_label_definition(parsed, line_number, filename, symbol_table)) {
+        if (!handle_label_definition(parsed, line_number, state)) {
             free_parsed_line(parsed);
             return 0;
         }
@@ -112,14 +641,14 @@ static int process_line_first_pass(char *line, int line_number, const char *file
     
     /* Process directive or instruction */
     if (parsed->is_directive) {
-        result = handle_directive_first_pass(parsed, line_number, filename, symbol_table);
+        result = handle_directive_first_pass(parsed, line_number, state);
         if (result > 0) {
-            DC += result;
+            state->dc += result;
         }
     } else {
-        result = handle_instruction_first_pass(parsed, line_number, filename);
+        result = handle_instruction_first_pass(parsed, line_number, state);
         if (result > 0) {
-            IC += result;
+            state->ic += result;
         }
     }
     
@@ -138,47 +667,33 @@ static int process_line_first_pass(char *line, int line_number, const char *file
 
 
 
-int validate_instruction_operands(int opcode, const char *src_operand, const char *dest_operand, int line_number, const char *filename) {
+static const InstructionForm* validate_instruction_operands(int opcode, const char *src_operand, const char *dest_operand, int line_number, FirstPassState *state) {
     int src_mode = -1, dest_mode = -1;
+    const InstructionForm *form;
     
     if (src_operand) {
         src_mode = get_addressing_mode(src_operand);
         if (src_mode == -1) {
-            print_error(filename, line_number, "Invalid source operand addressing mode");
-            return 0;
+            report_first_pass_error(state, line_number, "Invalid source operand addressing mode");
+            return NULL;
         }
     }
     
     if (dest_operand) {
         dest_mode = get_addressing_mode(dest_operand);
         if (dest_mode == -1) {
-            print_error(filename, line_number, "Invalid destination operand addressing mode");
-            return 0;
+            report_first_pass_error(state, line_number, "Invalid destination operand addressing mode");
+            return NULL;
         }
     }
     
-    if (!is_valid_addressing_for_instruction(opcode, src_mode, dest_mode)) {
-        print_error(filename, line_number, "Invalid addressing mode for this instruction");
-        return 0;
+    form = INSTRUCTION_FORM(opcode, src_mode, dest_mode);
+    if (!form->valid) {
+        report_first_pass_error(state, line_number, "Invalid addressing mode for this instruction");
+        return NULL;
     }
     
-    return 1;
-}
-
-
-int count_operands_for_instruction(int opcode) {
-    /* Instructions with no operands */
-    if (opcode == 14 || opcode == 15) { /* rts, stop */
-        return 0;
-    }
-    
-    /* Instructions with one operand */
-    if (opcode >= 4 && opcode <= 13) { /* not, clr, lea, inc, dec, jmp, bne, red, prn, jsr */
-        return 1;
-    }
-    
-    /* Instructions with two operands */
-    return 2; /* mov, cmp, add, sub */
+    return form;
 }
 
 
@@ -206,37 +721,20 @@ int parse_matrix_dimensions(const char *dimension_str, int *rows, int *cols) {
 }
 
 
-int store_data_values(char tokens[][MAX_SYMBOL_NAME], int start_token, int token_count, int line_number, const char *filename) {
-    int i, value;
-    int count = 0;
-    
-    for (i = start_token; i < token_count; i++) {
-        if (!is_valid_integer(tokens[i], &value)) {
-            print_error(filename, line_number, "Invalid integer value in data directive");
-            return -1;
-        }
-        
-        if (DC + count >= MEMORY_SIZE) {
-            print_error(filename, line_number, "Data memory overflow");
-            return -1;
-        }
-        
-        data_image[DC + count] = (unsigned int)(value & 0x3FF); /* 10-bit value */
-        count++;
-    }
-    
-    return count;
+/* Returns 1 if @count more data words fit; DC must stay below MEMORY_SIZE */
+static int data_fits(const FirstPassState *state, long count) {
+    return count >= 0 && state->dc + count < MEMORY_SIZE;
 }
 
 
-int store_string_data(const char *string_literal, int line_number, const char *filename) {
+static int store_string_data(const char *string_literal, int line_number, FirstPassState *state) {
     int i, len;
     const char *str;
     
     /* Check if string is quoted */
     len = strlen(string_literal);
     if (len < 2 || string_literal[0] != '"' || string_literal[len-1] != '"') {
-        print_error(filename, line_number, "String must be enclosed in quotes");
+        report_first_pass_error(state, line_number, "String must be enclosed in quotes");
         return -1;
     }
     
@@ -245,55 +743,55 @@ int store_string_data(const char *string_literal, int line_number, const char *f
     len -= 2;
     
     /* Check memory capacity */
-    if (DC + len + 1 >= MEMORY_SIZE) {
-        print_error(filename, line_number, "Data memory overflow");
+    if (!data_fits(state, len + 1)) {
+        report_first_pass_error(state, line_number, "Data memory overflow");
         return -1;
     }
     
     /* Store each character */
     for (i = 0; i < len; i++) {
-        data_image[DC + i] = (unsigned int)str[i];
+        state->data[state->dc + i] = (unsigned int)str[i];
     }
     
     /* Add null terminator */
-    data_image[DC + len] = 0;
+    state->data[state->dc + len] = 0;
     
     return len + 1;
 }
 
 
-static int finalize_first_pass(SymbolNode *symbol_table) {
+static int finalize_first_pass(SymbolTable *symbol_table) {
     update_data_symbols(symbol_table, IC);
     return 1;
 }
 
 
-static int handle_label_definition(ParsedLine *parsed, int line_number, const char *filename, SymbolNode **symbol_table) {
+static int handle_label_definition(ParsedLine *parsed, int line_number, FirstPassState *state) {
     SymbolAttribute attribute;
     int address;
     
     if (!is_valid_label(parsed->label)) {
-        print_error(filename, line_number, "Invalid label name");
+        report_first_pass_error(state, line_number, "Invalid label name");
         return 0;
     }
     
-    if (find_symbol(*symbol_table, parsed->label) != NULL) {
-        print_error(filename, line_number, "Label already defined");
+    if (find_symbol(state->symbol_table, parsed->label_id) != NULL) {
+        report_first_pass_error(state, line_number, "Label already defined");
         return 0;
     }
     
     if (parsed->is_directive && strcmp(parsed->command, ".extern") != 0) {
         attribute = DATA_SYMBOL;
-        address = DC;
+        address = state->dc;
     } else if (!parsed->is_directive) {
         attribute = CODE_SYMBOL;
-        address = IC;
+        address = state->ic;
     } else {
         return 1;
     }
     
-    if (add_symbol(symbol_table, parsed->label, address, attribute) == NULL) {
-        print_error(filename, line_number, "Failed to add symbol to table");
+    if (add_symbol(state->symbol_table, parsed->label_id, address, attribute) == NULL) {
+        report_first_pass_error(state, line_number, "Failed to add symbol to table");
         return 0;
     }
     
@@ -301,205 +799,428 @@ static int handle_label_definition(ParsedLine *parsed, int line_number, const ch
 }
 
 
-static int process_data_directive_parsed(ParsedLine *parsed, int line_number, const char *filename) {
-    int value, count = 0;
-    char *token, *operands;
-    char operands_copy[MAX_LINE_LENGTH];
-    
-    if (!parsed->operand1) {
-        print_error(filename, line_number, ".data directive requires at least one value");
+static int process_data_directive_parsed(ParsedLine *parsed, int line_number, FirstPassState *state) {
+    if (!parsed->values || parsed->values[0] == '\0') {
+        report_first_pass_error(state, line_number, ".data directive requires at least one value");
         return -1;
     }
     
-    strcpy(operands_copy, parsed->operand1);
-    if (parsed->operand2) {
-        strcat(operands_copy, ",");
-        strcat(operands_copy, parsed->operand2);
+    state->list_remaining = -1;
+    return store_value_list(parsed->values, line_number, state);
+}
+
+
+/*
+ * Scans a value list straight into the data image at DC. A trailing comma
+ * leaves the list open so the next line can carry on with more values.
+ * Returns: number of values stored, or -1 on error
+ */
+static int store_value_list(const char *text, int line_number, FirstPassState *state) {
+    int count, continues, status;
+    
+    /* DC must stay below MEMORY_SIZE, as data_fits requires */
+    status = scan_value_list(text, state->data + state->dc, MEMORY_SIZE - 1 - state->dc, &count, &continues);
+    if (status != SCAN_OK) {
+        report_first_pass_error(state, line_number, status == SCAN_OVERFLOW ? "Data memory overflow" :
+                                (state->list_remaining < 0 ? "Invalid integer value in data directive" :
+                                 "Invalid integer value in matrix directive"));
+        state->list_state = ends_with_comma(text) ? LIST_ABANDONED : LIST_CLOSED;
+        return -1;
     }
     
-    /* Parse and store values */
-    operands = operands_copy;
-    token = strtok(operands, ",");
+    state->list_state = continues ? LIST_OPEN : LIST_CLOSED;
     
-    while (token != NULL) {
-        token = trim_whitespace(token);
-        
-        if (!is_valid_integer(token, &value)) {
-            print_error(filename, line_number, "Invalid integer value in data directive");
-            return -1;
-        }
-        
-        if (DC + count >= MEMORY_SIZE) {
-            print_error(filename, line_number, "Data memory overflow");
+    /* A matrix must get exactly rows * cols values */
+    if (state->list_remaining >= 0) {
+        state->list_remaining -= count;
+        if (state->list_remaining < 0 || (!continues && state->list_remaining > 0)) {
+            report_first_pass_error(state, line_number, "Incorrect number of values for matrix dimensions");
+            state->list_state = continues ? LIST_ABANDONED : LIST_CLOSED;
             return -1;
         }
-        
-        data_image[DC + count] = (unsigned int)(value & 0x3FF); /* 10-bit value */
-        count++;
-        
-        token = strtok(NULL, ",");
     }
     
     return count;
 }
 
 
-static int process_string_directive_parsed(ParsedLine *parsed, int line_number, const char *filename) {
+/* Handles a line that carries on the value list of the previous .data or .mat line */
+static void continue_value_list(char *line, int line_number, FirstPassState *state) {
+    int count;
+    
+    if (state->list_state == LIST_ABANDONED) {
+        state->list_state = ends_with_comma(line) ? LIST_ABANDONED : LIST_CLOSED;
+        return;
+    }
+    
+    count = store_value_list(line, line_number, state);
+    if (count > 0) {
+        state->dc += count;
+    }
+}
+
+
+/* Reports a value list still open at the end of the input */
+static void close_value_list(int line_number, FirstPassState *state) {
+    if (state->list_state == LIST_OPEN) {
+        report_first_pass_error(state, line_number, "Value list ends with a comma");
+    }
+    state->list_state = LIST_CLOSED;
+}
+
+
+static int process_string_directive_parsed(ParsedLine *parsed, int line_number, FirstPassState *state) {
     if (!parsed->operand1) {
-        print_error(filename, line_number, ".string directive requires exactly one string literal");
+        report_first_pass_error(state, line_number, ".string directive requires exactly one string literal");
         return -1;
     }
     
-    return store_string_data(parsed->operand1, line_number, filename);
+    return store_string_data(parsed->operand1, line_number, state);
 }
 
 
-static int process_extern_directive_parsed(ParsedLine *parsed, int line_number, const char *filename, SymbolNode **symbol_table) {
+static int process_extern_directive_parsed(ParsedLine *parsed, int line_number, FirstPassState *state) {
     if (!parsed->operand1) {
-        print_error(filename, line_number, ".extern directive requires exactly one symbol name");
+        report_first_pass_error(state, line_number, ".extern directive requires exactly one symbol name");
         return -1;
     }
     
     if (!is_valid_label(parsed->operand1)) {
-        print_error(filename, line_number, "Invalid symbol name");
+        report_first_pass_error(state, line_number, "Invalid symbol name");
         return -1;
     }
     
-    if (add_symbol(symbol_table, parsed->operand1, 0, EXTERNAL_SYMBOL) == NULL) {
-        print_error(filename, line_number, "Failed to add external symbol");
+    if (add_symbol(state->symbol_table, parsed->operand1_id, 0, EXTERNAL_SYMBOL) == NULL) {
+        report_first_pass_error(state, line_number, "Failed to add external symbol");
         return -1;
     }
     return 0;
 }
 
 
-static int process_mat_directive_parsed(ParsedLine *parsed, int line_number, const char *filename) {
+static int process_mat_directive_parsed(ParsedLine *parsed, int line_number, FirstPassState *state) {
     int rows, cols;
-    int expected_values;
-    char values_string[MAX_LINE_LENGTH];
-    char *token;
-    char *values_copy;
-    int value;
-    int count = 0;
+    unsigned int word;
+    SymbolNode *symbol;
+    char dimensions[MAX_LINE_LENGTH];
+    size_t length;
+    const char *values;
     
-    if (!parsed->operand1) {
-        print_error(filename, line_number, ".mat directive requires dimensions and values");
+    if (!parsed->values || parsed->values[0] == '\0') {
+        report_first_pass_error(state, line_number, ".mat directive requires dimensions and values");
         return -1;
     }
     
-    if (!parse_matrix_dimensions(parsed->operand1, &rows, &cols)) {
-        print_error(filename, line_number, "Invalid matrix dimensions format");
+    /* The dimensions are the first word, the values follow */
+    length = strcspn(parsed->values, " \t");
+    strncpy(dimensions, parsed->values, length);
+    dimensions[length] = '\0';
+    
+    if (!parse_matrix_dimensions(dimensions, &rows, &cols)) {
+        report_first_pass_error(state, line_number, "Invalid matrix dimensions format");
         return -1;
     }
     
-    expected_values = rows * cols;
-    
-    if (!parsed->operand2) {
-        print_error(filename, line_number, "Not enough values for matrix dimensions");
+    if (rows > MEMORY_SIZE || cols > MEMORY_SIZE) {
+        report_first_pass_error(state, line_number, "Data memory overflow");
         return -1;
     }
     
-    strcpy(values_string, parsed->operand2);
+    /* Remember the row length so matrix operands can be resolved later */
+    if (parsed->label && (symbol = find_symbol(state->symbol_table, parsed->label_id)) != NULL) {
+        symbol->columns = cols;
+    }
     
-    values_copy = values_string;
-    token = strtok(values_copy, ",");
+    values = parsed->values + length;
+    values += strspn(values, " \t");
+    if (*values == '\0') {
+        report_first_pass_error(state, line_number, "Not enough values for matrix dimensions");
+        return -1;
+    }
     
-    while (token != NULL && count < expected_values) {
-        token = trim_whitespace(token);
-        
-        if (!is_valid_integer(token, &value)) {
-            print_error(filename, line_number, "Invalid integer value in matrix directive");
+    /* fill=v initializes the whole matrix without listing the values */
+    if (strncmp(values, "fill=", 5) == 0) {
+        if (!scan_fill_value(values + 5, &word)) {
+            report_first_pass_error(state, line_number, "Invalid integer value in matrix directive");
             return -1;
         }
-        
-        if (DC + count >= MEMORY_SIZE) {
-            print_error(filename, line_number, "Data memory overflow");
-            return -1;
+        return fill_data((long)rows * cols, word, line_number, state);
+    }
+    
+    state->list_remaining = rows * cols;
+    return store_value_list(values, line_number, state);
+}
+
+
+/* .fill count, value - reserves count words set to value */
+static int process_fill_directive_parsed(ParsedLine *parsed, int line_number, FirstPassState *state) {
+    char *count_end;
+    long count;
+    unsigned int word;
+    
+    if (!parsed->operand1 || !parsed->operand2) {
+        report_first_pass_error(state, line_number, ".fill directive requires a count and a value");
+        return -1;
+    }
+    
+    count = strtol(parsed->operand1, &count_end, 10);
+    if (!isdigit((unsigned char)parsed->operand1[0]) || *count_end != '\0' || count <= 0) {
+        report_first_pass_error(state, line_number, "Invalid .fill count");
+        return -1;
+    }
+    
+    if (!scan_fill_value(parsed->operand2, &word)) {
+        report_first_pass_error(state, line_number, "Invalid integer value in fill directive");
+        return -1;
+    }
+    
+    return fill_data(count, word, line_number, state);
+}
+
+
+/* Reads the value of .fill or .mat fill=, accepting exactly what a .data value may be */
+static int scan_fill_value(const char *text, unsigned int *word) {
+    int count, continues;
+    
+    return scan_value_list(text, word, 1, &count, &continues) == SCAN_OK && count == 1 && !continues;
+}
+
+
+/*
+ * Sets @count data words from DC on to @word in bulk
+ * Returns: @count, or -1 if the words do not fit in memory
+ */
+static int fill_data(long count, unsigned int word, int line_number, FirstPassState *state) {
+    unsigned int *target = state->data + state->dc;
+    long i;
+    
+    if (!data_fits(state, count)) {
+        report_first_pass_error(state, line_number, "Data memory overflow");
+        return -1;
+    }
+    
+    if (word == 0) {
+        memset(target, 0, (size_t)count * sizeof(*target));
+    } else {
+        for (i = 0; i < count; i++) {
+            target[i] = word;
         }
-        
-        data_image[DC + count] = (unsigned int)(value & 0x3FF); /* 10-bit value */
-        count++;
-        
-        token = strtok(NULL, ",");
     }
+    return (int)count;
+}
+
+
+/*
+ * .incbin "file"[, offset[, length]] - copies words from a binary file into
+ * the data image. The file holds 16-bit little-endian words; offset and
+ * length count words, and without a length the rest of the file is used.
+ * A relative file name is found next to the .as file.
+ * The file is mapped rather than read, and never tokenized.
+ */
+static int process_incbin_directive_parsed(ParsedLine *parsed, int line_number, FirstPassState *state) {
+    char filename[MAX_LINE_LENGTH];
+    char path[2 * MAX_LINE_LENGTH];
+    long offset, length, i;
+    long word_count;
+    struct stat info;
+    const unsigned char *mapping;
+    const unsigned char *word;
+    int fd;
     
-    if (count != expected_values) {
-        print_error(filename, line_number, "Incorrect number of values for matrix dimensions");
+    if (!parsed->values || !parse_incbin_operands(parsed->values, filename, &offset, &length)) {
+        report_first_pass_error(state, line_number, ".incbin directive requires a quoted file name and optional offset and length");
         return -1;
     }
     
-    return count;
+    /* A relative name is taken from the directory of the .as file, not the cwd */
+    if (filename[0] == '/') {
+        strcpy(path, filename);
+    } else {
+        strcpy(path, source_directory);
+        strcat(path, filename);
+    }
+    
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        report_first_pass_error(state, line_number, "Cannot open binary file");
+        return -1;
+    }
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        report_first_pass_error(state, line_number, "Cannot open binary file");
+        return -1;
+    }
+    
+    word_count = (long)(info.st_size / INCBIN_WORD_SIZE);
+    if (length < 0) {
+        length = word_count - offset;
+    }
+    if (offset > word_count || length < 0 || length > word_count - offset) {
+        close(fd);
+        report_first_pass_error(state, line_number, "Range is outside the binary file");
+        return -1;
+    }
+    if (!data_fits(state, length)) {
+        close(fd);
+        report_first_pass_error(state, line_number, "Data memory overflow");
+        return -1;
+    }
+    if (length == 0) {
+        close(fd);
+        return 0;
+    }
+    
+    mapping = (const unsigned char *)mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ((void *)mapping == MAP_FAILED) {
+        report_first_pass_error(state, line_number, "Cannot map binary file");
+        return -1;
+    }
+    
+    word = mapping + offset * INCBIN_WORD_SIZE;
+    for (i = 0; i < length; i++, word += INCBIN_WORD_SIZE) {
+        state->data[state->dc + i] = ((unsigned int)word[0] | ((unsigned int)word[1] << 8)) & 0x3FF; /* 10-bit value */
+    }
+    
+    munmap((void *)mapping, (size_t)info.st_size);
+    return (int)length;
+}
+
+
+/*
+ * Keeps the directory part of @full_path, up to and including its last '/',
+ * for .incbin; a name without a directory leaves it empty (the cwd)
+ */
+static void set_source_directory(const char *full_path) {
+    const char *slash = strrchr(full_path, '/');
+    size_t length = 0;
+    
+    if (slash != NULL && (size_t)(slash - full_path) + 1 < sizeof(source_directory)) {
+        length = (size_t)(slash - full_path) + 1;
+    }
+    strncpy(source_directory, full_path, length);
+    source_directory[length] = '\0';
+}
+
+
+/*
+ * Splits the operands of .incbin; @length is -1 when it is not given
+ * Returns: 1 on success, 0 on a syntax error
+ */
+static int parse_incbin_operands(const char *text, char *filename, long *offset, long *length) {
+    const char *end;
+    char *number_end;
+    long *fields[2];
+    int field;
+    
+    *offset = 0;
+    *length = -1;
+    fields[0] = offset;
+    fields[1] = length;
+    
+    if (*text != '"') {
+        return 0;
+    }
+    end = strchr(text + 1, '"');
+    if (end == NULL || end == text + 1 || end - text - 1 >= MAX_LINE_LENGTH) {
+        return 0;
+    }
+    strncpy(filename, text + 1, end - text - 1);
+    filename[end - text - 1] = '\0';
+    text = end + 1;
+    
+    for (field = 0; field < 2; field++) {
+        text += strspn(text, " \t");
+        if (*text == '\0') {
+            return 1;
+        }
+        if (*text != ',') {
+            return 0;
+        }
+        text++;
+        text += strspn(text, " \t");
+        if (!isdigit((unsigned char)*text)) {
+            return 0;
+        }
+        *fields[field] = strtol(text, &number_end, 10);
+        text = number_end;
+    }
+    
+    text += strspn(text, " \t");
+    return (*text == '\0');
 }
 
 
-static int handle_directive_first_pass(ParsedLine *parsed, int line_number, const char *filename, SymbolNode **symbol_table) {
+static int handle_directive_first_pass(ParsedLine *parsed, int line_number, FirstPassState *state) {
     if (strcmp(parsed->command, ".data") == 0) {
-        return process_data_directive_parsed(parsed, line_number, filename);
+        return process_data_directive_parsed(parsed, line_number, state);
     } else if (strcmp(parsed->command, ".string") == 0) {
-        return process_string_directive_parsed(parsed, line_number, filename);
+        return process_string_directive_parsed(parsed, line_number, state);
     } else if (strcmp(parsed->command, ".mat") == 0) {
-        return process_mat_directive_parsed(parsed, line_number, filename);
+        return process_mat_directive_parsed(parsed, line_number, state);
     } else if (strcmp(parsed->command, ".extern") == 0) {
-        return process_extern_directive_parsed(parsed, line_number, filename, symbol_table);
+        return process_extern_directive_parsed(parsed, line_number, state);
+    } else if (strcmp(parsed->command, ".incbin") == 0) {
+        return process_incbin_directive_parsed(parsed, line_number, state);
+    } else if (strcmp(parsed->command, ".fill") == 0) {
+        return process_fill_directive_parsed(parsed, line_number, state);
     } else if (strcmp(parsed->command, ".entry") == 0) {
         /* .entry is ignored in first pass */
         return 0;
     } else {
-        print_error(filename, line_number, "Unknown directive");
+        report_first_pass_error(state, line_number, "Unknown directive");
         return -1;
     }
 }
 
 
-static int process_instruction_parsed(ParsedLine *parsed, int line_number, const char *filename) {
+static int process_instruction_parsed(ParsedLine *parsed, int line_number, FirstPassState *state) {
     int opcode;
     int expected_operands;
     int actual_operands;
-    int src_mode = -1, dest_mode = -1;
+    const InstructionForm *form;
     const char *src_operand = NULL, *dest_operand = NULL;
     
     if (!parsed->command) {
-        print_error(filename, line_number, "Missing instruction");
+        report_first_pass_error(state, line_number, "Missing instruction");
         return -1;
     }
     
     /* Get instruction opcode */
     opcode = get_instruction_opcode(parsed->command);
     if (opcode == -1) {
-        print_error(filename, line_number, "Unknown instruction");
+        report_first_pass_error(state, line_number, "Unknown instruction");
         return -1;
     }
     
     /* Determine expected number of operands */
-    expected_operands = count_operands_for_instruction(opcode);
+    expected_operands = opcode_operand_counts[opcode];
     
     actual_operands = 0;
     if (parsed->operand1) actual_operands++;
     if (parsed->operand2) actual_operands++;
     
     if (actual_operands != expected_operands) {
-        print_error(filename, line_number, "Wrong number of operands");
+        report_first_pass_error(state, line_number, "Wrong number of operands");
         return -1;
     }
     
     if (expected_operands == 1) {
         dest_operand = parsed->operand1;
-        dest_mode = get_addressing_mode(dest_operand);
     } else if (expected_operands == 2) {
         src_operand = parsed->operand1;
         dest_operand = parsed->operand2;
-        src_mode = get_addressing_mode(src_operand);
-        dest_mode = get_addressing_mode(dest_operand);
     }
     
-    if (!validate_instruction_operands(opcode, src_operand, dest_operand, line_number, filename)) {
+    form = validate_instruction_operands(opcode, src_operand, dest_operand, line_number, state);
+    if (form == NULL) {
         return -1;
     }
-    return calculate_instruction_length(opcode, src_mode, dest_mode);
+    return form->length;
 }
 
 
-static int handle_instruction_first_pass(ParsedLine *parsed, int line_number, const char *filename) {
+static int handle_instruction_first_pass(ParsedLine *parsed, int line_number, FirstPassState *state) {
     /* Process the instruction using new ParsedLine-based function */
-    return process_instruction_parsed(parsed, line_number, filename);
+    return process_instruction_parsed(parsed, line_number, state);
 }
@@ -2,8 +2,27 @@
 #define FIRST_PASS_H
 
 #include "data_structures.h"
+#include "line_ring.h"
 
 
-int first_pass(const char *full_path, const char *base_name, SymbolNode **symbol_table);
+int first_pass(const char *full_path, const char *base_name, SymbolTable *symbol_table);
+
+
+void set_first_pass_threads(int count);
+
+
+const int* get_line_addresses(int *line_count);
+
+
+const int* get_line_data_offsets(int *line_count);
+
+
+void set_line_addresses(const int *addresses);
+
+
+int first_pass_stream(LineRing *ring, const char *full_path, const char *base_name, SymbolTable *symbol_table);
+
+
+int finish_first_pass_stream(int keep_results, SymbolTable *symbol_table);
 
 #endif /* FIRST_PASS_H */
\ No newline at end of file
@@ -0,0 +1,117 @@
+/*
+ * gen_opcode_table.c
+ * Build-time generator for opcode_table.c
+ * Holds the one description of the instruction set (legal addressing
+ * modes per opcode and the word layout) and expands it into the lookup
+ * tables declared in opcode_table.h
+ */
+
+#include <stdio.h>
+#include "opcode_table.h"
+
+/*
+ * Legal addressing modes per opcode, one bit per mode
+ * (bit 0 = immediate, 1 = direct, 2 = matrix, 3 = register)
+ */
+static const int valid_src_modes[OPCODE_COUNT] = {
+    0xF, 0xF, 0xF, 0xF, 0x0, 0x0, 0x6, 0x0,
+    0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0
+};
+
+static const int valid_dest_modes[OPCODE_COUNT] = {
+    0xE, 0xF, 0xE, 0xE, 0xE, 0xE, 0xE, 0xE,
+    0xE, 0xE, 0xE, 0xE, 0xF, 0xE, 0x0, 0x0
+};
+
+/* Extra words an operand needs in each mode; two registers share one word */
+static const int mode_words[4] = { 1, 1, 2, 1 };
+
+/*
+ * Function prototypes
+ */
+int accepts_mode(int mask, int mode);
+int instruction_length(int src_mode, int dest_mode);
+unsigned int first_word(int opcode, int src_mode, int dest_mode);
+
+/*
+ * main - Writes opcode_table.c to standard output
+ * Returns: 0 on success
+ */
+int main(void) {
+    int opcode, src_mode, dest_mode;
+    int valid;
+
+    printf("/*\n");
+    printf(" * opcode_table.c\n");
+    printf(" * Generated by gen_opcode_table - do not edit\n");
+    printf(" */\n\n");
+    printf("#include \"opcode_table.h\"\n\n");
+
+    printf("const int opcode_operand_counts[OPCODE_COUNT] = {\n");
+    for (opcode = 0; opcode < OPCODE_COUNT; opcode++) {
+        printf("    %d%s\n", (valid_src_modes[opcode] != 0) + (valid_dest_modes[opcode] != 0),
+               opcode < OPCODE_COUNT - 1 ? "," : "");
+    }
+    printf("};\n\n");
+
+    printf("const InstructionForm instruction_forms[OPCODE_COUNT][MODE_SLOTS][MODE_SLOTS] = {\n");
+    for (opcode = 0; opcode < OPCODE_COUNT; opcode++) {
+        printf("    {\n");
+        for (src_mode = -1; src_mode < MODE_SLOTS - 1; src_mode++) {
+            printf("        {");
+            for (dest_mode = -1; dest_mode < MODE_SLOTS - 1; dest_mode++) {
+                valid = accepts_mode(valid_src_modes[opcode], src_mode) &&
+                        accepts_mode(valid_dest_modes[opcode], dest_mode);
+                printf(" { %d, %d, 0x%03X }%s", valid,
+                       valid ? instruction_length(src_mode, dest_mode) : 0,
+                       valid ? first_word(opcode, src_mode, dest_mode) : 0,
+                       dest_mode < MODE_SLOTS - 2 ? "," : "");
+            }
+            printf(" }%s\n", src_mode < MODE_SLOTS - 2 ? "," : "");
+        }
+        printf("    }%s\n", opcode < OPCODE_COUNT - 1 ? "," : "");
+    }
+    printf("};\n");
+
+    return 0;
+}
+
+/*
+ * accepts_mode - Checks an operand's mode against an opcode's mask
+ * A mode of -1 (operand absent) is only accepted when the mask is empty
+ */
+int accepts_mode(int mask, int mode) {
+    if (mode == -1) {
+        return (mask == 0);
+    }
+    return (mask & (1 << mode)) != 0;
+}
+
+/* instruction_length - Counts the words of an instruction (L) */
+int instruction_length(int src_mode, int dest_mode) {
+    int length = 1;
+
+    if (src_mode == 3 && dest_mode == 3) {
+        return length + 1;
+    }
+    if (src_mode != -1) {
+        length += mode_words[src_mode];
+    }
+    if (dest_mode != -1) {
+        length += mode_words[dest_mode];
+    }
+    return length;
+}
+
+/* first_word - Packs the opcode and both modes into the first word */
+unsigned int first_word(int opcode, int src_mode, int dest_mode) {
+    unsigned int word = (unsigned int)(opcode & 0xF) << 6;
+
+    if (src_mode != -1) {
+        word |= (unsigned int)(src_mode & 0x3) << 4;
+    }
+    if (dest_mode != -1) {
+        word |= (unsigned int)(dest_mode & 0x3) << 2;
+    }
+    return word;
+}
@@ -0,0 +1,176 @@
+/*
+ * jobserver.c
+ * Implementation of the GNU make jobserver client
+ * make passes its jobserver in MAKEFLAGS, either as a pipe
+ * (--jobserver-auth=R,W, or --jobserver-fds=R,W in older versions) or as
+ * a named pipe (--jobserver-auth=fifo:PATH). Every byte in it is a token
+ * for one more job; a process always owns one implicit token and must
+ * write back exactly the bytes it read.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "jobserver.h"
+
+
+static const char* find_jobserver_option(const char *makeflags);
+static int connect_pipe(const char *value);
+static int connect_fifo(const char *path);
+
+
+static int read_fd = -1;                /* Own non-blocking reader; -1 if none */
+static int write_fd = -1;
+static int owns_write_fd = 0;           /* 1 if write_fd was opened here (fifo form) */
+static char tokens[MAX_JOB_TOKENS];     /* Tokens held, to be written back as read */
+static int token_count = 0;
+
+
+/*
+ * Looks for a jobserver in MAKEFLAGS and connects to it
+ * Returns: 1 if connected, 0 if there is none (or it was not passed on)
+ */
+int connect_jobserver(void) {
+    const char *makeflags = getenv("MAKEFLAGS");
+    const char *value;
+    char path[FILENAME_MAX];
+    size_t length;
+
+    if (makeflags == NULL || (value = find_jobserver_option(makeflags)) == NULL) {
+        return 0;
+    }
+
+    length = strcspn(value, " ");
+    if (strncmp(value, "fifo:", 5) == 0) {
+        if (length - 5 >= sizeof(path)) {
+            return 0;
+        }
+        memcpy(path, value + 5, length - 5);
+        path[length - 5] = '\0';
+        return connect_fifo(path);
+    }
+    return connect_pipe(value);
+}
+
+
+/*
+ * Takes up to @wanted tokens without waiting
+ * Returns: the number of tokens taken
+ */
+int acquire_job_tokens(int wanted) {
+    int taken = 0;
+    ssize_t result;
+
+    if (read_fd < 0) {
+        return 0;
+    }
+    while (taken < wanted && token_count < MAX_JOB_TOKENS) {
+        result = read(read_fd, &tokens[token_count], 1);
+        if (result == 1) {
+            token_count++;
+            taken++;
+        } else if (result < 0 && errno == EINTR) {
+            continue;
+        } else {
+            break;     /* No token free right now (EAGAIN) or make has gone */
+        }
+    }
+    return taken;
+}
+
+
+/* Writes back every token held */
+void release_job_tokens(void) {
+    int written = 0;
+    ssize_t result;
+
+    while (written < token_count) {
+        result = write(write_fd, tokens + written, token_count - written);
+        if (result > 0) {
+            written += (int)result;
+        } else if (result < 0 && errno != EINTR) {
+            break;
+        }
+    }
+    token_count = 0;
+}
+
+
+void disconnect_jobserver(void) {
+    release_job_tokens();
+    if (read_fd >= 0) {
+        close(read_fd);
+    }
+    if (owns_write_fd) {
+        close(write_fd);
+    }
+    read_fd = -1;
+    write_fd = -1;
+    owns_write_fd = 0;
+}
+
+
+/* Returns the value of the last jobserver option in @makeflags, or NULL */
+static const char* find_jobserver_option(const char *makeflags) {
+    static const char *options[] = { "--jobserver-auth=", "--jobserver-fds=" };
+    const char *found = NULL, *at;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        for (at = strstr(makeflags, options[i]); at != NULL; at = strstr(at + 1, options[i])) {
+            if (found == NULL || at > found) {
+                found = at;
+            }
+        }
+    }
+    if (found == NULL) {
+        return NULL;
+    }
+    return strchr(found, '=') + 1;
+}
+
+
+/*
+ * Connects to the R,W pipe inherited from make. The pipe's read end is
+ * reopened through /proc so that it can be made non-blocking without
+ * changing the descriptor make and the other jobs share; where that is not
+ * possible the connection holds no tokens beyond the implicit one.
+ * Returns: 1 if connected, 0 if make did not pass the pipe on
+ */
+static int connect_pipe(const char *value) {
+    char path[64];
+    int read_end, write_end;
+
+    if (sscanf(value, "%d,%d", &read_end, &write_end) != 2 || read_end < 0 || write_end < 0 ||
+        fcntl(read_end, F_GETFD) == -1 || fcntl(write_end, F_GETFD) == -1) {
+        return 0;
+    }
+
+    sprintf(path, "/proc/self/fd/%d", read_end);
+    read_fd = open(path, O_RDONLY | O_NONBLOCK);
+    write_fd = write_end;
+    owns_write_fd = 0;
+    return 1;
+}
+
+
+/* Returns: 1 if connected to the named pipe at @path, 0 otherwise */
+static int connect_fifo(const char *path) {
+    read_fd = open(path, O_RDONLY | O_NONBLOCK);
+    if (read_fd < 0) {
+        return 0;
+    }
+    write_fd = open(path, O_WRONLY);
+    if (write_fd < 0) {
+        close(read_fd);
+        read_fd = -1;
+        return 0;
+    }
+    owns_write_fd = 1;
+    return 1;
+}
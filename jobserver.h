@@ -0,0 +1,25 @@
+/*
+ * jobserver.h
+ * Client side of the GNU make jobserver
+ * Lets the assembler's worker threads share the -j limit of the make that
+ * runs it, instead of adding to it
+ */
+
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#define MAX_JOB_TOKENS 256   /* Most tokens held at once */
+
+
+int connect_jobserver(void);
+
+
+int acquire_job_tokens(int wanted);
+
+
+void release_job_tokens(void);
+
+
+void disconnect_jobserver(void);
+
+#endif /* JOBSERVER_H */
@@ -0,0 +1,133 @@
+/*
+ * line_ring.c
+ * Implementation of the line ring buffer
+ * The producer only wakes the consumer when the ring was empty and the
+ * consumer only wakes the producer when it was full, so a steady stream
+ * of lines costs one lock round trip per line and few context switches
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "line_ring.h"
+
+
+struct LineRing {
+    char (*slots)[LINE_RING_LINE_SIZE];
+    int capacity;
+    int head;       /* Next slot to read */
+    int tail;       /* Next slot to write */
+    int count;
+    int closed;     /* Set by the producer after its last line */
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+
+/*
+ * Creates a ring holding up to @capacity lines
+ * Returns: the ring, or NULL on allocation failure
+ */
+LineRing* create_line_ring(int capacity) {
+    LineRing *ring;
+
+    ring = (LineRing *)malloc(sizeof(LineRing));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    ring->slots = (char (*)[LINE_RING_LINE_SIZE])malloc(capacity * sizeof(*ring->slots));
+    if (ring->slots == NULL) {
+        free(ring);
+        return NULL;
+    }
+
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->count = 0;
+    ring->closed = 0;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->not_empty, NULL);
+    pthread_cond_init(&ring->not_full, NULL);
+    return ring;
+}
+
+
+void free_line_ring(LineRing *ring) {
+    if (ring == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->not_empty);
+    pthread_cond_destroy(&ring->not_full);
+    free(ring->slots);
+    free(ring);
+}
+
+
+/*
+ * Appends a line (without its newline), waiting while the ring is full
+ * Lines longer than a slot are cut short; they still read as too long
+ */
+void push_line(LineRing *ring, const char *line) {
+    int was_empty;
+
+    pthread_mutex_lock(&ring->lock);
+    while (ring->count == ring->capacity) {
+        pthread_cond_wait(&ring->not_full, &ring->lock);
+    }
+
+    strncpy(ring->slots[ring->tail], line, LINE_RING_LINE_SIZE - 1);
+    ring->slots[ring->tail][LINE_RING_LINE_SIZE - 1] = '\0';
+    ring->tail = (ring->tail + 1) % ring->capacity;
+    was_empty = (ring->count == 0);
+    ring->count++;
+
+    if (was_empty) {
+        pthread_cond_signal(&ring->not_empty);
+    }
+    pthread_mutex_unlock(&ring->lock);
+}
+
+
+/*
+ * Removes the oldest line into @line (LINE_RING_LINE_SIZE bytes)
+ * Returns: 1 if a line was read, 0 once the ring is closed and drained
+ */
+int pop_line(LineRing *ring, char *line) {
+    int was_full;
+
+    pthread_mutex_lock(&ring->lock);
+    while (ring->count == 0 && !ring->closed) {
+        pthread_cond_wait(&ring->not_empty, &ring->lock);
+    }
+
+    if (ring->count == 0) {
+        pthread_mutex_unlock(&ring->lock);
+        return 0;
+    }
+
+    strcpy(line, ring->slots[ring->head]);
+    ring->head = (ring->head + 1) % ring->capacity;
+    was_full = (ring->count == ring->capacity);
+    ring->count--;
+
+    if (was_full) {
+        pthread_cond_signal(&ring->not_full);
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return 1;
+}
+
+
+/* Marks the end of input; the consumer drains what is left and stops */
+void close_line_ring(LineRing *ring) {
+    pthread_mutex_lock(&ring->lock);
+    ring->closed = 1;
+    pthread_cond_signal(&ring->not_empty);
+    pthread_mutex_unlock(&ring->lock);
+}
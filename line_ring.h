@@ -0,0 +1,36 @@
+/*
+ * line_ring.h
+ * Bounded single-producer/single-consumer ring buffer of source lines
+ * Lets the pre-assembler hand expanded lines to the first pass running
+ * on another thread
+ */
+
+#ifndef LINE_RING_H
+#define LINE_RING_H
+
+#include "data_structures.h"
+
+#define LINE_RING_SLOTS 256                    /* Lines buffered between the two threads */
+#define LINE_RING_LINE_SIZE (MAX_LINE_LENGTH + 1) /* Room for an over-long line to still read as too long */
+
+
+typedef struct LineRing LineRing;
+
+
+
+
+LineRing* create_line_ring(int capacity);
+
+
+void free_line_ring(LineRing *ring);
+
+
+void push_line(LineRing *ring, const char *line);
+
+
+int pop_line(LineRing *ring, char *line);
+
+
+void close_line_ring(LineRing *ring);
+
+#endif /* LINE_RING_H */
@@ -0,0 +1,100 @@
+/*
+ * macro_library.c
+ * Implementation of the shared macro library
+ * Each definition is stored once, chained into a bucket picked by the
+ * string_hash of its name
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "macro_library.h"
+#include "utils.h"
+
+
+typedef struct LibraryMacro {
+    char name[MAX_MACRO_NAME];
+    char *content;
+    struct LibraryMacro *next;
+} LibraryMacro;
+
+
+struct MacroLibrary {
+    LibraryMacro *buckets[MACRO_LIBRARY_BUCKETS];
+    int count;
+};
+
+
+/* Returns: an empty library, or NULL on allocation failure */
+MacroLibrary* create_macro_library(void) {
+    return (MacroLibrary *)calloc(1, sizeof(MacroLibrary));
+}
+
+
+/*
+ * Adds a macro while the library is being built
+ * Returns: 1 on success, 0 if the name is taken or memory ran out
+ */
+int add_library_macro(MacroLibrary *library, const char *name, const char *content) {
+    LibraryMacro *macro;
+    unsigned long slot = string_hash(name) & (MACRO_LIBRARY_BUCKETS - 1);
+
+    if (find_library_macro(library, name) != NULL) {
+        return 0;
+    }
+
+    macro = (LibraryMacro *)malloc(sizeof(LibraryMacro));
+    if (macro == NULL) {
+        return 0;
+    }
+    macro->content = (char *)malloc(strlen(content) + 1);
+    if (macro->content == NULL) {
+        free(macro);
+        return 0;
+    }
+
+    strcpy(macro->name, name);
+    strcpy(macro->content, content);
+    macro->next = library->buckets[slot];
+    library->buckets[slot] = macro;
+    library->count++;
+    return 1;
+}
+
+
+/* Returns the body of macro @name, or NULL if the library has none (or is NULL) */
+const char* find_library_macro(const MacroLibrary *library, const char *name) {
+    const LibraryMacro *macro;
+
+    if (library == NULL) {
+        return NULL;
+    }
+    for (macro = library->buckets[string_hash(name) & (MACRO_LIBRARY_BUCKETS - 1)]; macro != NULL; macro = macro->next) {
+        if (strcmp(macro->name, name) == 0) {
+            return macro->content;
+        }
+    }
+    return NULL;
+}
+
+
+int macro_library_size(const MacroLibrary *library) {
+    return library->count;
+}
+
+
+void free_macro_library(MacroLibrary *library) {
+    LibraryMacro *macro, *next;
+    int i;
+
+    if (library == NULL) {
+        return;
+    }
+    for (i = 0; i < MACRO_LIBRARY_BUCKETS; i++) {
+        for (macro = library->buckets[i]; macro != NULL; macro = next) {
+            next = macro->next;
+            free(macro->content);
+            free(macro);
+        }
+    }
+    free(library);
+}
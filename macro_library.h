@@ -0,0 +1,33 @@
+/*
+ * macro_library.h
+ * Read-only hashed macro table shared by every file of a batch
+ * Filled once from a --macro-lib file; afterwards it is only looked up,
+ * so any number of files (or threads) can use it at the same time
+ */
+
+#ifndef MACRO_LIBRARY_H
+#define MACRO_LIBRARY_H
+
+#include "data_structures.h"
+
+#define MACRO_LIBRARY_BUCKETS 512   /* Hash buckets; a power of two */
+
+
+typedef struct MacroLibrary MacroLibrary;
+
+
+MacroLibrary* create_macro_library(void);
+
+
+int add_library_macro(MacroLibrary *library, const char *name, const char *content);
+
+
+const char* find_library_macro(const MacroLibrary *library, const char *name);
+
+
+int macro_library_size(const MacroLibrary *library);
+
+
+void free_macro_library(MacroLibrary *library);
+
+#endif /* MACRO_LIBRARY_H */
@@ -0,0 +1,33 @@
+/*
+ * opcode_table.h
+ * Instruction descriptors shared by both passes
+ * The tables are generated at build time by gen_opcode_table, so operand
+ * counts, legal addressing modes, lengths and first words all come from
+ * one description of the instruction set
+ */
+
+#ifndef OPCODE_TABLE_H
+#define OPCODE_TABLE_H
+
+#define OPCODE_COUNT 16     /* Number of machine instructions */
+#define MODE_SLOTS 5        /* "No operand" plus the four addressing modes */
+
+
+typedef struct {
+    unsigned char valid;        /* 1 if the instruction accepts this pair of modes */
+    unsigned char length;       /* Words the instruction occupies (L) */
+    unsigned short first_word;  /* Opcode and modes already shifted into place */
+} InstructionForm;
+
+
+extern const int opcode_operand_counts[OPCODE_COUNT];
+
+
+extern const InstructionForm instruction_forms[OPCODE_COUNT][MODE_SLOTS][MODE_SLOTS];
+
+
+/* Form of @opcode with the given modes; a mode of -1 means the operand is absent */
+#define INSTRUCTION_FORM(opcode, src_mode, dest_mode) \
+    (&instruction_forms[(opcode)][(src_mode) + 1][(dest_mode) + 1])
+
+#endif /* OPCODE_TABLE_H */
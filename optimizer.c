@@ -0,0 +1,380 @@
+/*
+ * optimizer.c
+ * Implementation of the peephole optimizer
+ * Macro expansion often leaves code behind that does nothing or could be
+ * shorter. The optimizer lists the instructions of the .am file, applies
+ * a few local rewrites and then relocates everything the first pass
+ * computed: code labels, data labels (their update_data_symbols offset),
+ * IC and the per-line addresses. The rewritten source replaces the .am
+ * file, so the second pass and the simulator see the optimized program.
+ * Instructions carrying a label are never removed, since they may be jump
+ * targets; they can still be shortened.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimizer.h"
+#include "first_pass.h"
+#include "opcode_table.h"
+#include "source.h"
+#include "utils.h"
+#include "symbol_names.h"
+
+#define OPCODE_MOV 0
+#define OPCODE_ADD 2
+#define OPCODE_SUB 3
+#define OPCODE_CLR 5
+#define OPCODE_INC 7
+#define OPCODE_DEC 8
+#define OPCODE_JMP 9
+#define DROPPED -1      /* new_opcode of a removed instruction */
+
+
+/* An instruction of the source, before and after optimization */
+typedef struct {
+    int line;           /* Index of its source line */
+    int address;        /* Address before optimization */
+    int length;         /* Words before optimization */
+    int opcode;
+    char label[MAX_LINE_LENGTH];    /* Empty if the line has no label */
+    char src[MAX_LINE_LENGTH];      /* Empty if absent */
+    char dest[MAX_LINE_LENGTH];
+    int dest_id;        /* Interned name of a direct destination, else NO_NAME_ID */
+    int src_mode;
+    int dest_mode;
+    int new_opcode;     /* Same as opcode if kept, DROPPED if removed */
+    int new_length;
+} PeepholeInstruction;
+
+
+static int collect_instructions(const SourceFile *source, PeepholeInstruction *list, int *count);
+static int collect_instruction(char *line, int index, int address, PeepholeInstruction *instruction);
+static void apply_local_rewrites(PeepholeInstruction *list, int count);
+static void remove_jumps_to_next(PeepholeInstruction *list, int count, SymbolTable *symbol_table);
+static void rewrite(PeepholeInstruction *instruction, int new_opcode);
+static int sets_to_zero(const PeepholeInstruction *instruction);
+static int words_removed_before(const PeepholeInstruction *list, int count, int address);
+static void relocate_program(const PeepholeInstruction *list, int count, int line_count, SymbolTable *symbol_table);
+static int write_optimized_source(const char *filename, const SourceFile *source, const PeepholeInstruction *list, int count);
+
+
+/*
+ * Optimizes base_name.am after a successful first pass
+ * @words_saved: receives how many code words were removed
+ * Returns: 1 on success, 0 on failure (reported)
+ */
+int optimize_program(const char *base_name, SymbolTable *symbol_table, int *words_saved) {
+    SourceFile source;
+    PeepholeInstruction *list;
+    char filename[MAX_LINE_LENGTH];
+    int count, i;
+    int success = 1;
+
+    *words_saved = 0;
+    strcpy(filename, base_name);
+    strcat(filename, ".am");
+
+    if (!load_source_file(filename, &source)) {
+        print_error(filename, 0, "Cannot open input file");
+        return 0;
+    }
+
+    list = (PeepholeInstruction *)malloc((source.line_count + 1) * sizeof(PeepholeInstruction));
+    if (list == NULL) {
+        print_error(filename, 0, "Memory allocation failed");
+        free_source_file(&source);
+        return 0;
+    }
+
+    if (collect_instructions(&source, list, &count)) {
+        apply_local_rewrites(list, count);
+        remove_jumps_to_next(list, count, symbol_table);
+
+        for (i = 0; i < count; i++) {
+            *words_saved += list[i].length - list[i].new_length;
+        }
+        if (*words_saved > 0) {
+            relocate_program(list, count, source.line_count, symbol_table);
+            success = write_optimized_source(filename, &source, list, count);
+        }
+    }
+
+    free(list);
+    free_source_file(&source);
+    return success;
+}
+
+
+/*
+ * Lists the instructions of the source with their addresses
+ * Returns: 1 on success, 0 if a line does not parse (the program is left alone)
+ */
+static int collect_instructions(const SourceFile *source, PeepholeInstruction *list, int *count) {
+    ParsedLine *parsed;
+    int list_open = 0;
+    int address = IC_INITIAL_VALUE;
+    int i, is_instruction;
+
+    *count = 0;
+    for (i = 0; i < source->line_count; i++) {
+        /* Values continuing a .data/.mat list belong to the line above */
+        if (list_open) {
+            list_open = ends_with_comma(source->lines[i]);
+            continue;
+        }
+        if (is_empty_line(source->lines[i]) || is_comment_line(source->lines[i])) {
+            continue;
+        }
+
+        parsed = parse_line(source->lines[i]);
+        if (parsed == NULL || parsed->is_error) {
+            if (parsed != NULL) {
+                free_parsed_line(parsed);
+            }
+            return 0;
+        }
+        is_instruction = (!parsed->is_empty && !parsed->is_directive && parsed->command != NULL);
+        list_open = (parsed->values != NULL && ends_with_comma(parsed->values));
+        free_parsed_line(parsed);
+
+        if (is_instruction) {
+            if (!collect_instruction(source->lines[i], i, address, &list[*count])) {
+                return 0;
+            }
+            address += list[*count].length;
+            (*count)++;
+        }
+    }
+    return 1;
+}
+
+
+/*
+ * Fills one list entry from an instruction line
+ * Returns: 1 on success, 0 if the instruction is not valid
+ */
+static int collect_instruction(char *line, int index, int address, PeepholeInstruction *instruction) {
+    ParsedLine *parsed;
+    const InstructionForm *form;
+    int operand_count;
+
+    parsed = parse_line(line);
+    if (parsed == NULL) {
+        return 0;
+    }
+
+    instruction->line = index;
+    instruction->address = address;
+    instruction->opcode = get_instruction_opcode(parsed->command);
+    strcpy(instruction->label, (parsed->label != NULL) ? parsed->label : "");
+    instruction->src[0] = '\0';
+    instruction->dest[0] = '\0';
+    instruction->dest_id = NO_NAME_ID;
+
+    operand_count = (instruction->opcode >= 0) ? opcode_operand_counts[instruction->opcode] : -1;
+    if (operand_count == 2 && parsed->operand1 != NULL && parsed->operand2 != NULL) {
+        strcpy(instruction->src, parsed->operand1);
+        strcpy(instruction->dest, parsed->operand2);
+        instruction->dest_id = parsed->operand2_id;
+    } else if (operand_count == 1 && parsed->operand1 != NULL) {
+        strcpy(instruction->dest, parsed->operand1);
+        instruction->dest_id = parsed->operand1_id;
+    }
+    free_parsed_line(parsed);
+
+    if (operand_count < 0) {
+        return 0;
+    }
+    instruction->src_mode = (instruction->src[0] != '\0') ? get_addressing_mode(instruction->src) : -1;
+    instruction->dest_mode = (instruction->dest[0] != '\0') ? get_addressing_mode(instruction->dest) : -1;
+
+    form = INSTRUCTION_FORM(instruction->opcode, instruction->src_mode, instruction->dest_mode);
+    if (!form->valid) {
+        return 0;
+    }
+    instruction->length = form->length;
+    instruction->new_opcode = instruction->opcode;
+    instruction->new_length = form->length;
+    return 1;
+}
+
+
+/*
+ * Rewrites single instructions and pairs of neighbours:
+ *   mov X, X             removed
+ *   add #0, X / sub #0   removed
+ *   add #1, X / sub #-1  inc X
+ *   sub #1, X / add #-1  dec X
+ *   mov #0, X            clr X
+ *   clr X after clr X    removed (mov #0 counts as clr)
+ */
+static void apply_local_rewrites(PeepholeInstruction *list, int count) {
+    PeepholeInstruction *instruction;
+    const PeepholeInstruction *previous = NULL;
+    int value, step;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        instruction = &list[i];
+
+        if (instruction->opcode == OPCODE_MOV && strcmp(instruction->src, instruction->dest) == 0) {
+            rewrite(instruction, DROPPED);
+        } else if (instruction->src_mode == 0 && is_valid_integer(instruction->src + 1, &value)) {
+            if (instruction->opcode == OPCODE_MOV && value == 0) {
+                rewrite(instruction, OPCODE_CLR);
+            } else if (instruction->opcode == OPCODE_ADD || instruction->opcode == OPCODE_SUB) {
+                step = (instruction->opcode == OPCODE_ADD) ? value : -value;
+                if (step == 0) {
+                    rewrite(instruction, DROPPED);
+                } else if (step == 1 || step == -1) {
+                    rewrite(instruction, (step == 1) ? OPCODE_INC : OPCODE_DEC);
+                }
+            }
+        }
+
+        if (instruction->label[0] == '\0' && previous != NULL &&
+            sets_to_zero(instruction) && sets_to_zero(previous) &&
+            strcmp(instruction->dest, previous->dest) == 0) {
+            rewrite(instruction, DROPPED);
+        }
+
+        if (instruction->new_opcode != DROPPED) {
+            previous = instruction;
+        }
+    }
+}
+
+
+/*
+ * Removes a jmp whose target is the next instruction that is kept. Going
+ * backwards lets a run of such jumps collapse completely
+ */
+static void remove_jumps_to_next(PeepholeInstruction *list, int count, SymbolTable *symbol_table) {
+    SymbolNode *target;
+    int i, next;
+
+    for (i = count - 1; i >= 0; i--) {
+        if (list[i].new_opcode != OPCODE_JMP || list[i].dest_mode != 1 || list[i].label[0] != '\0') {
+            continue;
+        }
+        target = find_symbol(symbol_table, list[i].dest_id);
+        if (target == NULL || target->attribute != CODE_SYMBOL) {
+            continue;
+        }
+        for (next = i + 1; next < count && list[next].new_opcode == DROPPED; next++) {
+            ;
+        }
+        if (next < count && list[next].address == target->address) {
+            rewrite(&list[i], DROPPED);
+        }
+    }
+}
+
+
+/* Replaces the instruction by a one-operand @new_opcode on its destination, or drops it */
+static void rewrite(PeepholeInstruction *instruction, int new_opcode) {
+    if (new_opcode == DROPPED && instruction->label[0] != '\0') {
+        return;
+    }
+
+    instruction->new_opcode = new_opcode;
+    if (new_opcode == DROPPED) {
+        instruction->new_length = 0;
+    } else {
+        instruction->new_length = INSTRUCTION_FORM(new_opcode, -1, instruction->dest_mode)->length;
+    }
+}
+
+
+/* Checks whether a kept instruction leaves its destination zero */
+static int sets_to_zero(const PeepholeInstruction *instruction) {
+    return (instruction->new_opcode == OPCODE_CLR);
+}
+
+
+/* Number of words removed from the instructions placed before @address */
+static int words_removed_before(const PeepholeInstruction *list, int count, int address) {
+    int removed = 0;
+    int i;
+
+    for (i = 0; i < count && list[i].address < address; i++) {
+        removed += list[i].length - list[i].new_length;
+    }
+    return removed;
+}
+
+
+/*
+ * Moves code labels back by the words removed before them, data labels
+ * and IC back by the words removed in total, and the first pass's line
+ * addresses the same way
+ */
+static void relocate_program(const PeepholeInstruction *list, int count, int line_count, SymbolTable *symbol_table) {
+    SymbolNode *current;
+    const int *old_addresses;
+    int *new_addresses;
+    int address_count, i;
+    int total = words_removed_before(list, count, IC);
+
+    for (current = symbol_table->head; current != NULL; current = current->next) {
+        if (current->attribute == CODE_SYMBOL) {
+            current->address -= words_removed_before(list, count, current->address);
+        }
+    }
+    update_data_symbols(symbol_table, -total);
+
+    old_addresses = get_line_addresses(&address_count);
+    if (old_addresses != NULL && address_count == line_count) {
+        new_addresses = (int *)malloc((address_count + 1) * sizeof(int));
+        if (new_addresses != NULL) {
+            for (i = 0; i <= address_count; i++) {
+                new_addresses[i] = old_addresses[i] - words_removed_before(list, count, old_addresses[i]);
+            }
+            set_line_addresses(new_addresses);
+            free(new_addresses);
+        }
+    }
+
+    IC -= total;
+}
+
+
+/*
+ * Writes the optimized source over filename. A removed instruction leaves
+ * an empty line, so line numbers in later messages still match the file
+ * Returns: 1 on success, 0 on failure (reported)
+ */
+static int write_optimized_source(const char *filename, const SourceFile *source, const PeepholeInstruction *list, int count) {
+    FILE *output_file;
+    int i, next = 0;
+
+    output_file = create_source_file(filename);
+    if (output_file == NULL) {
+        print_error(filename, 0, "Cannot create output file");
+        return 0;
+    }
+
+    for (i = 0; i < source->line_count; i++) {
+        if (next < count && list[next].line == i) {
+            if (list[next].new_opcode != list[next].opcode && list[next].new_opcode != DROPPED) {
+                if (list[next].label[0] != '\0') {
+                    fprintf(output_file, "%s: ", list[next].label);
+                }
+                fprintf(output_file, "%s %s", reserved_instructions[list[next].new_opcode], list[next].dest);
+            } else if (list[next].new_opcode != DROPPED) {
+                fputs(source->lines[i], output_file);
+            }
+            next++;
+        } else {
+            fputs(source->lines[i], output_file);
+        }
+        fputc('\n', output_file);
+    }
+
+    if (fclose(output_file) != 0) {
+        print_error(filename, 0, "Cannot write output file");
+        return 0;
+    }
+    return 1;
+}
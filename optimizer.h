@@ -0,0 +1,16 @@
+/*
+ * optimizer.h
+ * Peephole optimizer run between the first pass and encoding
+ * Removes or shortens redundant instructions in the macro-expanded source
+ * and moves the symbol table and counters to match
+ */
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "data_structures.h"
+
+
+int optimize_program(const char *base_name, SymbolTable *symbol_table, int *words_saved);
+
+#endif /* OPTIMIZER_H */
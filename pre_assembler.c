@@ -10,6 +10,182 @@
 #include "pre_assembler.h"
 #include "utils.h"
 #include "data_structures.h"
+#include "diagnostics.h"
+#include "line_ring.h"
+#include "macro_library.h"
+#include "source.h"
+#include "file_io.h"
+#include "region.h"
+
+
+#define TOKEN_DELIMITERS " \t\n\r,"   /* As in tokenize_line */
+#define MACRO_FILTER_BITS 1024          /* Bloom filter over a file's macro names; a power of two */
+
+
+/* What a source line is, decided from its first token */
+typedef enum {
+    LINE_PASSTHROUGH,    /* Copied to the .am file as it is */
+    LINE_MACRO_START,    /* mcro NAME */
+    LINE_MACRO_END,      /* mcroend */
+    LINE_MACRO_CALL      /* A defined macro's name alone on the line */
+} LineKind;
+
+
+static int process_macro_definition(char *line, char *macro_name, FILE *input_file, int *line_number, MacroNode **macro_table);
+static int expand_macro_call(const char *macro_name, int line_number, FILE *output_file, MacroNode *macro_table);
+static const char* flatten_macro(MacroNode *macro, MacroNode *macro_table, const MacroLibrary *library);
+static int append_text(char **buffer, size_t *length, size_t *capacity, const char *text, size_t size);
+static void forget_expansions(MacroNode *macro_table);
+static int validate_macro_name(const char *name);
+static LineKind classify_line(const char *line, char *macro_name, MacroNode *macro_table);
+static const char* next_token(const char *line, char *token);
+static int at_line_end(const char *line);
+static const char* lookup_macro(const char *name, MacroNode *macro_table);
+static void add_to_filter(const char *name);
+static int filter_may_contain(const char *name);
+static char* build_macro_content(FILE *input_file, int *line_number);
+static void emit_output(const char *text, FILE *output_file);
+static void flush_output_line(void);
+static void set_origin(int source_line, const char *macro_name);
+static void record_origin(void);
+
+
+static LineRing *output_ring = NULL;               /* Pipeline mode: also stream lines here */
+static const MacroLibrary *shared_macros = NULL;   /* --macro-lib definitions, under each file's own */
+static char pending_line[LINE_RING_LINE_SIZE];     /* Output line not yet ended by a newline */
+static int pending_length = 0;
+static LineOrigin *line_origins = NULL;            /* Origin of every .am line of the last file */
+static int origin_count = 0;
+static int origin_capacity = 0;
+static LineOrigin current_origin;                  /* Origin of the text being emitted */
+static int line_open = 0;                          /* 1 if the last emitted text did not end a line */
+static unsigned char macro_filter[MACRO_FILTER_BITS / 8];   /* Names in the current file's macro table */
+
+
+/* Streams every expanded line into @ring as well as the .am file (NULL to stop) */
+void set_pre_assembler_ring(LineRing *ring) {
+    output_ring = ring;
+    pending_length = 0;
+}
+
+
+/* Makes @library visible to every following file (NULL to stop); it is never changed */
+void set_macro_library(const MacroLibrary *library) {
+    shared_macros = library;
+}
+
+
+/*
+ * Reads a macro library: a file of macro definitions (plus empty and
+ * comment lines) that is parsed once and then shared by every file
+ * Returns: the library, or NULL on error (reported)
+ */
+MacroLibrary* load_macro_library(const char *filename) {
+    FILE *input_file;
+    MacroLibrary *library;
+    MacroNode *definitions = NULL;  /* Raw bodies, flattened once all are read */
+    MacroNode *macro;
+    char line[MAX_LINE_LENGTH];
+    char macro_name[MAX_MACRO_NAME];
+    char *content;
+    const char *expansion;
+    int line_number = 0;
+    int start_line;
+    int failed = 0;
+    int c;
+    
+    input_file = fopen(filename, "r");
+    if (input_file == NULL) {
+        print_error(filename, 0, "Cannot open macro library");
+        return NULL;
+    }
+    
+    library = create_macro_library();
+    if (library == NULL) {
+        print_error(filename, 0, "Memory allocation failed");
+        fclose(input_file);
+        return NULL;
+    }
+    
+    while (fgets(line, sizeof(line), input_file) != NULL) {
+        line_number++;
+        
+        if (strchr(line, '\n') == NULL && !feof(input_file)) {
+            print_error(filename, line_number, "Line is longer than 80 characters");
+            while ((c = fgetc(input_file)) != '\n' && c != EOF);
+            failed = 1;
+            continue;
+        }
+        
+        if (is_empty_line(line) || is_comment_line(line)) {
+            continue;
+        }
+        
+        if (classify_line(line, macro_name, NULL) != LINE_MACRO_START) {
+            print_error(filename, line_number, "Only macro definitions are allowed in a macro library");
+            failed = 1;
+            continue;
+        }
+        
+        if (!validate_macro_name(macro_name)) {
+            print_error(filename, line_number, "Invalid macro name or reserved word used");
+            failed = 1;
+        }
+        
+        start_line = line_number;
+        content = build_macro_content(input_file, &line_number);
+        if (content == NULL) {
+            print_error(filename, start_line, "Macro definition is not closed by mcroend");
+            failed = 1;
+            break;
+        }
+        
+        if (!failed && find_macro(definitions, macro_name) != NULL) {
+            print_error(filename, start_line, "Macro is defined more than once in the library");
+            failed = 1;
+        } else if (!failed) {
+            macro = add_macro(&definitions, macro_name, content);
+            if (macro == NULL) {
+                print_error(filename, start_line, "Memory allocation failed");
+                failed = 1;
+            } else {
+                macro->line_number = start_line;
+            }
+        }
+        free(content);
+    }
+    fclose(input_file);
+    
+    /* Library macros may call each other; store them already expanded, so a
+       call inside one keeps meaning the library's macro in every file */
+    for (macro = definitions; macro != NULL && !failed; macro = macro->next) {
+        expansion = flatten_macro(macro, definitions, NULL);
+        if (expansion == NULL) {
+            print_error(filename, macro->line_number, "Recursive macro call");
+            failed = 1;
+        } else if (!add_library_macro(library, macro->name, expansion)) {
+            print_error(filename, macro->line_number, "Memory allocation failed");
+            failed = 1;
+        }
+    }
+    
+    free_macro_table(&definitions);
+    if (failed) {
+        free_macro_library(library);
+        return NULL;
+    }
+    return library;
+}
+
+
+/*
+ * Returns where each line of the last .am file came from: its .as line,
+ * or the macro and the line of the call that expanded it
+ */
+const LineOrigin* get_line_origins(int *line_count) {
+    *line_count = origin_count;
+    return line_origins;
+}
 
 
 int process_file(const char *full_path, const char *base_name) {
@@ -24,29 +200,43 @@ int process_file(const char *full_path, const char *base_name) {
     extern int error_flag;
     
     /* Create input filename with .as extension - use full_path */
-    strcpy(input_filename, full_path);
-    strcat(input_filename, AS_EXTENSION);
+    if (strcmp(full_path, STDIN_PATH) == 0) {
+        strcpy(input_filename, STDIN_NAME);
+    } else {
+        strcpy(input_filename, full_path);
+        strcat(input_filename, AS_EXTENSION);
+    }
     
     /* Create output filename with .am extension - use base_name */
     create_output_filename(base_name, AM_EXTENSION, output_filename);
     
     /* Open input file */
-    input_file = fopen(input_filename, "r");
+    input_file = (strcmp(full_path, STDIN_PATH) == 0) ? stdin : open_input_file(input_filename);
     if (input_file == NULL) {
         print_error(input_filename, 0, "Cannot open input file");
         return 0;
     }
     
-    /* Open output file */
-    output_file = fopen(output_filename, "w");
+    /* Open output file (kept in memory when streaming) */
+    output_file = create_source_file(output_filename);
     if (output_file == NULL) {
         print_error(output_filename, 0, "Cannot create output file");
-        fclose(input_file);
+        if (input_file != stdin) {
+            fclose(input_file);
+        }
         return 0;
     }
     
+    origin_count = 0;
+    line_open = 0;
+    memset(macro_filter, 0, sizeof(macro_filter));
+    
     /* Process each line of the input file - simple approach */
     while (fgets(line, sizeof(line), input_file) != NULL) {
+        /* Stop early once the --max-errors limit has been reached */
+        if (error_limit_reached()) {
+            break;
+        }
         line_number++;
         
         /* Check line length - must not exceed 80 characters */
@@ -57,41 +247,41 @@ int process_file(const char *full_path, const char *base_name) {
             continue; /* Skip processing the invalid line */
         }
         
-        /* Skip empty lines and comments */
-        if (is_empty_line(line) || is_comment_line(line)) {
-            fputs(line, output_file);
-            continue;
-        }
+        set_origin(line_number, NULL);
         
-        /* Check if this line starts a macro definition */
-        if (is_macro_start(line, macro_name)) {
+        switch (classify_line(line, macro_name, macro_table)) {
+            case LINE_MACRO_START:
+                /* Validate macro name */
+                if (!validate_macro_name(macro_name)) {
+                    print_error(input_filename, line_number, "Invalid macro name or reserved word used");
+                    break;
+                }
+                
+                /* Process the macro definition - continue even if errors */
+                process_macro_definition(line, macro_name, input_file, &line_number, &macro_table);
+                break;
             
-            /* Validate macro name */
-            if (!validate_macro_name(macro_name)) {
-                print_error(input_filename, line_number, "Invalid macro name or reserved word used");
-                continue;
-            }
+            case LINE_MACRO_CALL:
+                if (!expand_macro_call(macro_name, line_number, output_file, macro_table)) {
+                    print_error(input_filename, line_number, "Recursive macro call");
+                }
+                break;
             
-            /* Process the macro definition - continue even if errors */
-            process_macro_definition(line, macro_name, input_file, &line_number, &macro_table);
-            continue;
+            default:
+                /* Empty, comment and regular lines - copy to output */
+                emit_output(line, output_file);
+                break;
         }
-        
-        
-        /* Check if this line is a macro call */
-        if (is_macro_call(line, macro_name, macro_table)) {
-            if (!expand_macro_call(macro_name, output_file, macro_table)) {
-                print_error(input_filename, line_number, "Undefined macro called");
-            }
-            continue;
-        }
-        
-        /* Regular line - copy to output */
-        fputs(line, output_file);
     }
     
     /* Close files */
-    fclose(input_file);
+    flush_output_line();
+    if (line_open) {
+        record_origin();
+    }
+    if (input_file != stdin) {
+        fclose(input_file);
+    }
     fclose(output_file);
     
     /* Cleanup macro table */
@@ -99,7 +289,7 @@ int process_file(const char *full_path, const char *base_name) {
     
     /* Remove output file if errors found */
     if (error_flag) {
-        remove(output_filename);
+        remove_source_file(output_filename);
         return 0;
     }
     return 1;
@@ -109,7 +299,9 @@ int process_file(const char *full_path, const char *base_name) {
  * Handles macro definition lines by reading content until mcroend
  */
 static int process_macro_definition(char *line, char *macro_name, FILE *input_file, int *line_number, MacroNode **macro_table) {
+    MacroNode *macro;
     char *content;
+    int start_line = *line_number;
     
     /* Build macro content by reading until mcroend */
     content = build_macro_content(input_file, line_number);
@@ -118,32 +310,149 @@ static int process_macro_definition(char *line, char *macro_name, FILE *input_fi
     }
     
     /* Add macro to local table */
-    if (add_macro(macro_table, macro_name, content) == NULL) {
+    macro = add_macro(macro_table, macro_name, content);
+    if (macro == NULL) {
         free(content);
         return 0;
     }
+    macro->line_number = start_line;
     
+    /* A cached expansion may have copied a call of this name as plain text */
+    forget_expansions(*macro_table);
+    add_to_filter(macro_name);
     free(content);
     return 1;
 }
 
 
-static int expand_macro_call(const char *macro_name, FILE *output_file, MacroNode *macro_table) {
-    MacroNode *macro;
+/*
+ * Writes the flattened body of a macro call to the output, tagged with the
+ * call site; the file's own definitions hide the library's
+ * Returns: 1 on success, 0 if the macro calls itself through nested calls
+ */
+static int expand_macro_call(const char *macro_name, int line_number, FILE *output_file, MacroNode *macro_table) {
+    MacroNode *macro = find_macro(macro_table, macro_name);
+    const char *content;
     
-    /* Find the macro in the table */
-    macro = find_macro(macro_table, macro_name);
-    if (macro == NULL) {
+    if (macro != NULL) {
+        content = flatten_macro(macro, macro_table, shared_macros);
+    } else {
+        content = find_library_macro(shared_macros, macro_name);
+    }
+    if (content == NULL) {
         return 0;
     }
     
-    /* Write macro content to output file */
-    fputs(macro->content, output_file);
+    set_origin(line_number, macro_name);
+    emit_output(content, output_file);
+    return 1;
+}
+
+
+/*
+ * Returns the body of @macro with every line that calls a macro replaced by
+ * that macro's own flattened body. The result is cached in the node, so
+ * each macro is expanded once and every later call is a single copy.
+ * Nested names are looked up in @macro_table, then in @library, whose
+ * bodies are stored flat already.
+ * Returns: the expansion, or NULL on a call cycle (or allocation failure)
+ */
+static const char* flatten_macro(MacroNode *macro, MacroNode *macro_table, const MacroLibrary *library) {
+    char line[MAX_LINE_LENGTH];
+    char token[MAX_LINE_LENGTH];
+    const char *start, *end, *nested_body;
+    MacroNode *nested;
+    char *buffer;
+    size_t length = 0, capacity, size;
+    int ok = 1;
+    
+    if (macro->expansion != NULL) {
+        return macro->expansion;
+    }
+    if (macro->expanding) {
+        return NULL;
+    }
+    
+    capacity = strlen(macro->content) + 1;
+    buffer = (char *)malloc(capacity);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    buffer[0] = '\0';
+    
+    macro->expanding = 1;
+    for (start = macro->content; ok && *start != '\0'; start = end) {
+        end = strchr(start, '\n');
+        end = (end != NULL) ? end + 1 : start + strlen(start);
+        size = end - start;
+        nested_body = NULL;
+        
+        /* Body lines were read into MAX_LINE_LENGTH buffers, so they fit */
+        if (size < MAX_LINE_LENGTH) {
+            memcpy(line, start, size);
+            line[size] = '\0';
+            if (at_line_end(next_token(line, token)) && token[0] != '\0') {
+                nested = find_macro(macro_table, token);
+                if (nested != NULL) {
+                    nested_body = flatten_macro(nested, macro_table, library);
+                    ok = (nested_body != NULL);
+                } else {
+                    nested_body = find_library_macro(library, token);
+                }
+            }
+        }
+        
+        if (ok) {
+            ok = (nested_body != NULL) ? append_text(&buffer, &length, &capacity, nested_body, strlen(nested_body))
+                                       : append_text(&buffer, &length, &capacity, start, size);
+        }
+    }
+    macro->expanding = 0;
+    
+    /* The cache lives with the macro in the file region */
+    if (ok) {
+        macro->expansion = (char *)region_alloc(length + 1);
+        if (macro->expansion != NULL) {
+            memcpy(macro->expansion, buffer, length + 1);
+        }
+    }
+    free(buffer);
+    return macro->expansion;
+}
+
+
+/*
+ * Appends @size bytes of @text to a growing string
+ * Returns: 1 on success, 0 on allocation failure
+ */
+static int append_text(char **buffer, size_t *length, size_t *capacity, const char *text, size_t size) {
+    char *grown;
     
+    if (*length + size + 1 > *capacity) {
+        while (*length + size + 1 > *capacity) {
+            *capacity *= 2;
+        }
+        grown = (char *)realloc(*buffer, *capacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        *buffer = grown;
+    }
+    memcpy(*buffer + *length, text, size);
+    *length += size;
+    (*buffer)[*length] = '\0';
     return 1;
 }
 
 
+/* Drops the cached expansions of a file's macros */
+static void forget_expansions(MacroNode *macro_table) {
+    for (; macro_table != NULL; macro_table = macro_table->next) {
+        macro_table->expansion = NULL;
+    }
+}
+
+
 static int validate_macro_name(const char *name) {
     /* Check if it's a valid identifier */
     if (!is_valid_label(name)) {
@@ -159,65 +468,85 @@ static int validate_macro_name(const char *name) {
 }
 
 
-static int is_macro_start(const char *line, char *macro_name) {
-    char tokens[MAX_TOKENS][MAX_SYMBOL_NAME];
-    char line_copy[MAX_LINE_LENGTH];
-    int token_count;
-    
-    /* Make a copy of the line for tokenization */
-    strcpy(line_copy, line);
+/*
+ * Decides what @line is from its first token, scanned once without copying
+ * the line. Only "mcro" lines read a second token (the name, left empty if
+ * too long so that validation rejects it); a one-token line is looked up
+ * as a macro only if the file's filter or the library may hold it.
+ * @macro_name (if not NULL) receives the name of a defined or called macro
+ */
+static LineKind classify_line(const char *line, char *macro_name, MacroNode *macro_table) {
+    char token[MAX_LINE_LENGTH];
+    const char *rest;
+    const char *body;
     
-    token_count = tokenize_line(line_copy, tokens, MAX_TOKENS);
+    rest = next_token(line, token);
+    if (token[0] == '\0' || token[0] == COMMENT_CHAR) {
+        return LINE_PASSTHROUGH;
+    }
     
-    if (token_count >= 2 && strcmp(tokens[0], MACRO_START) == 0) {
-        strcpy(macro_name, tokens[1]);
-        
-        if (token_count > 2) {
-            return 0;
+    if (strcmp(token, MACRO_START) == 0) {
+        rest = next_token(rest, token);
+        if (token[0] == '\0' || !at_line_end(rest)) {
+            return LINE_PASSTHROUGH;
+        }
+        if (macro_name != NULL) {
+            strcpy(macro_name, strlen(token) < MAX_MACRO_NAME ? token : "");
         }
-        return 1;
+        return LINE_MACRO_START;
+    }
+    
+    if (!at_line_end(rest)) {
+        return LINE_PASSTHROUGH;
+    }
+    if (strcmp(token, MACRO_END) == 0) {
+        return LINE_MACRO_END;
+    }
+    if (strlen(token) >= MAX_MACRO_NAME) {
+        return LINE_PASSTHROUGH;
     }
     
-    return 0;
+    body = filter_may_contain(token) ? lookup_macro(token, macro_table) : find_library_macro(shared_macros, token);
+    if (body == NULL) {
+        return LINE_PASSTHROUGH;
+    }
+    if (macro_name != NULL) {
+        strcpy(macro_name, token);
+    }
+    return LINE_MACRO_CALL;
 }
 
 
-static int is_macro_end(const char *line) {
-    char tokens[MAX_TOKENS][MAX_SYMBOL_NAME];
-    char line_copy[MAX_LINE_LENGTH];
-    int token_count;
-    
-    /* Make a copy of the line for tokenization */
-    strcpy(line_copy, line);
-    
-    /* Tokenize the line */
-    token_count = tokenize_line(line_copy, tokens, MAX_TOKENS);
-    
-    /* Check if only token is "mcroend" */
-    if (token_count == 1 && strcmp(tokens[0], MACRO_END) == 0) {
-        return 1;
-    }
+/*
+ * Copies the token at the start of @line (split as tokenize_line does)
+ * into @token, which is left empty at the end of the line
+ * Returns: the text after the token
+ */
+static const char* next_token(const char *line, char *token) {
+    size_t length;
     
-    return 0;
+    line += strspn(line, TOKEN_DELIMITERS);
+    length = strcspn(line, TOKEN_DELIMITERS);
+    memcpy(token, line, length);
+    token[length] = '\0';
+    return line + length;
 }
 
 
-static int is_macro_call(const char *line, char *macro_name, MacroNode *macro_table) {
-    char tokens[MAX_TOKENS][MAX_SYMBOL_NAME];
-    char line_copy[MAX_LINE_LENGTH];
-    int token_count;
-    
-    strcpy(line_copy, line);
-    token_count = tokenize_line(line_copy, tokens, MAX_TOKENS);
+/* Returns 1 if nothing but delimiters is left in @line */
+static int at_line_end(const char *line) {
+    return line[strspn(line, TOKEN_DELIMITERS)] == '\0';
+}
+
+
+/* Returns the body of macro @name; the file's own definitions hide the library's */
+static const char* lookup_macro(const char *name, MacroNode *macro_table) {
+    MacroNode *macro = find_macro(macro_table, name);
     
-    if (token_count == 1) {
-        if (find_macro(macro_table, tokens[0]) != NULL) {
-            strcpy(macro_name, tokens[0]);
-            return 1;
-        }
+    if (macro != NULL) {
+        return macro->content;
     }
-    
-    return 0;
+    return find_library_macro(shared_macros, name);
 }
 
 
@@ -246,7 +575,7 @@ static char* build_macro_content(FILE *input_file, int *line_number) {
             return NULL;
         }
         
-        if (is_macro_end(line)) {
+        if (classify_line(line, NULL, NULL) == LINE_MACRO_END) {
             return content;
         }
         
@@ -266,3 +595,88 @@ static char* build_macro_content(FILE *input_file, int *line_number) {
     free(content);
     return NULL;
 }
+
+
+/* Writes expanded text to the .am file and, in pipeline mode, to the line ring */
+static void emit_output(const char *text, FILE *output_file) {
+    const char *p;
+    
+    fputs(text, output_file);
+    
+    for (p = text; *p != '\0'; p++) {
+        if (*p == '\n') {
+            record_origin();
+        }
+    }
+    if (p != text) {
+        line_open = (p[-1] != '\n');
+    }
+    
+    if (output_ring == NULL) {
+        return;
+    }
+    
+    for (; *text != '\0'; text++) {
+        if (*text == '\n') {
+            pending_line[pending_length] = '\0';
+            push_line(output_ring, pending_line);
+            pending_length = 0;
+        } else if (pending_length < LINE_RING_LINE_SIZE - 1) {
+            pending_line[pending_length++] = *text;
+        }
+    }
+}
+
+
+/* Sends a final line that has no newline to the line ring */
+static void flush_output_line(void) {
+    if (output_ring != NULL && pending_length > 0) {
+        pending_line[pending_length] = '\0';
+        push_line(output_ring, pending_line);
+        pending_length = 0;
+    }
+}
+
+
+/* Sets the origin of the lines emitted next; @macro_name is NULL outside macros */
+static void set_origin(int source_line, const char *macro_name) {
+    current_origin.source_line = source_line;
+    strcpy(current_origin.macro, (macro_name != NULL) ? macro_name : "");
+}
+
+
+/* Appends the current origin for one more .am line */
+static void record_origin(void) {
+    LineOrigin *grown;
+    
+    if (origin_count == origin_capacity) {
+        grown = (LineOrigin *)realloc(line_origins, (origin_capacity ? origin_capacity * 2 : 256) * sizeof(LineOrigin));
+        if (grown == NULL) {
+            return;
+        }
+        line_origins = grown;
+        origin_capacity = origin_capacity ? origin_capacity * 2 : 256;
+    }
+    line_origins[origin_count++] = current_origin;
+}
+
+
+/* Sets the two filter bits of @name: one from the low and one from the high hash bits */
+static void add_to_filter(const char *name) {
+    unsigned long hash = string_hash(name);
+    unsigned long first = hash & (MACRO_FILTER_BITS - 1);
+    unsigned long second = (hash >> 16) & (MACRO_FILTER_BITS - 1);
+    
+    macro_filter[first / 8] |= (unsigned char)(1 << (first % 8));
+    macro_filter[second / 8] |= (unsigned char)(1 << (second % 8));
+}
+
+
+/* Returns 0 if @name is surely not in the current file's macro table */
+static int filter_may_contain(const char *name) {
+    unsigned long hash = string_hash(name);
+    unsigned long first = hash & (MACRO_FILTER_BITS - 1);
+    unsigned long second = (hash >> 16) & (MACRO_FILTER_BITS - 1);
+    
+    return (macro_filter[first / 8] & (1 << (first % 8))) && (macro_filter[second / 8] & (1 << (second % 8)));
+}
@@ -9,15 +9,37 @@
 
 #include <stdio.h>
 #include "data_structures.h"
+#include "line_ring.h"
+#include "macro_library.h"
 
 #define MACRO_START "mcro"    /* Keyword that starts macro definition */
 #define MACRO_END "mcroend"   /* Keyword that ends macro definition */
 #define AS_EXTENSION ".as"    /* Input file extension */
 #define AM_EXTENSION ".am"    /* Output file extension */
+#define STDIN_PATH "-"        /* Input path that reads the source from standard input */
+#define STDIN_NAME "stdin"    /* Base name of that source in messages and outputs */
+
+
+typedef struct {
+    int source_line;                /* Line of the .as file, or of the macro call */
+    char macro[MAX_MACRO_NAME];     /* Macro that produced the line, empty if none */
+} LineOrigin;
 
 
 
 
 int process_file(const char *full_path, const char *base_name);
 
+
+void set_pre_assembler_ring(LineRing *ring);
+
+
+MacroLibrary* load_macro_library(const char *filename);
+
+
+void set_macro_library(const MacroLibrary *library);
+
+
+const LineOrigin* get_line_origins(int *line_count);
+
 #endif /* PRE_ASSEMBLER_H */
@@ -0,0 +1,116 @@
+/*
+ * region.c
+ * Implementation of the per-file region
+ * Blocks stay chained after a reset. Allocation walks forward through the
+ * retained blocks before asking malloc for new ones, so a batch of similar
+ * files reaches a steady state and stops allocating. The pre-assembler and
+ * the first pass may allocate from different threads, so every request
+ * takes a lock.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "region.h"
+
+
+typedef struct RegionBlock {
+    struct RegionBlock *next;
+    size_t size;      /* Usable bytes */
+    size_t used;
+} RegionBlock;
+
+
+/* Strictest alignment any table entry needs */
+typedef union {
+    long integer;
+    double real;
+    void *pointer;
+} RegionAlign;
+
+#define ALIGN_SIZE(n) (((n) + sizeof(RegionAlign) - 1) / sizeof(RegionAlign) * sizeof(RegionAlign))
+#define BLOCK_DATA(block) ((char *)(block) + ALIGN_SIZE(sizeof(RegionBlock)))
+
+
+static RegionBlock* new_block(size_t size);
+
+
+static RegionBlock *first_block = NULL;
+static RegionBlock *current_block = NULL;
+static pthread_mutex_t region_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*
+ * Returns @size bytes that stay valid until the next reset_region
+ * Returns: NULL on allocation failure
+ */
+void* region_alloc(size_t size) {
+    RegionBlock *block;
+    void *memory = NULL;
+
+    size = ALIGN_SIZE(size);
+    pthread_mutex_lock(&region_lock);
+
+    if (current_block == NULL || current_block->used + size > current_block->size) {
+        if (current_block != NULL && current_block->next != NULL && size <= current_block->next->size) {
+            /* Reuse a block kept from an earlier file */
+            current_block = current_block->next;
+            current_block->used = 0;
+        } else if ((block = new_block(size > REGION_BLOCK_SIZE ? size : REGION_BLOCK_SIZE)) != NULL) {
+            if (current_block == NULL) {
+                block->next = first_block;
+                first_block = block;
+            } else {
+                block->next = current_block->next;
+                current_block->next = block;
+            }
+            current_block = block;
+        }
+    }
+
+    if (current_block != NULL && current_block->used + size <= current_block->size) {
+        memory = BLOCK_DATA(current_block) + current_block->used;
+        current_block->used += size;
+    }
+    pthread_mutex_unlock(&region_lock);
+    return memory;
+}
+
+
+/* Drops everything allocated so far, keeping the blocks for reuse */
+void reset_region(void) {
+    pthread_mutex_lock(&region_lock);
+    current_block = first_block;
+    if (current_block != NULL) {
+        current_block->used = 0;
+    }
+    pthread_mutex_unlock(&region_lock);
+}
+
+
+/* Returns every block to the system */
+void release_region(void) {
+    RegionBlock *block, *next;
+
+    pthread_mutex_lock(&region_lock);
+    for (block = first_block; block != NULL; block = next) {
+        next = block->next;
+        free(block);
+    }
+    first_block = NULL;
+    current_block = NULL;
+    pthread_mutex_unlock(&region_lock);
+}
+
+
+static RegionBlock* new_block(size_t size) {
+    RegionBlock *block = (RegionBlock *)malloc(ALIGN_SIZE(sizeof(RegionBlock)) + size);
+
+    if (block != NULL) {
+        block->next = NULL;
+        block->size = size;
+        block->used = 0;
+    }
+    return block;
+}
@@ -0,0 +1,25 @@
+/*
+ * region.h
+ * Bump-pointer region holding the tables of the file being assembled
+ * Symbols, macros, interned names and external uses are carved out of
+ * large blocks and never freed one by one; the whole region is rewound
+ * once the file is done and its blocks are reused for the next file.
+ */
+
+#ifndef REGION_H
+#define REGION_H
+
+#include <stddef.h>
+
+#define REGION_BLOCK_SIZE 65536   /* Bytes per block; larger requests get a block of their own */
+
+
+void* region_alloc(size_t size);
+
+
+void reset_region(void);
+
+
+void release_region(void);
+
+#endif /* REGION_H */
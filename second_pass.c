@@ -4,38 +4,103 @@
  * Generates machine code and creates output files
  */
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "second_pass.h"
 #include "utils.h"
 #include "data_structures.h"
+#include "diagnostics.h"
 #include "first_pass.h"
+#include "source.h"
+#include "file_io.h"
+#include "opcode_table.h"
+#include "symbol_names.h"
+#include "region.h"
+
+#define MIN_LINES_PER_CHUNK 64   /* Smaller chunks are not worth a thread */
+
+
+/* A symbol use seen by a parallel chunk: an external use, or an .entry mark if address < 0 */
+typedef struct {
+    SymbolNode *symbol;
+    int address;
+} SymbolReference;
+
+
+/*
+ * State of a second pass over a range of lines. The serial pass records
+ * external uses straight into the file's table; a parallel chunk only reads
+ * the symbol table and queues its references for an in-order merge.
+ */
+typedef struct {
+    const char *filename;
+    SymbolTable *symbol_table;
+    int ic;
+    ExternalTable *externals;       /* NULL in a parallel chunk */
+    SymbolReference *references;
+    int reference_count;
+    int reference_capacity;
+    int list_open;      /* 1 while a .data/.mat value list continues on the next line */
+    int speculative;    /* 1 = abandon the chunk on the first error instead of reporting it */
+    int failed;
+} SecondPassState;
+
+
+typedef struct {
+    const SourceFile *source;
+    int first_line;
+    int last_line;
+    int end_ic;         /* IC the chunk must finish at */
+    SecondPassState state;
+    pthread_t thread;
+    int started;
+} SecondPassChunk;
 
 /* Forward declarations */
-int encode_immediate_operand(const char *operand, int line_number, const char *filename);
 unsigned int encode_register_operand(const char *operand, int is_source);
 int parse_matrix_operand(const char *operand, char *label, int *row, int *col);
-int count_operands_for_instruction(int opcode);
-
-
-static int process_line_second_pass(char *line, int line_number, const char *filename, SymbolNode *symbol_table, ExternalUsage **externals_list);
-static int process_entry_directive_parsed(ParsedLine *parsed, int line_number, const char *filename, SymbolNode *symbol_table);
-static int encode_instruction_parsed(ParsedLine *parsed, int line_number, const char *filename, SymbolNode *symbol_table, ExternalUsage **externals_list);
-static int encode_operand(const char *operand, int addressing_mode, int line_number, const char *filename, SymbolNode *symbol_table, ExternalUsage **externals_list);
-static int encode_direct_operand(const char *operand, int line_number, const char *filename, SymbolNode *symbol_table, ExternalUsage **externals_list);
-static int encode_matrix_operand(const char *operand, int line_number, const char *filename, SymbolNode *symbol_table, ExternalUsage **externals_list);
-static int add_external_usage(ExternalUsage **externals_list, const char *symbol_name, int address);
-static int determine_are_field(const char *operand, int addressing_mode, SymbolNode *symbol_table);
 
 
-int second_pass(const char *full_path, const char *base_name, SymbolNode *symbol_table, ExternalUsage **externals_list) {
-    FILE *input_file;
+static void second_pass_lines(const SourceFile *source, int first_line, int last_line, SecondPassState *state);
+static int process_line_second_pass(char *line, int line_number, SecondPassState *state);
+static int process_entry_directive_parsed(ParsedLine *parsed, int line_number, SecondPassState *state);
+static int encode_instruction_parsed(ParsedLine *parsed, int line_number, SecondPassState *state);
+static int encode_operand(const char *operand, int name_id, int addressing_mode, int is_source, int slot, int line_number, SecondPassState *state);
+static int encode_immediate_operand(const char *operand, int slot, int line_number, SecondPassState *state);
+static int encode_direct_operand(int name_id, int slot, int line_number, SecondPassState *state);
+static int encode_matrix_operand(const char *operand, int name_id, int slot, int line_number, SecondPassState *state);
+static int add_external_usage(ExternalTable *externals, SymbolNode *symbol, int address);
+static int record_symbol_reference(SecondPassState *state, SymbolNode *symbol, int address);
+static int determine_are_field(const SymbolNode *symbol);
+static unsigned int encode_address_word(int address, int are_value);
+static void report_second_pass_error(SecondPassState *state, int line_number, const char *error_message);
+static int check_code_fits(const SourceFile *source, const char *filename);
+static int parallel_second_pass(const SourceFile *source, const char *filename, SymbolTable *symbol_table, ExternalTable *externals);
+static void* second_pass_worker(void *arg);
+static void write_output_stream(SymbolTable *symbol_table, ExternalTable *externals);
+static void write_object(FILE *output_file);
+static void write_object_words(FILE *output_file, const unsigned int *words, int count, int first_address);
+static void write_entries(FILE *output_file, SymbolTable *symbol_table);
+static void write_externals(FILE *output_file, ExternalTable *externals);
+static void write_grouped_externals(FILE *output_file, ExternalTable *externals);
+
+
+static int grouped_externals = 0;  /* 1 = write .ext as one line per symbol */
+static int second_pass_threads = 1;
+static FILE *output_stream = NULL;   /* Write the outputs here instead of into files */
+static int output_sections = 0;      /* 1 = also stream entries and externals, under headers */
+static int check_only = 0;           /* 1 = validate only: no external uses, no outputs */
+
+
+int second_pass(const char *full_path, const char *base_name, SymbolTable *symbol_table, ExternalTable *externals) {
+    SourceFile source;
+    SecondPassState state;
     char input_filename[MAX_LINE_LENGTH];
-    char line[MAX_LINE_LENGTH];
-    int line_number = 0;
-    int c;
     extern int error_flag;
     
     IC = IC_INITIAL_VALUE;
@@ -43,46 +108,283 @@ int second_pass(const char *full_path, const char *base_name, SymbolNode *symbol
     strcpy(input_filename, base_name);
     strcat(input_filename, ".am");
     
-    input_file = fopen(input_filename, "r");
-    if (input_file == NULL) {
+    if (!load_source_file(input_filename, &source)) {
         print_error(input_filename, 0, "Cannot open input file");
         return 0;
     }
     
-    while (fgets(line, sizeof(line), input_file) != NULL) {
-        line_number++;
+    if (!check_code_fits(&source, input_filename)) {
+        free_source_file(&source);
+        return 0;
+    }
+    
+    /* Try the parallel pass first; it backs off to the serial one on any error */
+    if (second_pass_threads < 2 || !parallel_second_pass(&source, input_filename, symbol_table, externals)) {
+        state.filename = input_filename;
+        state.symbol_table = symbol_table;
+        state.ic = IC;
+        state.externals = externals;
+        state.references = NULL;
+        state.reference_count = 0;
+        state.reference_capacity = 0;
+        state.list_open = 0;
+        state.speculative = 0;
+        state.failed = 0;
+        
+        second_pass_lines(&source, 0, source.line_count, &state);
+        IC = state.ic;
+    }
+    
+    free_source_file(&source);
+    
+    if (check_only) {
+        return (error_flag == 0);
+    }
+    if (error_flag == 0 && output_stream != NULL) {
+        write_output_stream(symbol_table, externals);
+    } else if (error_flag == 0) {
+        create_object_file(base_name);
+        create_entries_file(base_name, symbol_table);
+        create_externals_file(base_name, externals);
+    }
+    return (error_flag == 0);
+}
+
+
+/* Selects the grouped .ext layout (symbol followed by all use addresses) */
+void set_grouped_externals(int enabled) {
+    grouped_externals = enabled;
+}
+
+
+/*
+ * Sends the outputs to @stream instead of files (NULL for files). Only the
+ * object is written unless @with_sections is set; then the object, the
+ * entries and the externals each follow a [ob], [ent] or [ext] header line,
+ * and empty entries and externals are left out as their files would be.
+ */
+void set_output_stream(FILE *stream, int with_sections) {
+    output_stream = stream;
+    output_sections = with_sections;
+}
+
+
+/* Writes the outputs of the file just assembled to the output stream */
+static void write_output_stream(SymbolTable *symbol_table, ExternalTable *externals) {
+    if (output_sections) {
+        fputs(OBJECT_SECTION "\n", output_stream);
+    }
+    write_object(output_stream);
+    
+    if (output_sections && has_entry_symbols(symbol_table)) {
+        fputs(ENTRIES_SECTION "\n", output_stream);
+        write_entries(output_stream, symbol_table);
+    }
+    if (output_sections && has_external_usage(externals)) {
+        fputs(EXTERNALS_SECTION "\n", output_stream);
+        write_externals(output_stream, externals);
+    }
+    fflush(output_stream);
+}
+
+
+/*
+ * Makes the second pass only look for errors (undefined symbols, bad
+ * .entry targets, malformed operands): external uses are not collected
+ * and no output is written
+ */
+void set_second_pass_check_only(int enabled) {
+    check_only = enabled;
+}
+
+
+/* Sets how many threads the second pass may split a file across */
+void set_second_pass_threads(int count) {
+    second_pass_threads = (count > 0) ? count : 1;
+}
+
+
+/* Runs the second pass over lines [first_line, last_line) of the source */
+static void second_pass_lines(const SourceFile *source, int first_line, int last_line, SecondPassState *state) {
+    int i;
+    
+    for (i = first_line; i < last_line && !state->failed; i++) {
+        /* Stop early once the --max-errors limit has been reached */
+        if (!state->speculative && error_limit_reached()) {
+            break;
+        }
         
-                 if (strchr(line, '\n') == NULL && !feof(input_file)) {
-             print_error(input_filename, line_number, "Line is longer than 80 characters");
-             while ((c = fgetc(input_file)) != '\n' && c != EOF);
+        if (is_line_too_long(source->lines[i])) {
+            report_second_pass_error(state, i + 1, "Line is longer than 80 characters");
             continue;
         }
         
-        if (is_empty_line(line) || is_comment_line(line)) {
+        if (is_empty_line(source->lines[i]) || is_comment_line(source->lines[i])) {
             continue;
         }
         
-        process_line_second_pass(line, line_number, input_filename, symbol_table, externals_list);
+        process_line_second_pass(source->lines[i], i + 1, state);
+    }
+}
+
+
+/*
+ * Reports a second pass error; a speculative chunk only marks itself failed
+ * so that the serial pass can report the error in order
+ */
+static void report_second_pass_error(SecondPassState *state, int line_number, const char *error_message) {
+    if (state->speculative) {
+        state->failed = 1;
+    } else {
+        print_error(state->filename, line_number, error_message);
+    }
+}
+
+
+/*
+ * Rejects a program whose code, by the first pass's line addresses, runs
+ * past the end of instruction_image; the error names the first line that
+ * does not fit. Without line addresses encode_instruction_parsed catches it.
+ * Returns: 1 if the code fits (or cannot be measured), 0 after an error
+ */
+static int check_code_fits(const SourceFile *source, const char *filename) {
+    const int *line_addresses;
+    int address_count;
+    int i;
+    
+    line_addresses = get_line_addresses(&address_count);
+    if (line_addresses == NULL || address_count != source->line_count ||
+        line_addresses[address_count] - IC_INITIAL_VALUE <= MEMORY_SIZE) {
+        return 1;
+    }
+    for (i = 0; i < address_count && line_addresses[i + 1] - IC_INITIAL_VALUE <= MEMORY_SIZE; i++) {
+        ;
+    }
+    print_error(filename, i + 1, "Instruction memory overflow");
+    return 0;
+}
+
+
+/*
+ * Gives line ranges to worker threads. The first pass recorded the IC at
+ * the start of every line, so each chunk encodes straight into its own
+ * instruction_image slots against the read-only symbol table. External
+ * uses and .entry marks are queued per chunk and merged in chunk order,
+ * which keeps the external table in address order.
+ * Returns: 1 if the parallel result was committed, 0 if the caller must
+ * run the serial pass instead
+ */
+static int parallel_second_pass(const SourceFile *source, const char *filename, SymbolTable *symbol_table, ExternalTable *externals) {
+    SecondPassChunk *chunks;
+    const int *line_addresses;
+    int address_count;
+    int chunk_count = second_pass_threads;
+    int committed = 1;
+    int i, j;
+    SymbolReference *reference;
+    
+    line_addresses = get_line_addresses(&address_count);
+    if (line_addresses == NULL || address_count != source->line_count) {
+        return 0;
     }
     
-    fclose(input_file);
+    if (source->line_count / chunk_count < MIN_LINES_PER_CHUNK) {
+        chunk_count = source->line_count / MIN_LINES_PER_CHUNK;
+    }
+    if (chunk_count < 2) {
+        return 0;
+    }
     
-    if (error_flag == 0) {
-        create_object_file(base_name);
-        create_entries_file(base_name, symbol_table);
-        create_externals_file(base_name, *externals_list);
+    chunks = (SecondPassChunk *)calloc(chunk_count, sizeof(SecondPassChunk));
+    if (chunks == NULL) {
+        return 0;
     }
-    return (error_flag == 0);
+    
+    for (i = 0; i < chunk_count; i++) {
+        chunks[i].source = source;
+        chunks[i].first_line = chunk_boundary(source, (int)((long)source->line_count * i / chunk_count));
+        chunks[i].last_line = chunk_boundary(source, (int)((long)source->line_count * (i + 1) / chunk_count));
+        chunks[i].end_ic = line_addresses[chunks[i].last_line];
+        chunks[i].state.filename = filename;
+        chunks[i].state.symbol_table = symbol_table;
+        chunks[i].state.ic = line_addresses[chunks[i].first_line];
+        chunks[i].state.externals = NULL;
+        chunks[i].state.list_open = 0;
+        chunks[i].state.speculative = 1;
+    }
+    
+    /* Chunk 0 runs on this thread; the others get their own (or run here if none can be started) */
+    for (i = 1; i < chunk_count; i++) {
+        chunks[i].started = (pthread_create(&chunks[i].thread, NULL, second_pass_worker, &chunks[i]) == 0);
+        if (!chunks[i].started) {
+            second_pass_worker(&chunks[i]);
+        }
+    }
+    second_pass_worker(&chunks[0]);
+    for (i = 1; i < chunk_count; i++) {
+        if (chunks[i].started) {
+            pthread_join(chunks[i].thread, NULL);
+        }
+    }
+    
+    /* Every chunk must be error free and end exactly where the next one starts */
+    for (i = 0; i < chunk_count; i++) {
+        if (chunks[i].state.failed || chunks[i].state.ic != chunks[i].end_ic) {
+            committed = 0;
+        }
+    }
+    
+    for (i = 0; i < chunk_count && committed; i++) {
+        for (j = 0; j < chunks[i].state.reference_count && committed; j++) {
+            reference = &chunks[i].state.references[j];
+            if (reference->address < 0) {
+                reference->symbol->attribute = ENTRY_SYMBOL;
+            } else {
+                committed = add_external_usage(externals, reference->symbol, reference->address);
+            }
+        }
+    }
+    
+    if (committed) {
+        IC = chunks[chunk_count - 1].end_ic;
+    } else {
+        /* Let the serial pass start from a clean image and table */
+        for (i = 0; i < externals->symbol_count; i++) {
+            externals->symbols[i]->external_id = -1;
+        }
+        cleanup_external_usage(externals);
+        memset(instruction_image, 0, sizeof(instruction_image));
+    }
+    
+    for (i = 0; i < chunk_count; i++) {
+        free(chunks[i].state.references);
+    }
+    free(chunks);
+    return committed;
+}
+
+
+static void* second_pass_worker(void *arg) {
+    SecondPassChunk *chunk = (SecondPassChunk *)arg;
+    
+    second_pass_lines(chunk->source, chunk->first_line, chunk->last_line, &chunk->state);
+    return NULL;
 }
 
 
-static int process_line_second_pass(char *line, int line_number, const char *filename, SymbolNode *symbol_table, ExternalUsage **externals_list) {
+static int process_line_second_pass(char *line, int line_number, SecondPassState *state) {
     ParsedLine *parsed;
     int result;
     
+    /* Values continuing a .data/.mat list were stored by the first pass */
+    if (state->list_open) {
+        state->list_open = ends_with_comma(line);
+        return 1;
+    }
+    
     parsed = parse_line(line);
     if (parsed == NULL) {
-        print_error(filename, line_number, "Memory error");
+        report_second_pass_error(state, line_number, "Memory error");
         return 0;
     }
     
@@ -92,21 +394,22 @@ static int process_line_second_pass(char *line, int line_number, const char *fil
     }
     
     if (parsed->is_error) {
-        print_error(filename, line_number, "Invalid line format");
+        report_second_pass_error(state, line_number, "Invalid line format");
         free_parsed_line(parsed);
         return 0;
     }
     
     if (parsed->is_directive) {
         if (strcmp(parsed->command, ".entry") == 0) {
-            result = process_entry_directive_parsed(parsed, line_number, filename, symbol_table);
+            result = process_entry_directive_parsed(parsed, line_number, state);
         } else {
+            state->list_open = (parsed->values != NULL && ends_with_comma(parsed->values));
             result = 1;
         }
     } else {
-        result = encode_instruction_parsed(parsed, line_number, filename, symbol_table, externals_list);
+        result = encode_instruction_parsed(parsed, line_number, state);
         if (result > 0) {
-            IC += result;
+            state->ic += result;
         }
     }
     
@@ -117,35 +420,21 @@ static int process_line_second_pass(char *line, int line_number, const char *fil
 
 
 
-unsigned int encode_instruction_word(int opcode, int src_mode, int dest_mode) {
-    unsigned int word = 0;
-    
-    word |= (opcode & 0xF) << 6;
-    
-    if (src_mode != -1) {
-        word |= (src_mode & 0x3) << 4;
-    }
-    
-    if (dest_mode != -1) {
-        word |= (dest_mode & 0x3) << 2;
-    }
-    
-    word |= 0;
-    
-    return word;
-}
-
-
-static int encode_operand(const char *operand, int addressing_mode, int line_number, const char *filename, SymbolNode *symbol_table, ExternalUsage **externals_list) {
+/*
+ * Encodes one operand into the extra words starting at @slot words past
+ * the first word of the instruction
+ * Returns: number of words written, or -1 on error
+ */
+static int encode_operand(const char *operand, int name_id, int addressing_mode, int is_source, int slot, int line_number, SecondPassState *state) {
     switch (addressing_mode) {
         case 0:
-            return encode_immediate_operand(operand, line_number, filename);
+            return encode_immediate_operand(operand, slot, line_number, state);
         case 1:
-            return encode_direct_operand(operand, line_number, filename, symbol_table, externals_list);
+            return encode_direct_operand(name_id, slot, line_number, state);
         case 2:
-            return encode_matrix_operand(operand, line_number, filename, symbol_table, externals_list);
+            return encode_matrix_operand(operand, name_id, slot, line_number, state);
         case 3:
-            instruction_image[IC - IC_INITIAL_VALUE + 1] = encode_register_operand(operand, 0);
+            instruction_image[state->ic - IC_INITIAL_VALUE + slot] = encode_register_operand(operand, is_source);
             return 1;
         default:
             return -1;
@@ -153,41 +442,40 @@ static int encode_operand(const char *operand, int addressing_mode, int line_num
 }
 
 
-int encode_immediate_operand(const char *operand, int line_number, const char *filename) {
+static int encode_immediate_operand(const char *operand, int slot, int line_number, SecondPassState *state) {
     int value;
     unsigned int word = 0;
     
     if (!is_valid_integer(operand + 1, &value)) {
-        print_error(filename, line_number, "Invalid immediate value");
+        report_second_pass_error(state, line_number, "Invalid immediate value");
         return -1;
     }
     
     word = (value & 0x3FF) << 2;
     word |= 0;
     
-    instruction_image[IC - IC_INITIAL_VALUE + 1] = word;
+    instruction_image[state->ic - IC_INITIAL_VALUE + slot] = word;
     
     return 1;
 }
 
 
-static int encode_direct_operand(const char *operand, int line_number, const char *filename, SymbolNode *symbol_table, ExternalUsage **externals_list) {
+static int encode_direct_operand(int name_id, int slot, int line_number, SecondPassState *state) {
     SymbolNode *symbol;
-    unsigned int word = 0;
     int are_value;
     int address;
     
-    symbol = find_symbol(symbol_table, operand);
+    symbol = find_symbol(state->symbol_table, name_id);
     if (symbol == NULL) {
-        print_error(filename, line_number, "Undefined symbol");
+        report_second_pass_error(state, line_number, "Undefined symbol");
         return -1;
     }
     
-    are_value = determine_are_field(operand, 1, symbol_table);
+    are_value = determine_are_field(symbol);
     
     if (symbol->attribute == EXTERNAL_SYMBOL) {
-        if (!add_external_usage(externals_list, operand, IC + 1)) {
-            print_error(filename, line_number, "Error with external symbol");
+        if (!record_symbol_reference(state, symbol, state->ic + slot)) {
+            report_second_pass_error(state, line_number, "Error with external symbol");
             return -1;
         }
         address = 0;
@@ -195,15 +483,18 @@ static int encode_direct_operand(const char *operand, int line_number, const cha
         address = symbol->address;
     }
     
-    word = (address & 0x3FF) << 2;
-    word |= (are_value & 0x3);
-    
-    instruction_image[IC - IC_INITIAL_VALUE + 1] = word;
+    instruction_image[state->ic - IC_INITIAL_VALUE + slot] = encode_address_word(address, are_value);
     return 1;
 }
 
 
-static int encode_matrix_operand(const char *operand, int line_number, const char *filename, SymbolNode *symbol_table, ExternalUsage **externals_list) {
+/* Packs a symbol address into bits 2-9 and its A,R,E bits into bits 0-1 */
+static unsigned int encode_address_word(int address, int are_value) {
+    return ((unsigned int)(address & ADDRESS_FIELD_MASK) << 2) | (are_value & 0x3);
+}
+
+
+static int encode_matrix_operand(const char *operand, int name_id, int slot, int line_number, SecondPassState *state) {
     char label[MAX_SYMBOL_NAME];
     int row, col;
     SymbolNode *symbol;
@@ -211,32 +502,33 @@ static int encode_matrix_operand(const char *operand, int line_number, const cha
     int are_value;
     
     if (!parse_matrix_operand(operand, label, &row, &col)) {
-        print_error(filename, line_number, "Invalid matrix operand format");
+        report_second_pass_error(state, line_number, "Invalid matrix operand format");
         return -1;
     }
     
-    symbol = find_symbol(symbol_table, label);
+    symbol = find_symbol(state->symbol_table, name_id);
     if (symbol == NULL) {
-        print_error(filename, line_number, "Undefined matrix symbol");
+        report_second_pass_error(state, line_number, "Undefined matrix symbol");
         return -1;
     }
     
-    are_value = determine_are_field(label, 2, symbol_table);
+    are_value = determine_are_field(symbol);
     
     if (symbol->attribute == EXTERNAL_SYMBOL) {
-        if (!add_external_usage(externals_list, label, IC + 1)) {
-            print_error(filename, line_number, "Error with external symbol");
+        if (!record_symbol_reference(state, symbol, state->ic + slot)) {
+            report_second_pass_error(state, line_number, "Error with external symbol");
             return -1;
         }
-        word1 = 0 | (are_value << 0);
+        word1 = encode_address_word(0, are_value);
     } else {
-        word1 = (symbol->address & 0x3FF) | (are_value << 0);
+        word1 = encode_address_word(symbol->address, are_value);
     }
     
-    word2 = ((row & 0x1F) << 5) | ((col & 0x1F) << 0) | (0x0 << 0);
+    /* Row register in bits 6-9, column register in bits 2-5 */
+    word2 = ((row & 0xF) << 6) | ((col & 0xF) << 2);
     
-    instruction_image[IC - IC_INITIAL_VALUE + 1] = word1;
-    instruction_image[IC - IC_INITIAL_VALUE + 2] = word2;
+    instruction_image[state->ic - IC_INITIAL_VALUE + slot] = word1;
+    instruction_image[state->ic - IC_INITIAL_VALUE + slot + 1] = word2;
     
     return 2;
 }
@@ -246,8 +538,9 @@ unsigned int encode_register_operand(const char *operand, int is_source) {
     int reg_num = operand[1] - '0';
     unsigned int word = 0;
     
+    /* Source register in bits 6-9, destination register in bits 2-5 */
     if (is_source) {
-        word |= (reg_num & 0x7) << 5;
+        word |= (reg_num & 0x7) << 6;
     } else {
         word |= (reg_num & 0x7) << 2;
     }
@@ -261,26 +554,15 @@ unsigned int encode_two_registers(const char *src_operand, const char *dest_oper
     int dest_reg = dest_operand[1] - '0';
     unsigned int word = 0;
     
-    word |= (src_reg & 0x7) << 5;
+    word |= (src_reg & 0x7) << 6;
     word |= (dest_reg & 0x7) << 2;
     word |= 0x0;
     return word;
 }
 
 
-static int determine_are_field(const char *operand, int addressing_mode, SymbolNode *symbol_table) {
-    SymbolNode *symbol;
-    
-    if (addressing_mode == 0) {
-        return 0;
-    }
-    if (addressing_mode == 3) {
-        return 0;
-    }
-    symbol = find_symbol(symbol_table, operand);
-    if (symbol == NULL) {
-        return 0;
-    }
+/* Returns the A,R,E bits of a reference to @symbol: 1 (E) if external, 2 (R) otherwise */
+static int determine_are_field(const SymbolNode *symbol) {
     if (symbol->attribute == EXTERNAL_SYMBOL) {
         return 1;
     } else {
@@ -289,24 +571,28 @@ static int determine_are_field(const char *operand, int addressing_mode, SymbolN
 }
 
 
-static int process_entry_directive_parsed(ParsedLine *parsed, int line_number, const char *filename, SymbolNode *symbol_table) {
+static int process_entry_directive_parsed(ParsedLine *parsed, int line_number, SecondPassState *state) {
     SymbolNode *symbol;
     
     if (!parsed->operand1) {
-        print_error(filename, line_number, ".entry directive requires exactly one symbol name");
+        report_second_pass_error(state, line_number, ".entry directive requires exactly one symbol name");
         return 0;
     }
     
-    symbol = find_symbol(symbol_table, parsed->operand1);
+    symbol = find_symbol(state->symbol_table, parsed->operand1_id);
     if (symbol == NULL) {
-        print_error(filename, line_number, "Symbol not defined");
+        report_second_pass_error(state, line_number, "Symbol not defined");
         return 0;
     }
     if (symbol->attribute == EXTERNAL_SYMBOL) {
-        print_error(filename, line_number, "An external symbol cannot be an entry point.");
+        report_second_pass_error(state, line_number, "An external symbol cannot be an entry point.");
         return 0;
     }
     
+    /* A parallel chunk must not modify the shared table; its mark is applied at merge time */
+    if (state->externals == NULL) {
+        return record_symbol_reference(state, symbol, -1);
+    }
     symbol->attribute = ENTRY_SYMBOL;
     
     return 1;
@@ -315,12 +601,13 @@ static int process_entry_directive_parsed(ParsedLine *parsed, int line_number, c
 
 
 
-static int encode_instruction_parsed(ParsedLine *parsed, int line_number, const char *filename, SymbolNode *symbol_table, ExternalUsage **externals_list) {
+static int encode_instruction_parsed(ParsedLine *parsed, int line_number, SecondPassState *state) {
     int opcode;
     int expected_operands;
     int src_mode = -1, dest_mode = -1;
     const char *src_operand = NULL, *dest_operand = NULL;
-    unsigned int instruction_word;
+    int src_id = NO_NAME_ID, dest_id = NO_NAME_ID;
+    const InstructionForm *form;
     int words_used = 1; /* Start with base instruction word */
     int operand_result;
     int actual_operands;
@@ -331,51 +618,58 @@ static int encode_instruction_parsed(ParsedLine *parsed, int line_number, const
     
     opcode = get_instruction_opcode(parsed->command);
     if (opcode == -1) {
-        print_error(filename, line_number, "Unknown instruction");
+        report_second_pass_error(state, line_number, "Unknown instruction");
         return -1;
     }
     
-    expected_operands = count_operands_for_instruction(opcode);
+    expected_operands = opcode_operand_counts[opcode];
     actual_operands = 0;
     if (parsed->operand1) actual_operands++;
     if (parsed->operand2) actual_operands++;
     
     if (actual_operands != expected_operands) {
-        print_error(filename, line_number, "Wrong number of operands");
+        report_second_pass_error(state, line_number, "Wrong number of operands");
         return -1;
     }
     
     if (expected_operands == 1) {
         dest_operand = parsed->operand1;
+        dest_id = parsed->operand1_id;
         dest_mode = get_addressing_mode(dest_operand);
     } else if (expected_operands == 2) {
         src_operand = parsed->operand1;
         dest_operand = parsed->operand2;
+        src_id = parsed->operand1_id;
+        dest_id = parsed->operand2_id;
         src_mode = get_addressing_mode(src_operand);
         dest_mode = get_addressing_mode(dest_operand);
     }
     
-    if (!is_valid_addressing_for_instruction(opcode, src_mode, dest_mode)) {
-        print_error(filename, line_number, "Invalid addressing mode");
+    form = INSTRUCTION_FORM(opcode, src_mode, dest_mode);
+    if (!form->valid) {
+        report_second_pass_error(state, line_number, "Invalid addressing mode");
+        return -1;
+    }
+    if (state->ic - IC_INITIAL_VALUE + form->length > MEMORY_SIZE) {
+        report_second_pass_error(state, line_number, "Instruction memory overflow");
         return -1;
     }
     
-    instruction_word = encode_instruction_word(opcode, src_mode, dest_mode);
-    instruction_image[IC - IC_INITIAL_VALUE] = instruction_word;
+    instruction_image[state->ic - IC_INITIAL_VALUE] = form->first_word;
     
     if (expected_operands == 2 && src_mode == 3 && dest_mode == 3) {
-        instruction_image[IC - IC_INITIAL_VALUE + words_used] = encode_two_registers(src_operand, dest_operand);
+        instruction_image[state->ic - IC_INITIAL_VALUE + words_used] = encode_two_registers(src_operand, dest_operand);
         words_used++;
     } else {
         if (src_operand) {
-            operand_result = encode_operand(src_operand, src_mode, line_number, filename, symbol_table, externals_list);
+            operand_result = encode_operand(src_operand, src_id, src_mode, 1, words_used, line_number, state);
             if (operand_result == -1) {
                 return -1;
             }
             words_used += operand_result;
         }
         if (dest_operand) {
-            operand_result = encode_operand(dest_operand, dest_mode, line_number, filename, symbol_table, externals_list);
+            operand_result = encode_operand(dest_operand, dest_id, dest_mode, 0, words_used, line_number, state);
             if (operand_result == -1) {
                 return -1;
             }
@@ -386,20 +680,82 @@ static int encode_instruction_parsed(ParsedLine *parsed, int line_number, const
 }
 
 
-static int add_external_usage(ExternalUsage **externals_list, const char *symbol_name, int address) {
-    ExternalUsage *new_usage;
+/*
+ * Records an external use (address >= 0) or an .entry mark (address < 0).
+ * The serial pass applies it at once; a parallel chunk queues it
+ */
+static int record_symbol_reference(SecondPassState *state, SymbolNode *symbol, int address) {
+    SymbolReference *grown;
+    int new_capacity;
     
-    new_usage = (ExternalUsage *)malloc(sizeof(ExternalUsage));
-    if (new_usage == NULL) {
-        return 0;
+    if (check_only && address >= 0) {
+        return 1;
+    }
+    if (state->externals != NULL) {
+        return add_external_usage(state->externals, symbol, address);
+    }
+    
+    if (state->reference_count == state->reference_capacity) {
+        new_capacity = state->reference_capacity ? state->reference_capacity * 2 : EXTERNAL_USES_INITIAL_CAPACITY;
+        grown = (SymbolReference *)realloc(state->references, new_capacity * sizeof(SymbolReference));
+        if (grown == NULL) {
+            return 0;
+        }
+        state->references = grown;
+        state->reference_capacity = new_capacity;
     }
     
-    strcpy(new_usage->symbol_name, symbol_name);
-    new_usage->address = address;
-    new_usage->next = NULL;
+    state->references[state->reference_count].symbol = symbol;
+    state->references[state->reference_count].address = address;
+    state->reference_count++;
+    return 1;
+}
+
+
+/*
+ * Records a use of an external symbol at @address
+ * Uses are appended to a pooled array, so they stay in address order. The
+ * arrays live in the file region: growing one copies it into a block twice
+ * the size and leaves the old one to the next reset.
+ */
+static int add_external_usage(ExternalTable *externals, SymbolNode *symbol, int address) {
+    SymbolNode **grown_symbols;
+    ExternalUse *grown_uses;
+    int new_capacity;
+    
+    if (symbol->external_id < 0) {
+        if (externals->symbol_count == externals->symbol_capacity) {
+            new_capacity = externals->symbol_capacity ? externals->symbol_capacity * 2 : 8;
+            grown_symbols = (SymbolNode **)region_alloc(new_capacity * sizeof(SymbolNode *));
+            if (grown_symbols == NULL) {
+                return 0;
+            }
+            if (externals->symbol_count > 0) {
+                memcpy(grown_symbols, externals->symbols, externals->symbol_count * sizeof(SymbolNode *));
+            }
+            externals->symbols = grown_symbols;
+            externals->symbol_capacity = new_capacity;
+        }
+        symbol->external_id = externals->symbol_count;
+        externals->symbols[externals->symbol_count++] = symbol;
+    }
     
-    new_usage->next = *externals_list;
-    *externals_list = new_usage;
+    if (externals->use_count == externals->use_capacity) {
+        new_capacity = externals->use_capacity ? externals->use_capacity * 2 : EXTERNAL_USES_INITIAL_CAPACITY;
+        grown_uses = (ExternalUse *)region_alloc(new_capacity * sizeof(ExternalUse));
+        if (grown_uses == NULL) {
+            return 0;
+        }
+        if (externals->use_count > 0) {
+            memcpy(grown_uses, externals->uses, externals->use_count * sizeof(ExternalUse));
+        }
+        externals->uses = grown_uses;
+        externals->use_capacity = new_capacity;
+    }
+    
+    externals->uses[externals->use_count].symbol_id = symbol->external_id;
+    externals->uses[externals->use_count].address = address;
+    externals->use_count++;
     
     return 1;
 }
@@ -408,45 +764,70 @@ static int add_external_usage(ExternalUsage **externals_list, const char *symbol
 int create_object_file(const char *base_name) {
     FILE *output_file;
     char output_filename[MAX_LINE_LENGTH];
-    char base4_address[6], base4_value[6];
-    int i;
-    int code_size = IC - IC_INITIAL_VALUE;
     
     strcpy(output_filename, base_name);
     strcat(output_filename, ".ob");
     
-    output_file = fopen(output_filename, "w");
+    output_file = open_output_file(output_filename);
     if (output_file == NULL) {
         print_error(output_filename, 0, "Cannot create object file");
         return 0;
     }
     
+    write_object(output_file);
+    close_output_file(output_file);
+    return 1;
+}
+
+
+static void write_object(FILE *output_file) {
+    char base4_address[6], base4_value[6];
+    int code_size = IC - IC_INITIAL_VALUE;
+    
     to_base4(code_size, base4_address);
     to_base4(DC, base4_value);
     fprintf(output_file, "%s %s\n", base4_address, base4_value);
     
-    for (i = 0; i < code_size; i++) {
-        to_base4(IC_INITIAL_VALUE + i, base4_address);
-        to_base4(instruction_image[i], base4_value);
-        fprintf(output_file, "%s %s\n", base4_address, base4_value);
+    write_object_words(output_file, instruction_image, code_size, IC_INITIAL_VALUE);
+    write_object_words(output_file, data_image, DC, IC);
+}
+
+
+/*
+ * Writes @count words as "address value" lines, formatted into a batch
+ * buffer and passed to fwrite once per OBJECT_BATCH_LINES lines. Runs of
+ * equal words (.fill, zeroed matrices) reuse the encoded value.
+ */
+static void write_object_words(FILE *output_file, const unsigned int *words, int count, int first_address) {
+    char batch[OBJECT_BATCH_LINES * OBJECT_LINE_LENGTH];
+    char base4_value[6];
+    char *line = batch;
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        if (i == 0 || words[i] != words[i - 1]) {
+            to_base4(words[i], base4_value);
+        }
+        to_base4(first_address + i, line);
+        line[5] = ' ';
+        memcpy(line + 6, base4_value, 5);
+        line[11] = '\n';
+        line += OBJECT_LINE_LENGTH;
+        
+        if (line == batch + sizeof(batch)) {
+            fwrite(batch, 1, sizeof(batch), output_file);
+            line = batch;
+        }
     }
-    for (i = 0; i < DC; i++) {
-        to_base4(IC + i, base4_address);
-        to_base4(data_image[i], base4_value);
-        fprintf(output_file, "%s %s\n", base4_address, base4_value);
+    if (line > batch) {
+        fwrite(batch, 1, line - batch, output_file);
     }
-    
-    fclose(output_file);
-    return 1;
 }
 
 
-int create_entries_file(const char *base_name, SymbolNode *symbol_table) {
+int create_entries_file(const char *base_name, SymbolTable *symbol_table) {
     FILE *output_file;
     char output_filename[MAX_LINE_LENGTH];
-    char base4_address[6];
-    SymbolNode *current;
-    int has_entries = 0;
     
     if (!has_entry_symbols(symbol_table)) {
         return 1;
@@ -455,63 +836,116 @@ int create_entries_file(const char *base_name, SymbolNode *symbol_table) {
     strcpy(output_filename, base_name);
     strcat(output_filename, ".ent");
     
-    output_file = fopen(output_filename, "w");
+    output_file = open_output_file(output_filename);
     if (output_file == NULL) {
         print_error(output_filename, 0, "Cannot create entries file");
         return 0;
     }
     
-    current = symbol_table;
-    while (current != NULL) {
+    write_entries(output_file, symbol_table);
+    close_output_file(output_file);
+    return 1;
+}
+
+
+static void write_entries(FILE *output_file, SymbolTable *symbol_table) {
+    char base4_address[6];
+    SymbolNode *current;
+    
+    for (current = symbol_table->head; current != NULL; current = current->next) {
         if (current->attribute == ENTRY_SYMBOL) {
             to_base4(current->address, base4_address);
             fprintf(output_file, "%s %s\n", current->name, base4_address);
-            has_entries = 1;
         }
-        current = current->next;
-    }
-    
-    fclose(output_file);
-    
-    if (!has_entries) {
-        remove(output_filename);
     }
-    
-    return 1;
 }
 
 
-int create_externals_file(const char *base_name, ExternalUsage *externals_list) {
+int create_externals_file(const char *base_name, ExternalTable *externals) {
     FILE *output_file;
     char output_filename[MAX_LINE_LENGTH];
-    char base4_address[6];
-    ExternalUsage *current;
     
-    if (!has_external_usage(externals_list)) {
+    if (!has_external_usage(externals)) {
         return 1;
     }
     
     strcpy(output_filename, base_name);
     strcat(output_filename, ".ext");
     
-    output_file = fopen(output_filename, "w");
+    output_file = open_output_file(output_filename);
     if (output_file == NULL) {
         print_error(output_filename, 0, "Cannot create externals file");
         return 0;
     }
-    current = externals_list;
-    while (current != NULL) {
-        to_base4(current->address, base4_address);
-        fprintf(output_file, "%s %s\n", current->symbol_name, base4_address);
-        current = current->next;
-    }
-    fclose(output_file);
+    
+    write_externals(output_file, externals);
+    close_output_file(output_file);
     return 1;
 }
 
 
-int has_entry_symbols(SymbolNode *symbol_table) {
-    SymbolNode *current = symbol_table;
+static void write_externals(FILE *output_file, ExternalTable *externals) {
+    char base4_address[6];
+    int i;
+    
+    if (grouped_externals) {
+        write_grouped_externals(output_file, externals);
+    } else {
+        for (i = 0; i < externals->use_count; i++) {
+            to_base4(externals->uses[i].address, base4_address);
+            fprintf(output_file, "%s %s\n", externals->symbols[externals->uses[i].symbol_id]->name, base4_address);
+        }
+    }
+}
+
+
+/*
+ * Writes one line per external symbol: the name followed by all of its use
+ * addresses. A counting sort on symbol_id groups the uses in one pass over
+ * the pool, keeping each group in address order.
+ */
+static void write_grouped_externals(FILE *output_file, ExternalTable *externals) {
+    char base4_address[6];
+    int *group_start;
+    int *grouped;
+    int i, id;
+    
+    group_start = (int *)calloc(externals->symbol_count + 1, sizeof(int));
+    grouped = (int *)malloc((externals->use_count ? externals->use_count : 1) * sizeof(int));
+    if (group_start == NULL || grouped == NULL) {
+        free(group_start);
+        free(grouped);
+        print_error("externals", 0, "Memory allocation failed");
+        return;
+    }
+    
+    for (i = 0; i < externals->use_count; i++) {
+        group_start[externals->uses[i].symbol_id + 1]++;
+    }
+    for (id = 0; id < externals->symbol_count; id++) {
+        group_start[id + 1] += group_start[id];
+    }
+    for (i = 0; i < externals->use_count; i++) {
+        grouped[group_start[externals->uses[i].symbol_id]++] = externals->uses[i].address;
+    }
+    
+    /* Each group_start[id] now holds the end of group id, i.e. the start of id + 1 */
+    for (id = 0, i = 0; id < externals->symbol_count; id++) {
+        fputs(externals->symbols[id]->name, output_file);
+        for (; i < group_start[id]; i++) {
+            to_base4(grouped[i], base4_address);
+            fprintf(output_file, " %s", base4_address);
+        }
+        fputc('\n', output_file);
+    }
+    
+    free(group_start);
+    free(grouped);
+}
+
+
+int has_entry_symbols(SymbolTable *symbol_table) {
+    SymbolNode *current = symbol_table->head;
     while (current != NULL) {
         if (current->attribute == ENTRY_SYMBOL) {
             return 1;
@@ -522,8 +956,18 @@ int has_entry_symbols(SymbolNode *symbol_table) {
 }
 
 
-int has_external_usage(ExternalUsage *externals_list) {
-    return (externals_list != NULL);
+void init_external_table(ExternalTable *externals) {
+    externals->symbols = NULL;
+    externals->symbol_count = 0;
+    externals->symbol_capacity = 0;
+    externals->uses = NULL;
+    externals->use_count = 0;
+    externals->use_capacity = 0;
+}
+
+
+int has_external_usage(ExternalTable *externals) {
+    return (externals->use_count > 0);
 }
 
 
@@ -563,15 +1007,7 @@ int parse_matrix_operand(const char *operand, char *label, int *row, int *col) {
 }
 
 
-void cleanup_external_usage(ExternalUsage **externals_list) {
-    ExternalUsage *current = *externals_list;
-    ExternalUsage *next;
-    
-    while (current != NULL) {
-        next = current->next;
-        free(current);
-        current = next;
-    }
-    
-    *externals_list = NULL;
-}
\ No newline at end of file
+/* Empties the table; its arrays live in the file region */
+void cleanup_external_usage(ExternalTable *externals) {
+    init_external_table(externals);
+}
@@ -1,17 +1,48 @@
 #ifndef SECOND_PASS_H
 #define SECOND_PASS_H
 
+#include <stdio.h>
 #include "data_structures.h"
 
 
-typedef struct ExternalUsage {
-    char symbol_name[MAX_SYMBOL_NAME];
+#define EXTERNAL_USES_INITIAL_CAPACITY 64  /* Initial size of the external use pool */
+#define ADDRESS_FIELD_MASK 0xFF            /* Address bits of an operand word (bits 2-9) */
+#define OBJECT_LINE_LENGTH 12              /* "aaaaa bbbbb\n": two base 4 words and a newline */
+#define OBJECT_BATCH_LINES 256             /* Object lines formatted per fwrite */
+#define OBJECT_SECTION "[ob]"              /* Section headers of a streamed output */
+#define ENTRIES_SECTION "[ent]"
+#define EXTERNALS_SECTION "[ext]"
+
+
+typedef struct {
+    int symbol_id;   /* Index into ExternalTable.symbols */
     int address;
-    struct ExternalUsage *next;
-} ExternalUsage;
+} ExternalUse;
+
+
+typedef struct {
+    SymbolNode **symbols;   /* Distinct external symbols, in order of first use */
+    int symbol_count;
+    int symbol_capacity;
+    ExternalUse *uses;      /* Every use, in address order */
+    int use_count;
+    int use_capacity;
+} ExternalTable;
+
+
+int second_pass(const char *full_path, const char *base_name, SymbolTable *symbol_table, ExternalTable *externals);
+
 
+void set_grouped_externals(int enabled);
 
-int second_pass(const char *full_path, const char *base_name, SymbolNode *symbol_table, ExternalUsage **externals_list);
+
+void set_second_pass_threads(int count);
+
+
+void set_output_stream(FILE *stream, int with_sections);
+
+
+void set_second_pass_check_only(int enabled);
 
 
 
@@ -19,18 +50,21 @@ int second_pass(const char *full_path, const char *base_name, SymbolNode *symbol
 int create_object_file(const char *base_name);
 
 
-int create_entries_file(const char *base_name, SymbolNode *symbol_table);
+int create_entries_file(const char *base_name, SymbolTable *symbol_table);
+
+
+int create_externals_file(const char *base_name, ExternalTable *externals);
 
 
-int create_externals_file(const char *base_name, ExternalUsage *externals_list);
+int has_entry_symbols(SymbolTable *symbol_table);
 
 
-int has_entry_symbols(SymbolNode *symbol_table);
+void init_external_table(ExternalTable *externals);
 
 
-int has_external_usage(ExternalUsage *externals_list);
+int has_external_usage(ExternalTable *externals);
 
 
-void cleanup_external_usage(ExternalUsage **externals_list);
+void cleanup_external_usage(ExternalTable *externals);
 
 #endif /* SECOND_PASS_H */
\ No newline at end of file
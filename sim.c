@@ -0,0 +1,215 @@
+/*
+ * sim.c
+ * Main program for the instruction-set simulator
+ * Runs an assembled program and reports where the time went
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "simulator.h"
+#include "diagnostics.h"
+#include "utils.h"
+
+/*
+ * Function prototypes
+ */
+void print_summary(const Machine *machine, long max_steps, double seconds);
+void print_profile(const Machine *machine);
+void print_hot_spots(const Machine *machine, int count);
+void print_location(const Machine *machine, int address);
+int compare_hits(const void *a, const void *b);
+void print_sim_usage(const char *program_name);
+
+static const Machine *sorted_machine;  /* Machine whose addresses compare_hits orders */
+
+/*
+ * main - Entry point of the simulator program
+ * @argc: Number of command line arguments
+ * @argv: Array of command line argument strings
+ * Returns: 0 if the program reached stop, 1 otherwise
+ */
+int main(int argc, char *argv[]) {
+    static Machine machine;
+    extern int error_flag;
+    const char *base_name = NULL;
+    long max_steps = SIM_DEFAULT_STEPS;
+    int profile = 0;
+    int hot_spots = 0;
+    clock_t started;
+    double seconds;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc && atol(argv[i + 1]) > 0) {
+            max_steps = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--hot") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            hot_spots = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile = 1;
+        } else if (strncmp(argv[i], "--", 2) != 0 && base_name == NULL) {
+            base_name = argv[i];
+        } else {
+            print_sim_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (base_name == NULL) {
+        print_sim_usage(argv[0]);
+        return 1;
+    }
+
+    if (!load_program(base_name, &machine)) {
+        flush_diagnostics(stderr);
+        return 1;
+    }
+    load_source_symbols(base_name, &machine);
+
+    started = clock();
+    run_program(&machine, max_steps);
+    seconds = (double)(clock() - started) / CLOCKS_PER_SEC;
+    fflush(stdout);
+    flush_diagnostics(stderr);
+
+    print_summary(&machine, max_steps, seconds);
+    if (profile) {
+        print_profile(&machine);
+    }
+    if (hot_spots > 0) {
+        print_hot_spots(&machine, hot_spots);
+    }
+
+    free_program(&machine);
+    return (machine.halted && error_flag == 0) ? 0 : 1;
+}
+
+/*
+ * print_summary - Prints how the run ended, the simulation speed and the
+ * instruction mix (@seconds is the processor time spent running)
+ */
+void print_summary(const Machine *machine, long max_steps, double seconds) {
+    int opcode;
+
+    printf("\n=== Simulation ===\n");
+    if (machine->halted) {
+        printf("Stopped at stop after %ld instruction(s).\n", machine->instruction_count);
+    } else if (machine->faulted) {
+        printf("Runtime error after %ld instruction(s).\n", machine->instruction_count);
+    } else {
+        printf("Step limit of %ld instruction(s) reached.\n", max_steps);
+    }
+    if (seconds > 0) {
+        printf("Throughput: %.0f instructions/s\n", machine->instruction_count / seconds);
+    }
+
+    printf("Instruction counts:\n");
+    for (opcode = 0; opcode < 16; opcode++) {
+        if (machine->opcode_counts[opcode] > 0) {
+            printf("  %-5s %ld\n", reserved_instructions[opcode], machine->opcode_counts[opcode]);
+        }
+    }
+}
+
+/*
+ * print_profile - Prints the hit count of every executed address and the
+ * total per label (each address counts toward the closest label above it)
+ */
+void print_profile(const Machine *machine) {
+    long total;
+    int address, i, end;
+
+    printf("Address hits:\n");
+    for (address = machine->code_start; address < machine->code_end; address++) {
+        if (machine->hits[address] > 0) {
+            printf("  ");
+            print_location(machine, address);
+            printf(" %ld\n", machine->hits[address]);
+        }
+    }
+
+    printf("Label totals:\n");
+    for (i = 0; i < machine->label_count; i++) {
+        end = (i + 1 < machine->label_count) ? machine->labels[i + 1].address : machine->code_end;
+        total = 0;
+        for (address = machine->labels[i].address; address < end && address < SIM_MEMORY_SIZE; address++) {
+            total += machine->hits[address];
+        }
+        if (total > 0) {
+            printf("  %-20s %ld\n", machine->labels[i].name, total);
+        }
+    }
+}
+
+/*
+ * print_hot_spots - Prints the @count most executed addresses
+ */
+void print_hot_spots(const Machine *machine, int count) {
+    int addresses[SIM_MEMORY_SIZE];
+    int used = 0;
+    int address, i;
+
+    for (address = machine->code_start; address < machine->code_end; address++) {
+        if (machine->hits[address] > 0) {
+            addresses[used++] = address;
+        }
+    }
+
+    sorted_machine = machine;
+    qsort(addresses, used, sizeof(int), compare_hits);
+
+    printf("Hot spots:\n");
+    for (i = 0; i < used && i < count; i++) {
+        printf("  ");
+        print_location(machine, addresses[i]);
+        printf(" %ld (%.1f%%)\n", machine->hits[addresses[i]],
+               100.0 * machine->hits[addresses[i]] / machine->instruction_count);
+    }
+}
+
+/*
+ * print_location - Prints an address in base 4 with its label and offset
+ */
+void print_location(const Machine *machine, int address) {
+    const SimLabel *label = label_for_address(machine, address);
+    char base4_address[6];
+    char location[MAX_SYMBOL_NAME + 8];
+
+    to_base4((unsigned int)address, base4_address);
+    if (label == NULL) {
+        strcpy(location, "-");
+    } else if (label->address == address) {
+        strcpy(location, label->name);
+    } else {
+        sprintf(location, "%s+%d", label->name, address - label->address);
+    }
+    printf("%s %4d %-24s", base4_address, address, location);
+}
+
+/* Orders addresses by descending hit count, then by address */
+int compare_hits(const void *a, const void *b) {
+    int first = *(const int *)a;
+    int second = *(const int *)b;
+
+    if (sorted_machine->hits[first] != sorted_machine->hits[second]) {
+        return (sorted_machine->hits[first] > sorted_machine->hits[second]) ? -1 : 1;
+    }
+    return first - second;
+}
+
+/*
+ * print_sim_usage - Prints usage information for the simulator
+ */
+void print_sim_usage(const char *program_name) {
+    printf("Usage: %s [options] <name>\n", program_name);
+    printf("\nDescription:\n");
+    printf("  Loads name.ob (with name.ent and name.ext when present) and runs it\n");
+    printf("  from the first instruction until stop. prn prints to standard output\n");
+    printf("  and red reads characters from standard input. If name.am is present\n");
+    printf("  its labels and matrix dimensions are used as well.\n");
+    printf("\nOptions:\n");
+    printf("  --steps N   Stop after N instructions (default %ld)\n", SIM_DEFAULT_STEPS);
+    printf("  --profile   Print hit counts per address and per label\n");
+    printf("  --hot N     Print the N most executed addresses\n");
+}
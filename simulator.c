@@ -0,0 +1,785 @@
+/*
+ * simulator.c
+ * Implementation of the instruction-set simulator
+ * Decodes the words the second pass writes: the first word holds the
+ * opcode and both addressing modes, followed by one extra word per
+ * immediate, direct or register operand (two registers share one) and
+ * two extra words per matrix operand
+ * Each instruction is decoded once into a handler with its operands
+ * resolved; execution then dispatches through the handler pointer
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "simulator.h"
+#include "first_pass.h"
+#include "opcode_table.h"
+#include "utils.h"
+#include "symbol_names.h"
+#include "region.h"
+
+
+#define MAX_INSTRUCTION_WORDS 5  /* First word plus two matrix operands */
+
+
+typedef void (*InstructionHandler)(Machine *machine, const DecodedInstruction *decoded);
+
+
+/*
+ * A predecoded instruction. Entries are filled on first execution and
+ * dropped again when the program stores into one of their words.
+ */
+struct DecodedInstruction {
+    InstructionHandler handler;     /* Runs the instruction, or a fused pair */
+    InstructionHandler single;      /* Runs just this instruction; NULL = not decoded */
+    int opcode;
+    int next_pc;
+    SimOperand src;
+    SimOperand dest;
+    SimOperand pair_dest;              /* Target of the fused bne */
+    int pair_next_pc;
+};
+
+
+static int execute_next(Machine *machine, int allow_fused);
+static int decode_instruction(Machine *machine, int pc, DecodedInstruction *decoded);
+static int can_fuse_branch(const Machine *machine, int pc);
+static void invalidate_code(Machine *machine, int address);
+static int decode_operand(Machine *machine, SimOperand *operand, int at, int is_source);
+static int resolve_address(Machine *machine, int at, int *address);
+static int operand_address(Machine *machine, const SimOperand *operand);
+static int read_operand(Machine *machine, const SimOperand *operand);
+static void write_operand(Machine *machine, const SimOperand *operand, int value);
+static int jump_target(Machine *machine, const SimOperand *operand);
+static void execute_mov(Machine *machine, const DecodedInstruction *decoded);
+static void execute_cmp(Machine *machine, const DecodedInstruction *decoded);
+static void execute_add(Machine *machine, const DecodedInstruction *decoded);
+static void execute_sub(Machine *machine, const DecodedInstruction *decoded);
+static void execute_not(Machine *machine, const DecodedInstruction *decoded);
+static void execute_clr(Machine *machine, const DecodedInstruction *decoded);
+static void execute_lea(Machine *machine, const DecodedInstruction *decoded);
+static void execute_inc(Machine *machine, const DecodedInstruction *decoded);
+static void execute_dec(Machine *machine, const DecodedInstruction *decoded);
+static void execute_jmp(Machine *machine, const DecodedInstruction *decoded);
+static void execute_bne(Machine *machine, const DecodedInstruction *decoded);
+static void execute_red(Machine *machine, const DecodedInstruction *decoded);
+static void execute_prn(Machine *machine, const DecodedInstruction *decoded);
+static void execute_jsr(Machine *machine, const DecodedInstruction *decoded);
+static void execute_rts(Machine *machine, const DecodedInstruction *decoded);
+static void execute_stop(Machine *machine, const DecodedInstruction *decoded);
+static void execute_cmp_bne(Machine *machine, const DecodedInstruction *decoded);
+static int to_signed(unsigned int word, int bits);
+static void simulator_error(Machine *machine, int address, const char *message);
+static int load_object_file(const char *filename, Machine *machine);
+static void load_symbol_file(const char *filename, Machine *machine, int is_external);
+static int compare_labels(const void *a, const void *b);
+
+
+/*
+ * Loads base_name.ob, plus base_name.ent and base_name.ext when present
+ * Returns: 1 on success, 0 if the object file cannot be read
+ */
+int load_program(const char *base_name, Machine *machine) {
+    char filename[MAX_LINE_LENGTH];
+
+    strcpy(filename, base_name);
+    strcat(filename, ".ob");
+    if (!reset_machine(machine, filename)) {
+        return 0;
+    }
+    if (!load_object_file(machine->object_name, machine)) {
+        return 0;
+    }
+
+    strcpy(filename, base_name);
+    strcat(filename, ".ent");
+    load_symbol_file(filename, machine, 0);
+
+    strcpy(filename, base_name);
+    strcat(filename, ".ext");
+    load_symbol_file(filename, machine, 1);
+
+    sort_labels(machine);
+    machine->pc = machine->code_start;
+    return 1;
+}
+
+
+/*
+ * Clears @machine for a program loaded from @object_name (used in messages)
+ * Returns: 1 on success, 0 on allocation failure
+ */
+int reset_machine(Machine *machine, const char *object_name) {
+    memset(machine, 0, sizeof(*machine));
+    strcpy(machine->object_name, object_name);
+
+    machine->decoded = (DecodedInstruction *)calloc(SIM_MEMORY_SIZE, sizeof(DecodedInstruction));
+    if (machine->decoded == NULL) {
+        print_error(object_name, 0, "Memory allocation failed");
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * Adds every label of base_name.am to the machine
+ * The .ent file only names entry points; when the macro-expanded source is
+ * still around, the first pass recovers all labels and matrix dimensions.
+ * The source is used only if its code and data sizes match the loaded
+ * object, so a stale .am (or one the object was optimized away from)
+ * cannot attach labels to the wrong addresses.
+ */
+void load_source_symbols(const char *base_name, Machine *machine) {
+    SymbolTable symbol_table;
+    SymbolNode *current;
+    char filename[MAX_LINE_LENGTH];
+    FILE *source_file;
+
+    strcpy(filename, base_name);
+    strcat(filename, ".am");
+    source_file = fopen(filename, "r");
+    if (source_file == NULL) {
+        return;
+    }
+    fclose(source_file);
+
+    init_symbol_table(&symbol_table);
+    if (first_pass(base_name, base_name, &symbol_table) &&
+        IC == machine->code_end && IC + DC == machine->data_end) {
+        for (current = symbol_table.head; current != NULL; current = current->next) {
+            if (current->attribute != EXTERNAL_SYMBOL) {
+                add_label(machine, current->name, current->address, current->columns);
+            }
+        }
+        sort_labels(machine);
+    }
+    free_symbol_table(&symbol_table);
+    clear_symbol_names();
+    reset_region();
+}
+
+
+void free_program(Machine *machine) {
+    free(machine->decoded);
+    free(machine->labels);
+    free(machine->externals);
+    machine->decoded = NULL;
+    machine->labels = NULL;
+    machine->externals = NULL;
+    machine->label_count = 0;
+    machine->external_count = 0;
+}
+
+
+/* Reads the header line (code and data sizes) and the address/word lines */
+static int load_object_file(const char *filename, Machine *machine) {
+    FILE *input_file;
+    char line[MAX_LINE_LENGTH];
+    char first[MAX_LINE_LENGTH], second[MAX_LINE_LENGTH];
+    unsigned int code_size, data_size, address, word;
+
+    input_file = fopen(filename, "r");
+    if (input_file == NULL) {
+        print_error(filename, 0, "Cannot open object file");
+        return 0;
+    }
+
+    if (fgets(line, sizeof(line), input_file) == NULL ||
+        sscanf(line, "%80s %80s", first, second) != 2 ||
+        !from_base4(first, &code_size) || !from_base4(second, &data_size) ||
+        IC_INITIAL_VALUE + code_size + data_size > SIM_MEMORY_SIZE) {
+        print_error(filename, 1, "Invalid object file header");
+        fclose(input_file);
+        return 0;
+    }
+
+    machine->code_start = IC_INITIAL_VALUE;
+    machine->code_end = IC_INITIAL_VALUE + (int)code_size;
+    machine->data_end = machine->code_end + (int)data_size;
+
+    while (fgets(line, sizeof(line), input_file) != NULL) {
+        if (is_empty_line(line)) {
+            continue;
+        }
+        if (sscanf(line, "%80s %80s", first, second) != 2 ||
+            !from_base4(first, &address) || !from_base4(second, &word) ||
+            address >= SIM_MEMORY_SIZE) {
+            print_error(filename, 0, "Invalid object file line");
+            fclose(input_file);
+            return 0;
+        }
+        machine->memory[address] = word & 0x3FF;
+    }
+
+    fclose(input_file);
+    return 1;
+}
+
+
+/*
+ * Reads a .ent file ("NAME address") or a .ext file, in either layout
+ * ("NAME address" per use, or "NAME address address ..." per symbol)
+ */
+static void load_symbol_file(const char *filename, Machine *machine, int is_external) {
+    static char line[SIM_MEMORY_SIZE * 6 + MAX_LINE_LENGTH];  /* A grouped .ext line lists every use */
+    const char *delimiters = " \t\r\n";
+    FILE *input_file;
+    char *name, *field;
+    size_t length;
+    unsigned int address;
+
+    input_file = fopen(filename, "r");
+    if (input_file == NULL) {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), input_file) != NULL) {
+        name = line + strspn(line, delimiters);
+        length = strcspn(name, delimiters);
+        if (length == 0 || length >= MAX_SYMBOL_NAME) {
+            continue;
+        }
+        field = name + length;
+        if (*field != '\0') {
+            *field++ = '\0';
+        }
+
+        while (*(field += strspn(field, delimiters)) != '\0') {
+            length = strcspn(field, delimiters);
+            if (field[length] != '\0') {
+                field[length++] = '\0';
+            }
+            if (!from_base4(field, &address)) {
+                break;
+            }
+            if (is_external) {
+                add_external(machine, name, (int)address);
+            } else {
+                add_label(machine, name, (int)address, 0);
+            }
+            field += length;
+        }
+    }
+
+    fclose(input_file);
+}
+
+
+int add_external(Machine *machine, const char *name, int address) {
+    SimExternal *grown;
+
+    grown = (SimExternal *)realloc(machine->externals, (machine->external_count + 1) * sizeof(SimExternal));
+    if (grown == NULL) {
+        return 0;
+    }
+    machine->externals = grown;
+    strcpy(machine->externals[machine->external_count].name, name);
+    machine->externals[machine->external_count].address = address;
+    machine->external_count++;
+    return 1;
+}
+
+
+/*
+ * Adds a label for profiling; a name seen before only updates its columns
+ * Call sort_labels after the last label has been added
+ */
+int add_label(Machine *machine, const char *name, int address, int columns) {
+    SimLabel *grown;
+    int i;
+
+    for (i = 0; i < machine->label_count; i++) {
+        if (strcmp(machine->labels[i].name, name) == 0) {
+            if (columns > 0) {
+                machine->labels[i].columns = columns;
+            }
+            return 1;
+        }
+    }
+
+    grown = (SimLabel *)realloc(machine->labels, (machine->label_count + 1) * sizeof(SimLabel));
+    if (grown == NULL) {
+        return 0;
+    }
+    machine->labels = grown;
+    strcpy(machine->labels[machine->label_count].name, name);
+    machine->labels[machine->label_count].address = address;
+    machine->labels[machine->label_count].columns = columns;
+    machine->label_count++;
+    return 1;
+}
+
+
+static int compare_labels(const void *a, const void *b) {
+    const SimLabel *first = (const SimLabel *)a;
+    const SimLabel *second = (const SimLabel *)b;
+
+    if (first->address != second->address) {
+        return (first->address < second->address) ? -1 : 1;
+    }
+    return strcmp(first->name, second->name);
+}
+
+
+void sort_labels(Machine *machine) {
+    if (machine->label_count > 1) {
+        qsort(machine->labels, machine->label_count, sizeof(SimLabel), compare_labels);
+    }
+}
+
+
+/* Returns the closest label at or before @address, or NULL if there is none */
+const SimLabel* label_for_address(const Machine *machine, int address) {
+    int low = 0, high = machine->label_count - 1, middle;
+    const SimLabel *found = NULL;
+
+    while (low <= high) {
+        middle = (low + high) / 2;
+        if (machine->labels[middle].address <= address) {
+            found = &machine->labels[middle];
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return found;
+}
+
+
+/*
+ * Executes the instruction at PC, decoding it first if needed
+ * Returns: 1 if an instruction was executed, 0 once halted or faulted
+ */
+int step_program(Machine *machine) {
+    return execute_next(machine, 0);
+}
+
+
+/*
+ * Runs until stop, a runtime error or @max_steps instructions
+ * Returns: number of instructions executed
+ */
+long run_program(Machine *machine, long max_steps) {
+    long start = machine->instruction_count;
+    long remaining;
+
+    while ((remaining = max_steps - (machine->instruction_count - start)) > 0) {
+        /* A fused pair counts as two instructions */
+        if (!execute_next(machine, remaining >= 2)) {
+            break;
+        }
+    }
+    return machine->instruction_count - start;
+}
+
+
+/* Dispatches the predecoded entry at PC; @allow_fused lets a pair run at once */
+static int execute_next(Machine *machine, int allow_fused) {
+    DecodedInstruction *decoded;
+    int pc = machine->pc;
+
+    if (machine->halted || machine->faulted) {
+        return 0;
+    }
+    if (pc < machine->code_start || pc >= machine->code_end) {
+        simulator_error(machine, pc, "Execution left the code section");
+        return 0;
+    }
+
+    decoded = &machine->decoded[pc];
+    if (decoded->single == NULL && !decode_instruction(machine, pc, decoded)) {
+        return 0;
+    }
+
+    machine->hits[pc]++;
+    machine->instruction_count++;
+    machine->opcode_counts[decoded->opcode]++;
+
+    if (allow_fused) {
+        decoded->handler(machine, decoded);
+    } else {
+        decoded->single(machine, decoded);
+    }
+    return 1;
+}
+
+
+/*
+ * Decodes the instruction at @pc into @decoded, resolving its operands and
+ * fusing a cmp with a bne right after it
+ * Returns: 1 on success, 0 on a runtime error (already reported)
+ */
+static int decode_instruction(Machine *machine, int pc, DecodedInstruction *decoded) {
+    static const InstructionHandler handlers[16] = {
+        execute_mov, execute_cmp, execute_add, execute_sub,
+        execute_not, execute_clr, execute_lea, execute_inc,
+        execute_dec, execute_jmp, execute_bne, execute_red,
+        execute_prn, execute_jsr, execute_rts, execute_stop
+    };
+    const InstructionForm *form;
+    SimOperand src, dest;
+    int length;
+
+    if (!decode_at(machine, pc, &decoded->opcode, &src, &dest, &length)) {
+        return 0;
+    }
+
+    decoded->src = src;
+    decoded->dest = dest;
+    decoded->next_pc = pc + length;
+    decoded->single = handlers[decoded->opcode];
+    decoded->handler = decoded->single;
+
+    /* cmp; bne closes most loops - run the pair with one dispatch */
+    if (decoded->opcode == 1 && can_fuse_branch(machine, decoded->next_pc)) {
+        form = INSTRUCTION_FORM(10, -1, (int)((machine->memory[decoded->next_pc] >> 2) & 0x3));
+        decoded->pair_dest.mode = (int)((machine->memory[decoded->next_pc] >> 2) & 0x3);
+        decode_operand(machine, &decoded->pair_dest, decoded->next_pc + 1, 0);
+        decoded->pair_next_pc = decoded->next_pc + form->length;
+        decoded->handler = execute_cmp_bne;
+    }
+    return 1;
+}
+
+
+/*
+ * Decodes the first word at @pc and the operand words after it
+ * Returns: 1 on success, 0 on a runtime error (already reported)
+ */
+int decode_at(Machine *machine, int pc, int *opcode, SimOperand *src, SimOperand *dest, int *length) {
+    const InstructionForm *form;
+    unsigned int word = machine->memory[pc];
+    int operand_count, slot, used;
+
+    *opcode = (int)((word >> 6) & 0xF);
+    operand_count = opcode_operand_counts[*opcode];
+    src->mode = (operand_count == 2) ? (int)((word >> 4) & 0x3) : -1;
+    dest->mode = (operand_count >= 1) ? (int)((word >> 2) & 0x3) : -1;
+
+    form = INSTRUCTION_FORM(*opcode, src->mode, dest->mode);
+    if (!form->valid) {
+        simulator_error(machine, pc, "Illegal instruction");
+        return 0;
+    }
+    if (pc + form->length > machine->code_end) {
+        simulator_error(machine, pc, "Instruction runs past the code section");
+        return 0;
+    }
+    *length = form->length;
+
+    slot = 1;
+    if (src->mode == 3 && dest->mode == 3) {
+        src->reg = (int)((machine->memory[pc + 1] >> 6) & 0x7);
+        dest->reg = (int)((machine->memory[pc + 1] >> 2) & 0x7);
+        return 1;
+    }
+    if (src->mode != -1) {
+        used = decode_operand(machine, src, pc + slot, 1);
+        if (used < 0) {
+            return 0;
+        }
+        slot += used;
+    }
+    if (dest->mode != -1 && decode_operand(machine, dest, pc + slot, 0) < 0) {
+        return 0;
+    }
+    return 1;
+}
+
+
+/* Checks that the word at @pc is a bne that decodes without any error */
+static int can_fuse_branch(const Machine *machine, int pc) {
+    unsigned int word;
+    int mode;
+
+    if (pc + 2 > machine->code_end) {
+        return 0;
+    }
+    word = machine->memory[pc];
+    mode = (int)((word >> 2) & 0x3);
+    if (((word >> 6) & 0xF) != 10 || (word & 0xF0) != 0) {
+        return 0;
+    }
+    return (mode == 3 || (mode == 1 && (machine->memory[pc + 1] & 0x3) != 1));
+}
+
+
+/* A store into the code drops every predecoded entry that covers the word */
+static void invalidate_code(Machine *machine, int address) {
+    int pc;
+
+    for (pc = address - 2 * MAX_INSTRUCTION_WORDS + 1; pc <= address; pc++) {
+        if (pc >= machine->code_start && pc < machine->code_end) {
+            machine->decoded[pc].single = NULL;
+            machine->decoded[pc].handler = NULL;
+        }
+    }
+}
+
+
+/*
+ * Decodes the operand whose extra words start at address @at
+ * Returns: number of extra words used, or -1 on a runtime error
+ */
+static int decode_operand(Machine *machine, SimOperand *operand, int at, int is_source) {
+    unsigned int word = machine->memory[at];
+    const SimLabel *label;
+
+    switch (operand->mode) {
+        case 0:
+            operand->value = to_signed((word >> 2) & 0xFF, 8);
+            return 1;
+        case 1:
+            return resolve_address(machine, at, &operand->address) ? 1 : -1;
+        case 2:
+            if (!resolve_address(machine, at, &operand->address)) {
+                return -1;
+            }
+            label = label_for_address(machine, operand->address);
+            if (label == NULL || label->address != operand->address || label->columns == 0) {
+                simulator_error(machine, at, "Matrix dimensions unknown (assemble first so the .am file is present)");
+                return -1;
+            }
+            operand->columns = label->columns;
+            operand->row_reg = (int)((machine->memory[at + 1] >> 6) & 0x7);
+            operand->col_reg = (int)((machine->memory[at + 1] >> 2) & 0x7);
+            return 2;
+        default:
+            operand->reg = (int)((is_source ? (word >> 6) : (word >> 2)) & 0x7);
+            return 1;
+    }
+}
+
+
+/* Reads the address in the word at @at; external references cannot be run */
+static int resolve_address(Machine *machine, int at, int *address) {
+    char message[MAX_LINE_LENGTH + MAX_SYMBOL_NAME];
+    unsigned int word = machine->memory[at];
+    int i;
+
+    if ((word & 0x3) == 1) {
+        strcpy(message, "Unresolved external");
+        for (i = 0; i < machine->external_count; i++) {
+            if (machine->externals[i].address == at) {
+                strcat(message, " ");
+                strcat(message, machine->externals[i].name);
+                break;
+            }
+        }
+        simulator_error(machine, at, message);
+        return 0;
+    }
+
+    *address = (int)((word >> 2) & 0xFF);
+    return 1;
+}
+
+
+/*
+ * Returns the memory address of a direct or matrix operand; matrix
+ * elements are found from the row and column registers at run time
+ */
+static int operand_address(Machine *machine, const SimOperand *operand) {
+    int address;
+
+    if (operand->mode != 2) {
+        return operand->address;
+    }
+    address = operand->address + machine->registers[operand->row_reg] * operand->columns +
+              machine->registers[operand->col_reg];
+    if (address < 0 || address >= SIM_MEMORY_SIZE) {
+        simulator_error(machine, machine->pc, "Matrix index out of range");
+        return operand->address;
+    }
+    return address;
+}
+
+
+static int read_operand(Machine *machine, const SimOperand *operand) {
+    switch (operand->mode) {
+        case 0:
+            return operand->value;
+        case 3:
+            return machine->registers[operand->reg];
+        default:
+            return to_signed(machine->memory[operand_address(machine, operand)], 10);
+    }
+}
+
+
+static void write_operand(Machine *machine, const SimOperand *operand, int value) {
+    int address;
+
+    if (machine->faulted) {
+        return;
+    }
+    if (operand->mode == 3) {
+        machine->registers[operand->reg] = to_signed((unsigned int)value, 10);
+    } else if (operand->mode == 1 || operand->mode == 2) {
+        address = operand_address(machine, operand);
+        if (machine->faulted) {
+            return;
+        }
+        machine->memory[address] = (unsigned int)value & 0x3FF;
+        if (address >= machine->code_start && address < machine->code_end) {
+            invalidate_code(machine, address);
+        }
+    }
+}
+
+
+/* Jump destination: the operand's address, or the value of a register */
+static int jump_target(Machine *machine, const SimOperand *operand) {
+    if (operand->mode == 3) {
+        return machine->registers[operand->reg];
+    }
+    return operand_address(machine, operand);
+}
+
+
+/*
+ * Instruction handlers. Each runs one predecoded instruction and sets the
+ * next PC; execute_cmp_bne runs a cmp and the bne after it
+ */
+static void execute_mov(Machine *machine, const DecodedInstruction *decoded) {
+    write_operand(machine, &decoded->dest, read_operand(machine, &decoded->src));
+    machine->pc = decoded->next_pc;
+}
+
+
+static void execute_cmp(Machine *machine, const DecodedInstruction *decoded) {
+    int difference = read_operand(machine, &decoded->src) - read_operand(machine, &decoded->dest);
+
+    machine->zero_flag = (to_signed((unsigned int)difference, 10) == 0);
+    machine->pc = decoded->next_pc;
+}
+
+
+static void execute_add(Machine *machine, const DecodedInstruction *decoded) {
+    write_operand(machine, &decoded->dest, read_operand(machine, &decoded->dest) + read_operand(machine, &decoded->src));
+    machine->pc = decoded->next_pc;
+}
+
+
+static void execute_sub(Machine *machine, const DecodedInstruction *decoded) {
+    write_operand(machine, &decoded->dest, read_operand(machine, &decoded->dest) - read_operand(machine, &decoded->src));
+    machine->pc = decoded->next_pc;
+}
+
+
+static void execute_not(Machine *machine, const DecodedInstruction *decoded) {
+    write_operand(machine, &decoded->dest, ~read_operand(machine, &decoded->dest));
+    machine->pc = decoded->next_pc;
+}
+
+
+static void execute_clr(Machine *machine, const DecodedInstruction *decoded) {
+    write_operand(machine, &decoded->dest, 0);
+    machine->pc = decoded->next_pc;
+}
+
+
+static void execute_lea(Machine *machine, const DecodedInstruction *decoded) {
+    write_operand(machine, &decoded->dest, operand_address(machine, &decoded->src));
+    machine->pc = decoded->next_pc;
+}
+
+
+static void execute_inc(Machine *machine, const DecodedInstruction *decoded) {
+    write_operand(machine, &decoded->dest, read_operand(machine, &decoded->dest) + 1);
+    machine->pc = decoded->next_pc;
+}
+
+
+static void execute_dec(Machine *machine, const DecodedInstruction *decoded) {
+    write_operand(machine, &decoded->dest, read_operand(machine, &decoded->dest) - 1);
+    machine->pc = decoded->next_pc;
+}
+
+
+static void execute_jmp(Machine *machine, const DecodedInstruction *decoded) {
+    machine->pc = jump_target(machine, &decoded->dest);
+}
+
+
+static void execute_bne(Machine *machine, const DecodedInstruction *decoded) {
+    machine->pc = machine->zero_flag ? decoded->next_pc : jump_target(machine, &decoded->dest);
+}
+
+
+static void execute_red(Machine *machine, const DecodedInstruction *decoded) {
+    int value = getchar();
+
+    write_operand(machine, &decoded->dest, (value == EOF) ? -1 : value);
+    machine->pc = decoded->next_pc;
+}
+
+
+static void execute_prn(Machine *machine, const DecodedInstruction *decoded) {
+    printf("%d\n", read_operand(machine, &decoded->dest));
+    machine->pc = decoded->next_pc;
+}
+
+
+static void execute_jsr(Machine *machine, const DecodedInstruction *decoded) {
+    if (machine->stack_depth == SIM_STACK_SIZE) {
+        simulator_error(machine, machine->pc, "Call stack overflow");
+        return;
+    }
+    machine->stack[machine->stack_depth++] = decoded->next_pc;
+    machine->pc = jump_target(machine, &decoded->dest);
+}
+
+
+static void execute_rts(Machine *machine, const DecodedInstruction *decoded) {
+    if (machine->stack_depth == 0) {
+        simulator_error(machine, machine->pc, "rts with an empty call stack");
+        return;
+    }
+    machine->pc = machine->stack[--machine->stack_depth];
+}
+
+
+static void execute_stop(Machine *machine, const DecodedInstruction *decoded) {
+    machine->halted = 1;
+    machine->pc = decoded->next_pc;
+}
+
+
+static void execute_cmp_bne(Machine *machine, const DecodedInstruction *decoded) {
+    execute_cmp(machine, decoded);
+    if (machine->faulted) {
+        return;
+    }
+
+    machine->hits[decoded->next_pc]++;
+    machine->instruction_count++;
+    machine->opcode_counts[10]++;
+    machine->pc = machine->zero_flag ? decoded->pair_next_pc : jump_target(machine, &decoded->pair_dest);
+}
+
+
+/* Sign-extends the low @bits bits of @word */
+static int to_signed(unsigned int word, int bits) {
+    unsigned int mask = (1U << bits) - 1;
+    unsigned int sign = 1U << (bits - 1);
+
+    word &= mask;
+    return (word & sign) ? (int)word - (int)(mask + 1) : (int)word;
+}
+
+
+static void simulator_error(Machine *machine, int address, const char *message) {
+    char text[MAX_LINE_LENGTH * 2];
+    char base4_address[6];
+
+    machine->faulted = 1;
+    if (machine->quiet) {
+        return;
+    }
+    to_base4((unsigned int)address, base4_address);
+    sprintf(text, "%.*s at address %s (%d)", MAX_LINE_LENGTH, message, base4_address, address);
+    print_error(machine->object_name, 0, text);
+}
@@ -0,0 +1,106 @@
+/*
+ * simulator.h
+ * Instruction-set simulator for assembled programs
+ * Loads an object file with its entries and externals into a memory model,
+ * executes it and keeps per-address execution counts for profiling
+ */
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include "data_structures.h"
+
+#define SIM_MEMORY_SIZE 1024    /* Words addressable with a 10-bit address */
+#define SIM_REGISTERS 8         /* r0 - r7 */
+#define SIM_STACK_SIZE 256      /* Return addresses jsr can nest */
+#define SIM_DEFAULT_STEPS 1000000L  /* Instruction limit against endless loops */
+
+
+typedef struct {
+    char name[MAX_SYMBOL_NAME];
+    int address;
+    int columns;        /* Row length of a matrix label, 0 if unknown */
+} SimLabel;
+
+
+typedef struct {
+    char name[MAX_SYMBOL_NAME];
+    int address;        /* Word that refers to the external */
+} SimExternal;
+
+
+/* A decoded operand */
+typedef struct {
+    int mode;           /* Addressing mode, -1 if absent */
+    int reg;            /* Register of register mode */
+    int address;        /* Address of direct mode, base address of matrix mode */
+    int value;          /* Value of immediate mode */
+    int row_reg;        /* Matrix mode: registers holding the indices */
+    int col_reg;
+    int columns;        /* Matrix mode: row length */
+} SimOperand;
+
+
+typedef struct DecodedInstruction DecodedInstruction;
+
+
+typedef struct Machine {
+    char object_name[MAX_LINE_LENGTH];
+    unsigned int memory[SIM_MEMORY_SIZE];
+    int code_start;
+    int code_end;       /* First address after the code */
+    int data_end;       /* First address after the data */
+    int registers[SIM_REGISTERS];
+    int pc;
+    int zero_flag;      /* Set by cmp when both operands are equal */
+    int stack[SIM_STACK_SIZE];
+    int stack_depth;
+    int halted;         /* 1 after stop */
+    int faulted;        /* 1 after a runtime error */
+    int quiet;          /* Runtime errors only set faulted, nothing is reported */
+    long instruction_count;
+    long opcode_counts[16];
+    long hits[SIM_MEMORY_SIZE];     /* Times each address was executed */
+    DecodedInstruction *decoded;    /* Predecoded instruction per code address */
+    SimLabel *labels;               /* Sorted by address */
+    int label_count;
+    SimExternal *externals;
+    int external_count;
+} Machine;
+
+
+
+
+int load_program(const char *base_name, Machine *machine);
+
+
+int reset_machine(Machine *machine, const char *object_name);
+
+
+void load_source_symbols(const char *base_name, Machine *machine);
+
+
+void free_program(Machine *machine);
+
+
+int add_label(Machine *machine, const char *name, int address, int columns);
+
+
+void sort_labels(Machine *machine);
+
+
+int add_external(Machine *machine, const char *name, int address);
+
+
+const SimLabel* label_for_address(const Machine *machine, int address);
+
+
+int decode_at(Machine *machine, int pc, int *opcode, SimOperand *src, SimOperand *dest, int *length);
+
+
+int step_program(Machine *machine);
+
+
+long run_program(Machine *machine, long max_steps);
+
+#endif /* SIMULATOR_H */
@@ -0,0 +1,261 @@
+/*
+ * size_report.c
+ * Implementation of the code-size attribution report
+ * The first pass records the IC and DC at the start of every .am line and
+ * the pre-assembler records where every .am line came from, so each line's
+ * words can be charged to the closest label at or before its address and
+ * to the macro call (if any) that expanded it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "size_report.h"
+#include "first_pass.h"
+#include "pre_assembler.h"
+#include "utils.h"
+
+
+/* Words charged to one label; the first entry collects words before any label */
+typedef struct {
+    const char *name;
+    int address;
+    int code_words;
+    int data_words;
+} LabelSize;
+
+
+/* Words produced by one macro call */
+typedef struct {
+    const char *macro;
+    int call_line;      /* Line of the call in the .as file */
+    int words;
+} CallSiteSize;
+
+
+static LabelSize* collect_labels(SymbolTable *symbol_table, int *count);
+static LabelSize* label_at(LabelSize *labels, int count, int address);
+static int charge_call_site(CallSiteSize **sites, int *count, const LineOrigin *origin, int words);
+static void print_label_sizes(FILE *stream, LabelSize *labels, int count);
+static void print_macro_sizes(FILE *stream, CallSiteSize *sites, int count, int total_words);
+static int compare_label_sizes(const void *a, const void *b);
+static int compare_label_addresses(const void *a, const void *b);
+static int compare_call_sites(const void *a, const void *b);
+
+
+/*
+ * Prints the size report for the file just assembled on @stream
+ * Returns: 1 on success, 0 if the per-line information is not available
+ */
+int print_size_report(FILE *stream, const char *base_name, SymbolTable *symbol_table) {
+    const int *addresses, *data_offsets;
+    const LineOrigin *origins;
+    LabelSize *labels;
+    CallSiteSize *sites = NULL;
+    int line_count, origin_count, label_count, site_count = 0;
+    int code_words, data_words, code_end;
+    int i;
+
+    addresses = get_line_addresses(&line_count);
+    data_offsets = get_line_data_offsets(&line_count);
+    origins = get_line_origins(&origin_count);
+    labels = collect_labels(symbol_table, &label_count);
+    if (addresses == NULL || data_offsets == NULL || labels == NULL) {
+        free(labels);
+        fprintf(stream, "Size report for %s is not available.\n", base_name);
+        return 0;
+    }
+    if (origin_count != line_count) {
+        origins = NULL;
+    }
+
+    /* Data words are placed after the code, as update_data_symbols does for their labels */
+    code_end = addresses[line_count];
+    for (i = 0; i < line_count; i++) {
+        code_words = addresses[i + 1] - addresses[i];
+        data_words = data_offsets[i + 1] - data_offsets[i];
+        if (code_words > 0) {
+            label_at(labels, label_count, addresses[i])->code_words += code_words;
+        }
+        if (data_words > 0) {
+            label_at(labels, label_count, code_end + data_offsets[i])->data_words += data_words;
+        }
+        if (origins != NULL && origins[i].macro[0] != '\0' && code_words + data_words > 0) {
+            charge_call_site(&sites, &site_count, &origins[i], code_words + data_words);
+        }
+    }
+
+    code_words = code_end - IC_INITIAL_VALUE;
+    data_words = data_offsets[line_count];
+    fprintf(stream, "Size report for %s:\n", base_name);
+    fprintf(stream, "  Code: %d word(s)  Data: %d word(s)  Total: %d of %d word(s)\n",
+           code_words, data_words, code_words + data_words, MEMORY_SIZE);
+    print_label_sizes(stream, labels, label_count);
+    if (origins != NULL) {
+        print_macro_sizes(stream, sites, site_count, code_words + data_words);
+    }
+
+    free(labels);
+    free(sites);
+    return 1;
+}
+
+
+/*
+ * Lists the file's own labels by address, after an entry for the words
+ * that come before the first label
+ * Returns: the list, or NULL on allocation failure
+ */
+static LabelSize* collect_labels(SymbolTable *symbol_table, int *count) {
+    LabelSize *labels;
+    SymbolNode *current;
+    int capacity = 1;
+
+    for (current = symbol_table->head; current != NULL; current = current->next) {
+        capacity++;
+    }
+    labels = (LabelSize *)calloc(capacity, sizeof(LabelSize));
+    if (labels == NULL) {
+        return NULL;
+    }
+
+    labels[0].name = "(before any label)";
+    labels[0].address = -1;
+    *count = 1;
+    for (current = symbol_table->head; current != NULL; current = current->next) {
+        if (current->attribute != EXTERNAL_SYMBOL) {
+            labels[*count].name = current->name;
+            labels[*count].address = current->address;
+            (*count)++;
+        }
+    }
+    qsort(labels + 1, *count - 1, sizeof(LabelSize), compare_label_addresses);
+    return labels;
+}
+
+
+/* Returns the closest label at or before @address (binary search) */
+static LabelSize* label_at(LabelSize *labels, int count, int address) {
+    int low = 1, high = count - 1, middle;
+    LabelSize *found = &labels[0];
+
+    while (low <= high) {
+        middle = (low + high) / 2;
+        if (labels[middle].address <= address) {
+            found = &labels[middle];
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return found;
+}
+
+
+/*
+ * Adds @words to the call site of @origin, creating it on first use
+ * Returns: 1 on success, 0 on allocation failure
+ */
+static int charge_call_site(CallSiteSize **sites, int *count, const LineOrigin *origin, int words) {
+    CallSiteSize *grown;
+    int i;
+
+    for (i = *count - 1; i >= 0; i--) {
+        if ((*sites)[i].call_line == origin->source_line && strcmp((*sites)[i].macro, origin->macro) == 0) {
+            (*sites)[i].words += words;
+            return 1;
+        }
+    }
+
+    grown = (CallSiteSize *)realloc(*sites, (*count + 1) * sizeof(CallSiteSize));
+    if (grown == NULL) {
+        return 0;
+    }
+    *sites = grown;
+    (*sites)[*count].macro = origin->macro;
+    (*sites)[*count].call_line = origin->source_line;
+    (*sites)[*count].words = words;
+    (*count)++;
+    return 1;
+}
+
+
+/* Prints the labels that own any words, largest first */
+static void print_label_sizes(FILE *stream, LabelSize *labels, int count) {
+    int i;
+
+    qsort(labels, count, sizeof(LabelSize), compare_label_sizes);
+
+    fprintf(stream, "  By label (largest first):\n");
+    fprintf(stream, "    %-30s %5s %5s %5s\n", "Label", "Code", "Data", "Total");
+    for (i = 0; i < count && labels[i].code_words + labels[i].data_words > 0; i++) {
+        fprintf(stream, "    %-30s %5d %5d %5d\n", labels[i].name, labels[i].code_words, labels[i].data_words,
+               labels[i].code_words + labels[i].data_words);
+    }
+}
+
+
+/* Prints each macro's total, in name order, followed by its call sites */
+static void print_macro_sizes(FILE *stream, CallSiteSize *sites, int count, int total_words) {
+    int macro_words, calls, first, i;
+    int expanded = 0;
+
+    qsort(sites, count, sizeof(CallSiteSize), compare_call_sites);
+
+    fprintf(stream, "  By macro:\n");
+    for (first = 0; first < count; first = i) {
+        macro_words = 0;
+        for (i = first; i < count && strcmp(sites[i].macro, sites[first].macro) == 0; i++) {
+            macro_words += sites[i].words;
+        }
+        calls = i - first;
+        expanded += macro_words;
+
+        fprintf(stream, "    %-30s %5d word(s) in %d call(s)\n", sites[first].macro, macro_words, calls);
+        for (i = first; i < first + calls; i++) {
+            fprintf(stream, "      called at line %-5d %5d word(s)\n", sites[i].call_line, sites[i].words);
+        }
+    }
+    fprintf(stream, "    %-30s %5d word(s)\n", "(outside macros)", total_words - expanded);
+}
+
+
+/* Orders labels by descending size, then by address */
+static int compare_label_sizes(const void *a, const void *b) {
+    const LabelSize *first = (const LabelSize *)a;
+    const LabelSize *second = (const LabelSize *)b;
+    int first_size = first->code_words + first->data_words;
+    int second_size = second->code_words + second->data_words;
+
+    if (first_size != second_size) {
+        return (first_size > second_size) ? -1 : 1;
+    }
+    return (first->address < second->address) ? -1 : (first->address > second->address);
+}
+
+
+static int compare_label_addresses(const void *a, const void *b) {
+    const LabelSize *first = (const LabelSize *)a;
+    const LabelSize *second = (const LabelSize *)b;
+
+    if (first->address != second->address) {
+        return (first->address < second->address) ? -1 : 1;
+    }
+    return strcmp(first->name, second->name);
+}
+
+
+/*
+ * Orders call sites so that each macro's sites are together, macros by
+ * name and sites by line; print_macro_sizes relies on the grouping
+ */
+static int compare_call_sites(const void *a, const void *b) {
+    const CallSiteSize *first = (const CallSiteSize *)a;
+    const CallSiteSize *second = (const CallSiteSize *)b;
+    int order = strcmp(first->macro, second->macro);
+
+    if (order != 0) {
+        return order;
+    }
+    return first->call_line - second->call_line;
+}
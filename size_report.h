@@ -0,0 +1,17 @@
+/*
+ * size_report.h
+ * Code-size attribution report
+ * Charges every instruction and data word of an assembled file to the
+ * label it falls under and to the macro call that produced it
+ */
+
+#ifndef SIZE_REPORT_H
+#define SIZE_REPORT_H
+
+#include <stdio.h>
+#include "data_structures.h"
+
+
+int print_size_report(FILE *stream, const char *base_name, SymbolTable *symbol_table);
+
+#endif /* SIZE_REPORT_H */
@@ -0,0 +1,241 @@
+/*
+ * source.c
+ * Implementation of in-memory source files
+ * Reading the whole file up front lets a pass hand out line ranges
+ * instead of reading line by line with fgets
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "source.h"
+#include "data_structures.h"
+#include "utils.h"
+
+
+/* An intermediate file kept in memory; the buffer is owned by its memory stream */
+typedef struct MemoryFile {
+    char name[MAX_LINE_LENGTH];
+    char *text;
+    size_t size;
+    struct MemoryFile *next;
+} MemoryFile;
+
+
+static MemoryFile* find_memory_file(const char *filename);
+static int split_lines(SourceFile *source, size_t size);
+
+
+static int memory_mode = SOURCES_ON_DISK;
+static MemoryFile *memory_files = NULL;
+
+
+/*
+ * Keeps the files made by create_source_file in memory (SOURCES_IN_MEMORY,
+ * or SOURCES_DEFERRED when the caller writes them out later), or goes back
+ * to real files and drops every memory file (SOURCES_ON_DISK)
+ */
+void keep_sources_in_memory(int mode) {
+    MemoryFile *next;
+
+    while (mode == SOURCES_ON_DISK && memory_files != NULL) {
+        next = memory_files->next;
+        free(memory_files->text);
+        free(memory_files);
+        memory_files = next;
+    }
+    memory_mode = mode;
+}
+
+
+/*
+ * Opens an intermediate file (such as the .am) for writing, in memory when
+ * keep_sources_in_memory is on; close it with fclose
+ * Returns: the stream, or NULL on failure
+ */
+FILE* create_source_file(const char *filename) {
+    MemoryFile *file;
+
+    if (memory_mode == SOURCES_ON_DISK) {
+        return fopen(filename, "w");
+    }
+
+    file = find_memory_file(filename);
+    if (file == NULL) {
+        file = (MemoryFile *)calloc(1, sizeof(MemoryFile));
+        if (file == NULL || strlen(filename) >= MAX_LINE_LENGTH) {
+            free(file);
+            return NULL;
+        }
+        strcpy(file->name, filename);
+        file->next = memory_files;
+        memory_files = file;
+    }
+    free(file->text);
+    file->text = NULL;
+    file->size = 0;
+    return open_memstream(&file->text, &file->size);
+}
+
+
+/*
+ * Deletes an intermediate file made by create_source_file; a deferred one
+ * is also removed from the disk, where an older copy may still be
+ */
+void remove_source_file(const char *filename) {
+    MemoryFile **link, *file;
+
+    if (memory_mode != SOURCES_IN_MEMORY) {
+        remove(filename);
+    }
+    if (memory_mode == SOURCES_ON_DISK) {
+        return;
+    }
+    for (link = &memory_files; *link != NULL; link = &(*link)->next) {
+        if (strcmp((*link)->name, filename) == 0) {
+            file = *link;
+            *link = file->next;
+            free(file->text);
+            free(file);
+            return;
+        }
+    }
+}
+
+
+/*
+ * Detaches the text of an in-memory file from the store
+ * Returns: the text (the caller frees it), or NULL if there is no such file
+ */
+char* take_source_file(const char *filename, size_t *size) {
+    MemoryFile **link, *file;
+    char *text;
+
+    for (link = &memory_files; *link != NULL; link = &(*link)->next) {
+        if (strcmp((*link)->name, filename) == 0) {
+            file = *link;
+            *link = file->next;
+            text = file->text;
+            *size = file->size;
+            free(file);
+            return text;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Reads @filename and splits it into lines
+ * Returns: 1 on success, 0 if the file cannot be read
+ */
+int load_source_file(const char *filename, SourceFile *source) {
+    MemoryFile *file;
+    size_t size;
+
+    source->text = NULL;
+    source->lines = NULL;
+    source->line_count = 0;
+
+    file = (memory_mode != SOURCES_ON_DISK) ? find_memory_file(filename) : NULL;
+    if (file != NULL) {
+        source->text = (char *)malloc(file->size + 1);
+        if (source->text == NULL) {
+            return 0;
+        }
+        memcpy(source->text, file->text, file->size);
+        source->text[file->size] = '\0';
+        return split_lines(source, file->size);
+    }
+
+    source->text = read_whole_file(filename, &size);
+    if (source->text == NULL) {
+        return 0;
+    }
+    return split_lines(source, size);
+}
+
+
+/*
+ * Splits the @size bytes of source->text into lines
+ * Returns: 1 on success, 0 on allocation failure
+ */
+static int split_lines(SourceFile *source, size_t size) {
+    size_t i;
+    int line;
+
+    /* Count lines; a final line without a newline still counts */
+    for (i = 0; i < size; i++) {
+        if (source->text[i] == '\n') {
+            source->line_count++;
+        }
+    }
+    if (size > 0 && source->text[size - 1] != '\n') {
+        source->line_count++;
+    }
+
+    source->lines = (char **)malloc((source->line_count + 1) * sizeof(char *));
+    if (source->lines == NULL) {
+        free_source_file(source);
+        return 0;
+    }
+
+    line = 0;
+    if (size > 0) {
+        source->lines[line++] = source->text;
+    }
+    for (i = 0; i < size; i++) {
+        if (source->text[i] == '\n') {
+            source->text[i] = '\0';
+            if (i + 1 < size) {
+                source->lines[line++] = source->text + i + 1;
+            }
+        }
+    }
+
+    return 1;
+}
+
+
+static MemoryFile* find_memory_file(const char *filename) {
+    MemoryFile *file;
+
+    for (file = memory_files; file != NULL; file = file->next) {
+        if (strcmp(file->name, filename) == 0) {
+            return file;
+        }
+    }
+    return NULL;
+}
+
+
+void free_source_file(SourceFile *source) {
+    free(source->text);
+    free(source->lines);
+    source->text = NULL;
+    source->lines = NULL;
+    source->line_count = 0;
+}
+
+
+/*
+ * Checks whether a line exceeds the input line limit
+ * A line must fit in a MAX_LINE_LENGTH buffer together with its newline
+ */
+int is_line_too_long(const char *line) {
+    return (strlen(line) >= MAX_LINE_LENGTH - 1);
+}
+
+
+/*
+ * Moves a chunk boundary forward past lines that continue a value list,
+ * so that every chunk starts at a complete statement
+ */
+int chunk_boundary(const SourceFile *source, int line) {
+    while (line > 0 && line < source->line_count && ends_with_comma(source->lines[line - 1])) {
+        line++;
+    }
+    return line;
+}
@@ -0,0 +1,50 @@
+/*
+ * source.h
+ * In-memory source files for the assembler passes
+ * Loads a whole file at once and splits it into lines
+ */
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdio.h>
+#include "data_structures.h"
+
+#define SOURCES_ON_DISK 0       /* Intermediate files are real files */
+#define SOURCES_IN_MEMORY 1     /* Intermediate files never touch the disk */
+#define SOURCES_DEFERRED 2      /* Kept in memory; the caller writes them out later */
+
+
+typedef struct {
+    char *text;         /* File contents; every line is NUL-terminated in place */
+    char **lines;       /* Start of each line, without the newline */
+    int line_count;
+} SourceFile;
+
+
+
+
+void keep_sources_in_memory(int mode);
+
+
+FILE* create_source_file(const char *filename);
+
+
+void remove_source_file(const char *filename);
+
+
+char* take_source_file(const char *filename, size_t *size);
+
+
+int load_source_file(const char *filename, SourceFile *source);
+
+
+void free_source_file(SourceFile *source);
+
+
+int is_line_too_long(const char *line);
+
+
+int chunk_boundary(const SourceFile *source, int line);
+
+#endif /* SOURCE_H */
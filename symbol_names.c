@@ -0,0 +1,116 @@
+/*
+ * symbol_names.c
+ * Implementation of the symbol name interner
+ * Names are chained into buckets picked by a djb2 hash and numbered in
+ * order of first appearance. Every stage lexes lines, and the parallel
+ * passes do so from several threads, so lookups share a read lock and only
+ * a new name takes the write lock.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "symbol_names.h"
+#include "region.h"
+#include "utils.h"
+
+
+typedef struct InternedName {
+    char *text;                 /* Stored right after the node itself */
+    int id;
+    struct InternedName *next;
+} InternedName;
+
+
+static const InternedName* find_entry(const char *name, unsigned long slot);
+
+
+static InternedName *buckets[SYMBOL_NAME_BUCKETS];
+static InternedName **names = NULL;     /* Indexed by id */
+static int name_count = 0;
+static int name_capacity = 0;
+static pthread_rwlock_t names_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+
+/*
+ * Returns the id of @name, giving it the next free id if it is new
+ * Returns: the id, or NO_NAME_ID on allocation failure
+ */
+int intern_name(const char *name) {
+    unsigned long slot = string_hash(name) & (SYMBOL_NAME_BUCKETS - 1);
+    const InternedName *found;
+    InternedName *entry, **grown;
+    size_t length = strlen(name);
+    int id = NO_NAME_ID;
+
+    pthread_rwlock_rdlock(&names_lock);
+    found = find_entry(name, slot);
+    pthread_rwlock_unlock(&names_lock);
+    if (found != NULL) {
+        return found->id;
+    }
+
+    /* Look again under the write lock: another thread may have added it */
+    pthread_rwlock_wrlock(&names_lock);
+    found = find_entry(name, slot);
+    if (found != NULL) {
+        id = found->id;
+    } else {
+        if (name_count == name_capacity) {
+            grown = (InternedName **)realloc(names, (name_capacity ? name_capacity * 2 : 64) * sizeof(InternedName *));
+            if (grown == NULL) {
+                pthread_rwlock_unlock(&names_lock);
+                return NO_NAME_ID;
+            }
+            names = grown;
+            name_capacity = name_capacity ? name_capacity * 2 : 64;
+        }
+        entry = (InternedName *)region_alloc(sizeof(InternedName) + length + 1);
+        if (entry != NULL) {
+            entry->text = (char *)(entry + 1);
+            memcpy(entry->text, name, length + 1);
+            entry->id = name_count;
+            entry->next = buckets[slot];
+            buckets[slot] = entry;
+            names[name_count++] = entry;
+            id = entry->id;
+        }
+    }
+    pthread_rwlock_unlock(&names_lock);
+    return id;
+}
+
+
+/* Returns the text of name @id; it stays valid until the file region is reset */
+const char* name_text(int id) {
+    const char *text;
+
+    pthread_rwlock_rdlock(&names_lock);
+    text = names[id]->text;
+    pthread_rwlock_unlock(&names_lock);
+    return text;
+}
+
+
+/* Forgets every name, before the next file is assembled; the texts go with the file region */
+void clear_symbol_names(void) {
+    free(names);
+    names = NULL;
+    name_count = 0;
+    name_capacity = 0;
+    memset(buckets, 0, sizeof(buckets));
+}
+
+
+static const InternedName* find_entry(const char *name, unsigned long slot) {
+    const InternedName *entry;
+
+    for (entry = buckets[slot]; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->text, name) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,25 @@
+/*
+ * symbol_names.h
+ * Per-file interner for label and symbol names
+ * Every distinct name of the file being assembled gets a small integer id
+ * the first time the lexer sees it, so the symbol table is indexed by id
+ * and the passes never compare strings. The text is kept only for the output
+ * files and messages.
+ */
+
+#ifndef SYMBOL_NAMES_H
+#define SYMBOL_NAMES_H
+
+#define SYMBOL_NAME_BUCKETS 1024   /* Hash buckets; a power of two */
+#define NO_NAME_ID -1              /* Id of a name that was never interned */
+
+
+int intern_name(const char *name);
+
+
+const char* name_text(int id);
+
+
+void clear_symbol_names(void);
+
+#endif /* SYMBOL_NAMES_H */
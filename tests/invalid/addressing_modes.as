@@ -0,0 +1,17 @@
+; Operand forms the opcode table rejects, next to the two forms of lea it
+; accepts; each bad line is reported once
+MAIN:   lea STR, r1
+        lea MAT[r1][r2], r3
+        lea #1, r2
+        lea r1, r2
+        lea STR, #3
+        lea STR
+        mov r1, #5
+        clr #1
+        jmp #3
+        red #5
+        not STR, r1
+        rts r1
+        stop
+STR:    .string "ab"
+MAT:    .mat [1][1] 7
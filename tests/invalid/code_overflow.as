@@ -0,0 +1,135 @@
+; More code than instruction memory holds: 130 two-word instructions
+; need 260 words, and the error names the first line past the end
+MAIN:   inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        inc COUNT
+        stop
+
+COUNT:  .data 0
@@ -0,0 +1,8 @@
+; .fill and .mat fill= with bad counts and values, and a block too large
+; for the data image
+MAIN:   stop
+A:      .fill 3, 600
+B:      .fill -2, 0
+C:      .fill 4, x
+D:      .mat [2][2] fill=1, 2
+E:      .fill 300, 0
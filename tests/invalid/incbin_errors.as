@@ -0,0 +1,5 @@
+; .incbin of a missing file, a bad operand list and a range past the end
+MAIN:   stop
+A:      .incbin "missing.bin"
+B:      .incbin incbin_errors.bin
+C:      .incbin "incbin_errors.bin", 4, 5
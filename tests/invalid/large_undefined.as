@@ -0,0 +1,272 @@
+; The large sample with undefined symbols in every chunk: the first pass
+; accepts it and the parallel second pass reports each of them in order.
+;
+
+.extern EXT1
+.extern EXT2
+.entry MAIN
+.entry LOOP
+.entry TABLE
+.entry UNKNOWN
+
+mcro save
+mov r1, r6
+mov r2, r7
+mcroend
+
+MAIN: mov #1, r1
+      jmp FAR
+
+; block 0
+mov TABLE, r7
+; block 1
+; block 2
+L0: dec r6
+; block 3
+; block 4
+; block 5
+
+
+
+; block 9
+        jmp MISSING1
+bne L1
+; block 10
+prn GRID[r1][r2]
+sub r5, r1
+not r2
+
+; block 12
+rts
+
+red r4
+L2: red r1
+L3: jsr EXT2
+inc r5
+; block 14
+L4: stop
+L5: mov EXT2, r3
+; block 15
+
+; block 17
+prn GRID[r1][r2]
+L6: clr r4
+; block 18
+; block 19
+; block 20
+
+save
+dec r0
+; block 22
+; block 23
+
+rts
+
+L7: red r0
+; block 26
+; block 27
+
+mov TABLE, r7
+
+; block 30
+L8: prn GRID[r1][r2]
+save
+
+; block 32
+L9: prn r3
+
+L10: clr r4
+; block 34
+L11: prn GRID[r1][r2]
+L12: sub r5, r4
+; block 35
+L13: add r2, r0
+
+; block 37
+
+
+mov EXT2, r0
+save
+bne L8
+; block 40
+        prn MISSING2
+not r3
+jsr EXT2
+
+; block 42
+clr r6
+; block 43
+
+mov TABLE, r7
+L14: mov EXT2, r2
+L15: mov EXT2, r4
+; block 45
+; block 46
+mov EXT2, r1
+
+bne L14
+L16: prn GRID[r1][r2]
+
+L17: dec r3
+add r7, r1
+save
+mov EXT2, r3
+L18: add r5, r2
+not r2
+
+
+
+not r3
+save
+; block 52
+; block 53
+; block 54
+
+not r0
+; block 56
+
+
+stop
+not r0
+
+sub r4, r1
+L19: jmp L23
+jsr EXT1
+; block 60
+L20: jsr EXT1
+; block 61
+; block 62
+; block 63
+; block 64
+; block 65
+
+inc r1
+
+
+clr r0
+mov EXT2, r0
+; block 69
+
+; block 71
+L21: jsr EXT1
+        mov MISSING3, r1
+L22: clr r3
+
+L23: rts
+jmp L32
+; block 73
+; block 74
+save
+
+L24: jmp L28
+
+
+
+L25: inc r4
+; block 79
+L26: stop
+
+clr r1
+
+
+L27: jsr EXT2
+clr r1
+inc r1
+jsr EXT2
+; block 83
+red r4
+
+add r1, r5
+
+L28: jmp L31
+
+add r0, r2
+clr r4
+clr r0
+
+; block 88
+
+; block 90
+
+
+
+jmp FAR
+
+cmp COUNT, #-5
+; block 95
+; block 96
+L29: dec r7
+dec r7
+; block 97
+
+; block 99
+
+
+mov EXT2, r7
+clr r7
+bne L26
+; block 102
+
+
+
+        cmp MISSING4, #1
+rts
+; block 106
+
+
+
+
+
+; block 112
+; block 113
+jsr EXT1
+
+
+; block 116
+
+mov TABLE, r0
+; block 118
+prn r2
+bne L27
+
+
+
+; block 122
+
+stop
+; block 124
+L31: cmp COUNT, #1
+; block 125
+prn GRID[r1][r2]
+add r0, r4
+; block 126
+; block 127
+; block 128
+sub r4, r3
+save
+; block 129
+; block 130
+
+
+
+; block 134
+; block 135
+stop
+
+; block 137
+        prn MISSING5[r1][r2]
+; block 139
+L32: rts
+; block 140
+; block 141
+; block 142
+; block 143
+
+LOOP: dec COUNT
+      bne LOOP
+FAR:  stop
+
+COUNT: .data 5
+TABLE: .data 10, -10
+GRID: .mat [1][1] 7
+NAME: .string "large"
@@ -0,0 +1,8 @@
+; Bad lines; --max-errors 2 stops the first pass after its second error
+mov r0, r9
+add #600, r0
+bogus r1
+jmp
+prn #1000
+lea #1, r2
+stop
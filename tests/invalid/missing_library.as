@@ -0,0 +1,2 @@
+; --macro-lib names a library that does not exist
+MAIN:   stop
@@ -0,0 +1,11 @@
+; A macro that ends up calling itself
+mcro ping
+pong
+mcroend
+
+mcro pong
+ping
+mcroend
+
+MAIN:   stop
+ping
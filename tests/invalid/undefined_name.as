@@ -0,0 +1,5 @@
+; Uses STR and END, which only test1.as defines: assembled after test1 in
+; one batch, they must still be undefined
+MAIN:   lea STR, r1
+        jmp END
+        stop
@@ -0,0 +1,403 @@
+#!/bin/sh
+#
+# run_tests.sh
+# Assembles the samples under tests/valid and tests/invalid and compares the
+# results with the files in their expected/ directories, then checks the
+# other tools and modes against those results.
+#
+# Usage: tests/run_tests.sh    (after make; exit status 0 = every check passed)
+#
+# A sample NAME.as is assembled in a copy of its directory, with the options
+# in NAME.args when that file exists. expected/NAME.ob, NAME.ent and NAME.ext
+# are its output files and expected/NAME.err its error messages; an output
+# without an expected file must be absent or empty, and the sample must be
+# rejected exactly when it has expected errors. expected/NAME.out, when
+# present, is compared with the standard output.
+#
+
+TOP=$(cd "$(dirname "$0")/.." && pwd)
+TESTS=$TOP/tests
+ASSEMBLER=$TOP/assembler
+ARCHIVER=$TOP/archiver
+SIM=$TOP/sim
+TRANSLATE=$TOP/translate
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+checks=0
+failures=0
+
+
+fail() {
+    echo "FAIL: $*"
+    failures=$((failures + 1))
+}
+
+
+# Compares the file $2 (shown as $3) with the expected file $1
+expect_file() {
+    checks=$((checks + 1))
+    if [ -f "$1" ]; then
+        cmp -s "$1" "$2" || fail "$3 differs from the expected file"
+    elif [ -s "$2" ]; then
+        fail "$3 was written but is not expected"
+    fi
+}
+
+
+# Checks that the file $1 (shown as $2) is absent or empty
+expect_absent() {
+    checks=$((checks + 1))
+    if [ -s "$1" ]; then
+        fail "$2 was written but is not expected"
+    fi
+}
+
+
+# Assembles every sample of tests/$1 in the directory $2, adding the options $3...
+assemble_samples() {
+    kind=$1
+    out=$2
+    shift 2
+    mkdir -p "$out"
+    for file in "$TESTS/$kind"/*; do
+        if [ -f "$file" ]; then
+            cp "$file" "$out"
+        fi
+    done
+    for source in "$TESTS/$kind"/*.as; do
+        name=$(basename "$source" .as)
+        options=
+        if [ -f "$TESTS/$kind/$name.args" ]; then
+            options=$(cat "$TESTS/$kind/$name.args")
+        fi
+        (cd "$out" && "$ASSEMBLER" $options "$@" "$name" > "$name.out" 2> "$name.err"; echo $? > "$name.status")
+    done
+}
+
+
+# Checks the results in $2 of the samples of tests/$1 against their expected files
+check_samples() {
+    kind=$1
+    out=$2
+    for source in "$TESTS/$kind"/*.as; do
+        name=$(basename "$source" .as)
+        status=$(cat "$out/$name.status")
+        checks=$((checks + 1))
+        if [ -s "$TESTS/$kind/expected/$name.err" ]; then
+            [ "$status" -ne 0 ] || fail "$kind/$name.as was accepted"
+        else
+            [ "$status" -eq 0 ] || fail "$kind/$name.as was rejected"
+        fi
+        for extension in ob ent ext err; do
+            expect_file "$TESTS/$kind/expected/$name.$extension" "$out/$name.$extension" "$kind/$name.$extension"
+        done
+        if [ -f "$TESTS/$kind/expected/$name.out" ]; then
+            expect_file "$TESTS/$kind/expected/$name.out" "$out/$name.out" "$kind/$name.out"
+        fi
+    done
+}
+
+
+# Checks that the samples of tests/$1 gave the same files, errors and status in $3 as in $2
+same_results() {
+    kind=$1
+    for source in "$TESTS/$kind"/*.as; do
+        name=$(basename "$source" .as)
+        for extension in ob ent ext err status; do
+            expect_file "$2/$name.$extension" "$3/$name.$extension" "$kind/$name.$extension ($4)"
+        done
+    done
+}
+
+
+for kind in valid invalid; do
+    assemble_samples $kind "$WORK/$kind"
+    check_samples $kind "$WORK/$kind"
+done
+
+
+# Parallel first and second pass: chunks of the large samples go to different
+# threads, and each thread count puts the chunk borders on other lines
+for threads in 2 3 4; do
+    for kind in valid invalid; do
+        assemble_samples $kind "$WORK/$kind-threads-$threads" --threads $threads
+        same_results $kind "$WORK/$kind" "$WORK/$kind-threads-$threads" "--threads $threads"
+    done
+done
+
+# Pipelined pre-assembler and first pass, alone and with the parallel second pass
+for kind in valid invalid; do
+    assemble_samples $kind "$WORK/$kind-pipeline" --pipeline
+    same_results $kind "$WORK/$kind" "$WORK/$kind-pipeline" "--pipeline"
+    assemble_samples $kind "$WORK/$kind-pipeline-threads" --pipeline --threads 4
+    same_results $kind "$WORK/$kind" "$WORK/$kind-pipeline-threads" "--pipeline --threads 4"
+done
+
+
+# .incbin finds its file next to the .as file, wherever the assembler runs
+for options in "" --pipeline; do
+    out="$WORK/elsewhere$options"
+    mkdir -p "$out"
+    (cd "$out" && "$ASSEMBLER" $options "$TESTS/valid/incbin" > /dev/null 2> incbin.err)
+    (cd "$out" && "$ASSEMBLER" $options "$TESTS/invalid/incbin_errors" > /dev/null 2> incbin_errors.err)
+    expect_file "$TESTS/valid/expected/incbin.ob" "$out/incbin.ob" "valid/incbin.ob (from another directory${options:+, $options})"
+    expect_absent "$out/incbin.err" "valid/incbin.err (from another directory${options:+, $options})"
+    expect_file "$TESTS/invalid/expected/incbin_errors.err" "$out/incbin_errors.err" "invalid/incbin_errors.err (from another directory${options:+, $options})"
+done
+
+
+# Batch: with several files, reading, assembling and writing overlap; every
+# file must come out as it does alone, and the errors in file order
+for kind in valid invalid; do
+    out=$WORK/$kind-batch
+    mkdir -p "$out"
+    for file in "$TESTS/$kind"/*; do
+        if [ -f "$file" ]; then
+            cp "$file" "$out"
+        fi
+    done
+    names=
+    for source in "$TESTS/$kind"/*.as; do
+        name=$(basename "$source" .as)
+        if [ ! -f "$TESTS/$kind/$name.args" ]; then
+            names="$names $name"
+        fi
+    done
+    (cd "$out" && "$ASSEMBLER" $names > batch.out 2> batch.err)
+    for name in $names; do
+        for extension in ob ent ext; do
+            expect_file "$WORK/$kind/$name.$extension" "$out/$name.$extension" "$kind/$name.$extension (batch)"
+        done
+        cat "$WORK/$kind/$name.err"
+    done > "$out/expected.err"
+    expect_file "$out/expected.err" "$out/batch.err" "$kind batch errors"
+done
+
+
+# Interned names: a batch drops the names of each file before the next one,
+# so a label only an earlier file defines stays undefined, and a name that
+# several files define refers to each file's own label
+out=$WORK/interner
+mkdir -p "$out"
+cp "$TESTS/valid/test1.as" "$TESTS/invalid/undefined_name.as" "$TESTS/valid/main.as" "$out"
+(cd "$out" && "$ASSEMBLER" test1 undefined_name main > /dev/null 2> undefined_name.err)
+for name in test1 main; do
+    for extension in ob ent ext; do
+        expect_file "$WORK/valid/$name.$extension" "$out/$name.$extension" "valid/$name.$extension (batch after other files)"
+    done
+done
+for extension in ob ent ext err; do
+    expect_file "$WORK/invalid/undefined_name.$extension" "$out/undefined_name.$extension" "invalid/undefined_name.$extension (batch after test1)"
+done
+
+
+# Region reuse: each file of a batch allocates its tables from the memory
+# the file before it released; the large sample after smaller files and
+# after itself must come out as it does alone, serially and with threads
+for threads in 1 4; do
+    out=$WORK/region-$threads
+    mkdir -p "$out"
+    cp "$TESTS/valid/test1.as" "$TESTS/valid/large.as" "$TESTS/valid/nested.as" "$out"
+    cp "$TESTS/valid/large.as" "$out/large2.as"
+    (cd "$out" && "$ASSEMBLER" --threads $threads test1 large nested large2 > /dev/null 2> region.err)
+    for name in test1 large nested large2; do
+        for extension in ob ent ext; do
+            expect_file "$WORK/valid/${name%2}.$extension" "$out/$name.$extension" "valid/$name.$extension (batch, --threads $threads)"
+        done
+    done
+    expect_absent "$out/region.err" "errors of the batch (--threads $threads)"
+done
+
+
+# --if-changed: assembling again leaves the unchanged outputs with their old
+# times, while an edited source gets new ones
+out=$WORK/valid-if-changed
+assemble_samples valid "$out"
+touch -t 200001010000 "$out"/*.am "$out"/*.ob "$out"/*.ent "$out"/*.ext
+touch -t 200001020000 "$WORK/stamp"
+assemble_samples valid "$out" --if-changed
+same_results valid "$WORK/valid" "$out" "--if-changed"
+for source in "$TESTS/valid"/*.as; do
+    name=$(basename "$source" .as)
+    for extension in am ob ent ext; do
+        checks=$((checks + 1))
+        if [ -f "$out/$name.$extension" ] && [ "$out/$name.$extension" -nt "$WORK/stamp" ]; then
+            fail "valid/$name.$extension was rewritten with the same contents (--if-changed)"
+        fi
+    done
+done
+echo "        prn r0" >> "$out/test2.as"
+(cd "$out" && "$ASSEMBLER" --if-changed test2 > /dev/null)
+for extension in am ob; do
+    checks=$((checks + 1))
+    if [ ! "$out/test2.$extension" -nt "$WORK/stamp" ]; then
+        fail "valid/test2.$extension was not rewritten after an edit (--if-changed)"
+    fi
+done
+
+
+# Jobserver: a pipe or fifo named in MAKEFLAGS that cannot be used is ignored,
+# and under make -j4 the threads of the large sample take make's tokens
+for jobserver in --jobserver-auth=98,99 --jobserver-auth=fifo:$WORK/no-fifo; do
+    (
+        MAKEFLAGS=" -j4 $jobserver"
+        export MAKEFLAGS
+        assemble_samples valid "$WORK/valid-jobserver" --threads 4
+    )
+    same_results valid "$WORK/valid" "$WORK/valid-jobserver" "--threads 4, $jobserver"
+    rm -rf "$WORK/valid-jobserver"
+done
+if command -v make > /dev/null 2>&1; then
+    mkdir -p "$WORK/make"
+    cp "$TESTS/valid/large.as" "$WORK/make"
+    printf 'all:\n\t+@"$(ASM)" --threads 4 large > large.out 2> large.err; echo $$? > large.status\n' > "$WORK/make/Makefile"
+    (unset MAKEFLAGS MAKELEVEL; cd "$WORK/make" && make -s -j4 ASM="$ASSEMBLER")
+    for extension in ob ent ext err status; do
+        expect_file "$WORK/valid/large.$extension" "$WORK/make/large.$extension" "valid/large.$extension (make -j4)"
+    done
+else
+    echo "make not found: skipping the make -j4 check"
+fi
+
+
+# Standard input: the object goes to standard output, --sections adds the
+# entries and externals, the errors name the file stdin and no file is
+# written. A size report would go to standard error as well, so those
+# samples are left out
+for kind in valid invalid; do
+    out=$WORK/$kind-stdin
+    mkdir -p "$out"
+    for source in "$TESTS/$kind"/*.as; do
+        name=$(basename "$source" .as)
+        expected=$TESTS/$kind/expected/$name
+        options=
+        if [ -f "$TESTS/$kind/$name.args" ]; then
+            options=$(cat "$TESTS/$kind/$name.args")
+        fi
+        case $options in
+            *--size-report*) continue ;;
+        esac
+        (
+            cd "$WORK/$kind" || exit 1
+            ls > "$out/$name.files-before"
+            "$ASSEMBLER" $options - < "$name.as" > "$out/$name.ob" 2> "$out/$name.stderr"
+            "$ASSEMBLER" $options --sections - < "$name.as" > "$out/$name.sections" 2> /dev/null
+            ls > "$out/$name.files-after"
+        )
+        sed -e "s/^Error in file stdin,/Error in file $name.as,/" \
+            -e "s/^Error in file stdin\.am,/Error in file $name.am,/" "$out/$name.stderr" > "$out/$name.err"
+        for extension in ob ent ext; do
+            if [ -s "$expected.$extension" ]; then
+                echo "[$extension]"
+                cat "$expected.$extension"
+            fi
+        done > "$out/$name.expected-sections"
+        expect_file "$expected.ob" "$out/$name.ob" "$kind/$name.ob (stdin)"
+        expect_file "$expected.err" "$out/$name.err" "$kind/$name.err (stdin)"
+        expect_file "$out/$name.expected-sections" "$out/$name.sections" "$kind/$name (stdin --sections)"
+        expect_file "$out/$name.files-before" "$out/$name.files-after" "files next to $kind/$name.as (stdin)"
+    done
+done
+
+
+# --check: the same errors and exit status, with no output file and nothing on standard output
+for kind in valid invalid; do
+    assemble_samples $kind "$WORK/$kind-check" --check
+    for source in "$TESTS/$kind"/*.as; do
+        name=$(basename "$source" .as)
+        expect_file "$WORK/$kind/$name.status" "$WORK/$kind-check/$name.status" "$kind/$name.status (--check)"
+        expect_file "$TESTS/$kind/expected/$name.err" "$WORK/$kind-check/$name.err" "$kind/$name.err (--check)"
+        for extension in am ob ent ext out; do
+            expect_absent "$WORK/$kind-check/$name.$extension" "$kind/$name.$extension (--check)"
+        done
+    done
+done
+
+
+# Archiver: an archive of two modules, its listing and symbol lookups
+(
+    cd "$WORK/valid" || exit 1
+    "$ARCHIVER" -c lib.arc main module
+    "$ARCHIVER" -t lib.arc
+    for symbol in MAIN PRINT BUFFER NOPE; do
+        "$ARCHIVER" -l lib.arc $symbol
+        echo "exit $?"
+    done
+) > "$WORK/archive.out" 2>&1
+expect_file "$TESTS/valid/expected/archive.out" "$WORK/archive.out" "archiver -c/-t/-l"
+
+# Two members defining the same entry symbol are refused and no archive is left
+(
+    cd "$WORK/valid" || exit 1
+    "$ARCHIVER" -c duplicate.arc main main
+    echo "exit $?"
+    ls duplicate.arc 2> /dev/null
+) > "$WORK/archive.err" 2>&1
+expect_file "$TESTS/invalid/expected/archive.err" "$WORK/archive.err" "archiver duplicate symbols"
+
+
+# Simulator: program output, instruction counts and profile, then a step limit;
+# the throughput line depends on the machine
+(
+    cd "$WORK/valid" || exit 1
+    printf 'AB' | "$SIM" --profile countdown
+    echo "exit $?"
+    printf 'AB' | "$SIM" --steps 5 countdown
+    echo "exit $?"
+) 2>&1 | grep -v '^Throughput:' > "$WORK/countdown.sim"
+expect_file "$TESTS/valid/expected/countdown.sim" "$WORK/countdown.sim" "sim countdown"
+
+# A program that stores over one of its own instructions must run the new
+# one, and a cmp and bne run as one step must branch as the two would, also
+# when a jump lands on the bne
+for name in selfmod branches; do
+    (cd "$WORK/valid" && "$SIM" $name) 2>&1 | grep -v '^Throughput:' > "$WORK/$name.sim"
+    expect_file "$TESTS/valid/expected/$name.sim" "$WORK/$name.sim" "sim $name"
+done
+
+# Translator: the native build of countdown prints what it prints under sim
+(
+    cd "$WORK/valid" || exit 1
+    "$TRANSLATE" countdown > /dev/null || exit 1
+    printf 'AB' | ./countdown_native
+    echo "exit $?"
+    printf 'AB' | ./countdown_native --steps 5
+    echo "exit $?"
+) > "$WORK/countdown.native" 2>&1
+expect_file "$TESTS/valid/expected/countdown.native" "$WORK/countdown.native" "translate countdown"
+
+# The store into the code and the branches run natively as they do under sim
+for name in selfmod branches; do
+    (
+        cd "$WORK/valid" || exit 1
+        "$TRANSLATE" $name > /dev/null || exit 1
+        ./${name}_native
+    ) > "$WORK/$name.native" 2>&1
+    sed '/^$/,$d' "$TESTS/valid/expected/$name.sim" > "$WORK/$name.sim-output"
+    expect_file "$WORK/$name.sim-output" "$WORK/$name.native" "translate $name"
+done
+
+# Names reach the compiler as arguments: a directory whose name has quotes,
+# $(...) and backquotes builds like any other, and the shell runs none of it
+odd="$WORK/odd \"dir\" \$(touch ran) \`touch ran\`"
+mkdir -p "$odd"
+cp "$WORK/valid/countdown.ob" "$WORK/valid/countdown.ent" "$WORK/valid/countdown.am" "$odd"
+(
+    cd "$WORK" || exit 1
+    "$TRANSLATE" "$odd/countdown" > /dev/null || exit 1
+    printf 'AB' | "$odd/countdown_native"
+    echo "exit $?"
+    printf 'AB' | "$odd/countdown_native" --steps 5
+    echo "exit $?"
+) > "$WORK/odd.native" 2>&1
+expect_file "$TESTS/valid/expected/countdown.native" "$WORK/odd.native" "translate in a directory with shell characters"
+checks=$((checks + 1))
+if [ -e "$WORK/ran" ]; then
+    fail "translate let the shell run part of a file name"
+fi
+
+
+echo "$checks checks, $failures failed"
+[ "$failures" -eq 0 ]
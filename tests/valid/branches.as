@@ -0,0 +1,17 @@
+; A cmp followed by a bne runs as one step. The loop takes its bne twice
+; and then falls through. CHECK follows a cmp too, but it is also reached
+; by jumps, and then it must test the flag left by the cmp before the jump
+.entry MAIN
+
+MAIN:   mov #2, r1
+LOOP:   prn r1
+        dec r1
+        cmp r1, #0
+        bne LOOP
+        cmp r3, #1
+CHECK:  bne AGAIN
+        stop
+AGAIN:  prn r3
+        inc r3
+        cmp r3, #2
+        jmp CHECK
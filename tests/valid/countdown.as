@@ -0,0 +1,29 @@
+; Counts down, echoes two input characters and adds up a matrix row;
+; run by the simulator and by the translated program
+.entry MAIN
+
+MAIN:   mov #3, r1
+LOOP:   prn r1
+        dec r1
+        cmp r1, #0
+        bne LOOP
+        red r2
+        prn r2
+        red r3
+        prn r3
+        jsr SUM
+        prn r4
+        dec COUNT
+        prn COUNT
+        stop
+
+SUM:    clr r4
+        clr r6
+        clr r7
+        add GRID[r6][r7], r4
+        inc r7
+        add GRID[r6][r7], r4
+        rts
+
+COUNT:  .data 10
+GRID:   .mat [2][2] 7, 8, 9, 10
@@ -0,0 +1,19 @@
+; soyk and awa set the same macro filter bits as stop and rts, so the stop
+; and rts lines pass the filter; the lookup finds no macro by those names
+; and they stay instructions
+mcro soyk
+inc r1
+mcroend
+
+mcro awa
+jsr DOUBLE
+mcroend
+
+MAIN:   mov #1, r1
+soyk
+awa
+        prn r1
+        stop
+
+DOUBLE: add r1, r1
+        rts
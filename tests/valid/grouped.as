@@ -0,0 +1,11 @@
+; Several uses of each external, for --ext-grouped
+.extern PUTC
+.extern GETC
+
+MAIN:   jsr GETC
+        mov GETC, r1
+        jsr PUTC
+        cmp GETC, #-1
+        bne MAIN
+        jsr PUTC
+        stop
@@ -0,0 +1,8 @@
+; Words copied from incbin.bin (16-bit little-endian): all of them, then
+; three from the second on
+MAIN:   prn WORDS
+        prn PART
+        stop
+
+WORDS:  .incbin "incbin.bin"
+PART:   .incbin "incbin.bin", 1, 3
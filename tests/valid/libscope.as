@@ -0,0 +1,11 @@
+; The library's swap2 calls push2 and pop2 of the library: the pop2 this
+; file defines only replaces the library one where the file calls it
+mcro pop2
+mov r6, r2
+mcroend
+
+MAIN:   mov #4, r1
+        mov #5, r2
+swap2
+pop2
+        stop
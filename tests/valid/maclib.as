@@ -0,0 +1,18 @@
+; Uses the macros of macros.lib, which is given with --macro-lib. The
+; file's own pop2 hides the library one, and its own macro calls push2
+mcro pop2
+mov r6, r2
+mcroend
+
+mcro save
+push2
+prn r6
+mcroend
+
+MAIN:   mov #4, r1
+        mov #5, r2
+save
+        add r1, r2
+pop2
+        prn r2
+        stop
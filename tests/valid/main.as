@@ -0,0 +1,13 @@
+; Main module for the archiver tests: calls PRINT from module.as, which
+; stores into RESULT
+.entry MAIN
+.entry RESULT
+.extern PRINT
+.extern BUFFER
+
+MAIN:   jsr PRINT
+        prn RESULT
+        prn BUFFER
+        stop
+
+RESULT: .data 0
@@ -0,0 +1,10 @@
+; Library module for the archiver tests: two entry points and an external
+.entry PRINT
+.entry BUFFER
+.extern RESULT
+
+PRINT:  prn BUFFER
+        mov BUFFER, RESULT
+        rts
+
+BUFFER: .data 1, 2
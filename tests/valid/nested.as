@@ -0,0 +1,21 @@
+; Macros that call other macros, expanded from their flattened bodies
+mcro twice
+inc r1
+inc r1
+mcroend
+
+mcro four
+twice
+twice
+mcroend
+
+mcro report
+four
+prn r1
+mcroend
+
+MAIN:   clr r1
+report
+twice
+        prn r1
+        stop
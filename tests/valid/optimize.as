@@ -0,0 +1,16 @@
+; Redundant instructions for the -O peephole pass. All but the labelled
+; mov are shortened or removed, and the labels after them move down
+.entry DONE
+
+MAIN:   mov r1, r1
+        add #1, r2
+        sub #1, r3
+        add #0, r4
+        mov #0, r5
+        clr r5
+        jmp NEXT
+NEXT:   prn TOTAL
+        jmp DONE
+DONE:   stop
+
+TOTAL:  .data 42
@@ -0,0 +1,15 @@
+; Stores over one of its own instructions: the inc at PATCH runs once, is
+; replaced by the word of "dec r1" and must run as a dec on the next pass
+.entry MAIN
+
+MAIN:   clr r1
+        clr r3
+PATCH:  inc r1
+        prn r1
+        mov NEWOP, PATCH
+        inc r3
+        cmp r3, #2
+        bne PATCH
+        stop
+
+NEWOP:  .data -500
@@ -0,0 +1,17 @@
+; Code and data under several labels, and a macro called twice,
+; for --size-report
+mcro show
+prn r1
+prn VALUES
+mcroend
+
+MAIN:   mov #3, r1
+show
+        jsr PRINT
+        stop
+PRINT:  prn r2
+show
+        rts
+
+VALUES: .data 1, 2, 3
+TEXT:   .string "size"
@@ -1,7 +1,7 @@
 ; Test basic functionality
 mcro m1
 add r1, r2
-sub r3, #5
+sub #5, r3
 mcroend
 
 .extern LIST
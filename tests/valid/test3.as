@@ -0,0 +1,18 @@
+; Long value lists, continued on the next line by a trailing comma
+MAIN: mov TABLE, r1
+      prn r1
+      stop
+
+TABLE: .data 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+             -1, -2, -3, -4, -5, -6, -7, -8,
+; comments and blank lines may sit inside a list
+
+             511, -512
+GRID: .mat [3][4] 1, 2, 3, 4,
+                  5, 6, 7, 8,
+                  9, 10, 11, 12
+
+; Bulk-initialized blocks
+ZEROS: .fill 8, 0
+ONES: .fill 3, -1
+IDENT: .mat [2][3] fill=7
@@ -0,0 +1,631 @@
+/*
+ * translate.c
+ * Main program for the ahead-of-time translator
+ * Turns an assembled program into a C program with one block of C per basic
+ * block, where jmp, bne, jsr and rts become gotos, and builds it with the
+ * host compiler. Whatever the translation cannot run natively (stores into
+ * the code, runtime errors, the step limit) continues in the interpreter,
+ * which the translated program links in.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "simulator.h"
+#include "diagnostics.h"
+#include "utils.h"
+
+#define DEFAULT_COMPILER "gcc -O2"
+#define NATIVE_SUFFIX "_native"
+#define RUNTIME_LIBRARY "libsim.a"
+
+
+/* One statically decoded instruction */
+typedef struct {
+    int valid;          /* 0 if the word does not decode; the interpreter reports it */
+    int opcode;
+    int length;
+    SimOperand src;
+    SimOperand dest;
+} TranslatedInstruction;
+
+
+typedef struct {
+    Machine *machine;
+    FILE *output;
+    TranslatedInstruction code[SIM_MEMORY_SIZE];
+    int starts[SIM_MEMORY_SIZE];    /* 1 where an instruction begins */
+    int leaders[SIM_MEMORY_SIZE];   /* 1 where a basic block begins */
+    int block_count;
+} Translation;
+
+/*
+ * Function prototypes
+ */
+void decode_program(Translation *translation);
+void find_blocks(Translation *translation);
+int write_translation(Translation *translation, const char *filename);
+void write_prologue(Translation *translation);
+void write_block(Translation *translation, int start);
+void write_instruction(Translation *translation, int pc, int undone);
+void write_matrix_address(Translation *translation, const SimOperand *operand, const char *temp, int pc, int undone);
+void write_store(Translation *translation, const SimOperand *operand, const char *temp, const char *value, int next_pc, int undone);
+void write_jump(Translation *translation, const SimOperand *operand, const char *temp);
+void write_epilogue(Translation *translation);
+void format_address(const SimOperand *operand, const char *temp, char *text);
+void format_read(const SimOperand *operand, const char *temp, char *text);
+void write_c_string(FILE *output, const char *text);
+int build_translation(const char *compiler, const char *runtime_dir, const char *c_file, const char *executable);
+void print_translate_usage(const char *program_name);
+
+/*
+ * main - Entry point of the translator program
+ * @argc: Number of command line arguments
+ * @argv: Array of command line argument strings
+ * Returns: 0 on success, 1 on failure
+ */
+int main(int argc, char *argv[]) {
+    static Machine machine;
+    static Translation translation;
+    extern int error_flag;
+    const char *base_name = NULL;
+    const char *compiler = DEFAULT_COMPILER;
+    const char *output_name = NULL;
+    char runtime_dir[MAX_LINE_LENGTH];
+    char executable[MAX_LINE_LENGTH];
+    char c_file[MAX_LINE_LENGTH + 2];
+    const char *slash;
+    int build = 1;
+    int i;
+
+    slash = strrchr(argv[0], '/');
+    if (slash == NULL || slash - argv[0] >= MAX_LINE_LENGTH) {
+        strcpy(runtime_dir, ".");
+    } else {
+        strncpy(runtime_dir, argv[0], slash - argv[0]);
+        runtime_dir[slash - argv[0]] = '\0';
+    }
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc && strlen(argv[i + 1]) < MAX_LINE_LENGTH) {
+            output_name = argv[++i];
+        } else if (strcmp(argv[i], "--cc") == 0 && i + 1 < argc) {
+            compiler = argv[++i];
+        } else if (strcmp(argv[i], "--runtime") == 0 && i + 1 < argc && strlen(argv[i + 1]) < MAX_LINE_LENGTH) {
+            strcpy(runtime_dir, argv[++i]);
+        } else if (strcmp(argv[i], "--no-build") == 0) {
+            build = 0;
+        } else if (strncmp(argv[i], "--", 2) != 0 && base_name == NULL &&
+                   strlen(argv[i]) + strlen(NATIVE_SUFFIX) < MAX_LINE_LENGTH) {
+            base_name = argv[i];
+        } else {
+            print_translate_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (base_name == NULL) {
+        print_translate_usage(argv[0]);
+        return 1;
+    }
+
+    if (!load_program(base_name, &machine)) {
+        flush_diagnostics(stderr);
+        return 1;
+    }
+    load_source_symbols(base_name, &machine);
+
+    if (output_name != NULL) {
+        strcpy(executable, output_name);
+    } else {
+        strcpy(executable, base_name);
+        strcat(executable, NATIVE_SUFFIX);
+    }
+    strcpy(c_file, executable);
+    strcat(c_file, ".c");
+
+    translation.machine = &machine;
+    decode_program(&translation);
+    find_blocks(&translation);
+
+    if (write_translation(&translation, c_file)) {
+        printf("Translated %s to %s (%d basic block(s)).\n", machine.object_name, c_file, translation.block_count);
+        if (build && build_translation(compiler, runtime_dir, c_file, executable)) {
+            printf("Built %s.\n", executable);
+        }
+    }
+
+    free_program(&machine);
+    flush_diagnostics(stderr);
+    return (error_flag == 0) ? 0 : 1;
+}
+
+/*
+ * decode_program - Decodes the code section from its first word on
+ * A word that does not decode is left to the interpreter, which reports it
+ * when (and if) the program gets there
+ */
+void decode_program(Translation *translation) {
+    Machine *machine = translation->machine;
+    TranslatedInstruction *instruction;
+    int pc = machine->code_start;
+
+    machine->quiet = 1;
+    while (pc < machine->code_end) {
+        instruction = &translation->code[pc];
+        translation->starts[pc] = 1;
+        machine->faulted = 0;
+        instruction->valid = decode_at(machine, pc, &instruction->opcode, &instruction->src,
+                                       &instruction->dest, &instruction->length);
+        if (!instruction->valid) {
+            instruction->length = 1;
+        }
+        pc += instruction->length;
+    }
+    machine->faulted = 0;
+    machine->quiet = 0;
+}
+
+/*
+ * find_blocks - Marks the first instruction of every basic block: the entry
+ * point, every label, every direct jump target and the instruction after a
+ * jump, a call, a return, stop or a word that does not decode
+ */
+void find_blocks(Translation *translation) {
+    const Machine *machine = translation->machine;
+    const TranslatedInstruction *instruction;
+    int pc, i;
+
+    translation->leaders[machine->code_start] = 1;
+    for (i = 0; i < machine->label_count; i++) {
+        if (machine->labels[i].address >= 0 && machine->labels[i].address < SIM_MEMORY_SIZE) {
+            translation->leaders[machine->labels[i].address] = 1;
+        }
+    }
+
+    for (pc = machine->code_start; pc < machine->code_end; pc += instruction->length) {
+        instruction = &translation->code[pc];
+        if (!instruction->valid || instruction->opcode == 9 || instruction->opcode == 10 ||
+            instruction->opcode >= 13) {
+            if (pc + instruction->length < SIM_MEMORY_SIZE) {
+                translation->leaders[pc + instruction->length] = 1;
+            }
+        }
+        if (instruction->valid && (instruction->opcode == 9 || instruction->opcode == 10 ||
+            instruction->opcode == 13) && instruction->dest.mode == 1) {
+            translation->leaders[instruction->dest.address] = 1;
+        }
+    }
+
+    translation->block_count = 0;
+    for (pc = machine->code_start; pc < machine->code_end; pc++) {
+        if (translation->starts[pc] && translation->leaders[pc]) {
+            translation->block_count++;
+        }
+    }
+}
+
+/*
+ * write_translation - Writes the C program for the decoded code to filename
+ * Returns: 1 on success, 0 if the file cannot be written
+ */
+int write_translation(Translation *translation, const char *filename) {
+    const Machine *machine = translation->machine;
+    int pc;
+
+    translation->output = fopen(filename, "w");
+    if (translation->output == NULL) {
+        print_error(filename, 0, "Cannot create output file");
+        return 0;
+    }
+
+    write_prologue(translation);
+    for (pc = machine->code_start; pc < machine->code_end; pc++) {
+        if (translation->starts[pc] && translation->leaders[pc]) {
+            write_block(translation, pc);
+        }
+    }
+    write_epilogue(translation);
+
+    if (fclose(translation->output) != 0) {
+        print_error(filename, 0, "Cannot write output file");
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * write_prologue - Writes the memory image and the start of main, which
+ * sets up the machine the way load_program would
+ */
+void write_prologue(Translation *translation) {
+    const Machine *machine = translation->machine;
+    FILE *output = translation->output;
+    int address, i;
+
+    fprintf(output, "/*\n * Translated from %s - do not edit\n", machine->object_name);
+    fprintf(output, " * Link with %s; anything not run natively continues in the interpreter\n */\n\n", RUNTIME_LIBRARY);
+    fprintf(output, "#include <stdio.h>\n#include <stdlib.h>\n#include <string.h>\n");
+    fprintf(output, "#include \"simulator.h\"\n#include \"diagnostics.h\"\n\n");
+    fprintf(output, "#define FALLBACK(at, undone) do { executed -= (undone); machine.pc = (at); goto interpret; } while (0)\n\n");
+
+    fprintf(output, "static const unsigned int image[SIM_MEMORY_SIZE] = {");
+    for (address = 0; address < SIM_MEMORY_SIZE; address++) {
+        fprintf(output, "%s%u", (address % 16 == 0) ? "\n    " : " ", machine->memory[address]);
+        if (address + 1 < SIM_MEMORY_SIZE) {
+            fputc(',', output);
+        }
+    }
+    fprintf(output, "\n};\n\n");
+
+    fprintf(output, "static Machine machine;\n\n");
+    fprintf(output, "static int sx(unsigned int word) {\n");
+    fprintf(output, "    word &= 0x3FF;\n");
+    fprintf(output, "    return (word & 0x200) ? (int)word - 1024 : (int)word;\n}\n\n");
+
+    fprintf(output, "int main(int argc, char *argv[]) {\n");
+    fprintf(output, "    extern int error_flag;\n");
+    fprintf(output, "    long max_steps = SIM_DEFAULT_STEPS;\n");
+    fprintf(output, "    long executed = 0;\n");
+    fprintf(output, "    int src_address = 0, dest_address = 0, value = 0;\n\n");
+    fprintf(output, "    if (argc == 3 && strcmp(argv[1], \"--steps\") == 0 && atol(argv[2]) > 0) {\n");
+    fprintf(output, "        max_steps = atol(argv[2]);\n");
+    fprintf(output, "    } else if (argc != 1) {\n");
+    fprintf(output, "        printf(\"Usage: %%s [--steps N]\\n\", argv[0]);\n");
+    fprintf(output, "        return 1;\n    }\n\n");
+
+    fprintf(output, "    if (!reset_machine(&machine, ");
+    write_c_string(output, machine->object_name);
+    fprintf(output, ")) {\n        flush_diagnostics(stderr);\n        return 1;\n    }\n");
+    fprintf(output, "    memcpy(machine.memory, image, sizeof(image));\n");
+    fprintf(output, "    machine.code_start = %d;\n", machine->code_start);
+    fprintf(output, "    machine.code_end = %d;\n", machine->code_end);
+    fprintf(output, "    machine.data_end = %d;\n", machine->data_end);
+    for (i = 0; i < machine->label_count; i++) {
+        if (machine->labels[i].columns > 0) {
+            fprintf(output, "    add_label(&machine, \"%s\", %d, %d);\n", machine->labels[i].name,
+                    machine->labels[i].address, machine->labels[i].columns);
+        }
+    }
+    for (i = 0; i < machine->external_count; i++) {
+        fprintf(output, "    add_external(&machine, \"%s\", %d);\n", machine->externals[i].name,
+                machine->externals[i].address);
+    }
+    fprintf(output, "    sort_labels(&machine);\n");
+    fprintf(output, "    machine.pc = machine.code_start;\n");
+    fprintf(output, "    goto dispatch;\n");
+}
+
+/*
+ * write_block - Writes the basic block starting at start
+ * The block first checks that all of its instructions fit in the step
+ * limit; if not, the interpreter runs it and stops exactly at the limit
+ */
+void write_block(Translation *translation, int start) {
+    const Machine *machine = translation->machine;
+    const SimLabel *label = label_for_address(machine, start);
+    int count = 0;
+    int pc;
+
+    for (pc = start; pc < machine->code_end && (pc == start || !translation->leaders[pc]);
+         pc += translation->code[pc].length) {
+        count++;
+    }
+
+    fprintf(translation->output, "\nb%d:", start);
+    if (label != NULL && label->address == start) {
+        fprintf(translation->output, "  /* %s */", label->name);
+    }
+    fprintf(translation->output, "\n    if (max_steps - executed < %d) {\n", count);
+    fprintf(translation->output, "        machine.pc = %d;\n        goto interpret;\n    }\n", start);
+    fprintf(translation->output, "    executed += %d;\n", count);
+
+    for (pc = start; count > 0; pc += translation->code[pc].length) {
+        write_instruction(translation, pc, count--);
+    }
+}
+
+/*
+ * write_instruction - Writes the C for the instruction at pc
+ * @undone: instructions of the block from this one on; a fallback takes
+ * them back off the step count before the interpreter continues
+ */
+void write_instruction(Translation *translation, int pc, int undone) {
+    const TranslatedInstruction *instruction = &translation->code[pc];
+    const Machine *machine = translation->machine;
+    FILE *output = translation->output;
+    int next_pc = pc + instruction->length;
+    char src[MAX_LINE_LENGTH], dest[MAX_LINE_LENGTH], value[MAX_LINE_LENGTH * 3];
+
+    if (!instruction->valid) {
+        fprintf(output, "    FALLBACK(%d, %d);\n", pc, undone);
+        return;
+    }
+
+    fprintf(output, "    /* %d: %s */\n", pc, reserved_instructions[instruction->opcode]);
+    write_matrix_address(translation, &instruction->src, "src_address", pc, undone);
+    write_matrix_address(translation, &instruction->dest, "dest_address", pc, undone);
+    format_read(&instruction->src, "src_address", src);
+    format_read(&instruction->dest, "dest_address", dest);
+
+    switch (instruction->opcode) {
+        case 0:     /* mov */
+            write_store(translation, &instruction->dest, "dest_address", src, next_pc, undone);
+            break;
+        case 1:     /* cmp */
+            fprintf(output, "    machine.zero_flag = (sx((unsigned int)(%s - %s)) == 0);\n", src, dest);
+            break;
+        case 2:     /* add */
+        case 3:     /* sub */
+            sprintf(value, "%s %c %s", dest, (instruction->opcode == 2) ? '+' : '-', src);
+            write_store(translation, &instruction->dest, "dest_address", value, next_pc, undone);
+            break;
+        case 4:     /* not */
+            sprintf(value, "~%s", dest);
+            write_store(translation, &instruction->dest, "dest_address", value, next_pc, undone);
+            break;
+        case 5:     /* clr */
+            write_store(translation, &instruction->dest, "dest_address", "0", next_pc, undone);
+            break;
+        case 6:     /* lea */
+            format_address(&instruction->src, "src_address", value);
+            write_store(translation, &instruction->dest, "dest_address", value, next_pc, undone);
+            break;
+        case 7:     /* inc */
+        case 8:     /* dec */
+            sprintf(value, "%s %c 1", dest, (instruction->opcode == 7) ? '+' : '-');
+            write_store(translation, &instruction->dest, "dest_address", value, next_pc, undone);
+            break;
+        case 9:     /* jmp */
+            write_jump(translation, &instruction->dest, "dest_address");
+            break;
+        case 10:    /* bne */
+            fprintf(output, "    if (!machine.zero_flag) {\n");
+            write_jump(translation, &instruction->dest, "dest_address");
+            fprintf(output, "    }\n");
+            break;
+        case 11:    /* red */
+            fprintf(output, "    value = getchar();\n");
+            write_store(translation, &instruction->dest, "dest_address", "(value == EOF) ? -1 : value", next_pc, undone);
+            break;
+        case 12:    /* prn */
+            fprintf(output, "    printf(\"%%d\\n\", %s);\n", dest);
+            break;
+        case 13:    /* jsr */
+            fprintf(output, "    if (machine.stack_depth == SIM_STACK_SIZE) {\n        FALLBACK(%d, %d);\n    }\n", pc, undone);
+            fprintf(output, "    machine.stack[machine.stack_depth++] = %d;\n", next_pc);
+            write_jump(translation, &instruction->dest, "dest_address");
+            break;
+        case 14:    /* rts */
+            fprintf(output, "    if (machine.stack_depth == 0) {\n        FALLBACK(%d, %d);\n    }\n", pc, undone);
+            fprintf(output, "    machine.pc = machine.stack[--machine.stack_depth];\n    goto dispatch;\n");
+            break;
+        default:    /* stop */
+            fprintf(output, "    machine.halted = 1;\n    machine.pc = %d;\n    goto finish;\n", next_pc);
+            break;
+    }
+
+    if (next_pc == machine->code_end && undone == 1 &&
+        (instruction->opcode < 9 || instruction->opcode == 10 || instruction->opcode == 11 ||
+         instruction->opcode == 12)) {
+        fprintf(output, "    machine.pc = %d;\n    goto interpret;\n", next_pc);
+    }
+}
+
+/*
+ * write_matrix_address - Computes a matrix operand's element address into
+ * temp; an index out of range is left to the interpreter to report
+ */
+void write_matrix_address(Translation *translation, const SimOperand *operand, const char *temp, int pc, int undone) {
+    if (operand->mode != 2) {
+        return;
+    }
+    fprintf(translation->output, "    %s = %d + machine.registers[%d] * %d + machine.registers[%d];\n",
+            temp, operand->address, operand->row_reg, operand->columns, operand->col_reg);
+    fprintf(translation->output, "    if (%s < 0 || %s >= SIM_MEMORY_SIZE) {\n        FALLBACK(%d, %d);\n    }\n",
+            temp, temp, pc, undone);
+}
+
+/*
+ * write_store - Writes value to the operand; after a store into the code
+ * the interpreter takes over, since the translation no longer matches it
+ */
+void write_store(Translation *translation, const SimOperand *operand, const char *temp, const char *value, int next_pc, int undone) {
+    const Machine *machine = translation->machine;
+    FILE *output = translation->output;
+
+    switch (operand->mode) {
+        case 3:
+            fprintf(output, "    machine.registers[%d] = sx((unsigned int)(%s));\n", operand->reg, value);
+            break;
+        case 1:
+            fprintf(output, "    machine.memory[%d] = (unsigned int)(%s) & 0x3FF;\n", operand->address, value);
+            if (operand->address >= machine->code_start && operand->address < machine->code_end) {
+                fprintf(output, "    FALLBACK(%d, %d);\n", next_pc, undone - 1);
+            }
+            break;
+        case 2:
+            fprintf(output, "    machine.memory[%s] = (unsigned int)(%s) & 0x3FF;\n", temp, value);
+            fprintf(output, "    if (%s >= %d && %s < %d) {\n        FALLBACK(%d, %d);\n    }\n",
+                    temp, machine->code_start, temp, machine->code_end, next_pc, undone - 1);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * write_jump - Writes a transfer to the operand's address: a goto for a
+ * known block, otherwise through the dispatch switch or the interpreter
+ */
+void write_jump(Translation *translation, const SimOperand *operand, const char *temp) {
+    FILE *output = translation->output;
+    int target = operand->address;
+
+    if (operand->mode == 3) {
+        fprintf(output, "    machine.pc = machine.registers[%d];\n    goto dispatch;\n", operand->reg);
+    } else if (operand->mode == 2) {
+        fprintf(output, "    machine.pc = %s;\n    goto dispatch;\n", temp);
+    } else if (target >= translation->machine->code_start && target < translation->machine->code_end &&
+               translation->starts[target] && translation->leaders[target]) {
+        fprintf(output, "    goto b%d;\n", target);
+    } else {
+        fprintf(output, "    machine.pc = %d;\n    goto interpret;\n", target);
+    }
+}
+
+/*
+ * write_epilogue - Writes the dispatch switch for computed jumps, the hand
+ * over to the interpreter and the end of main
+ */
+void write_epilogue(Translation *translation) {
+    const Machine *machine = translation->machine;
+    FILE *output = translation->output;
+    int pc;
+
+    fprintf(output, "\ndispatch:\n    switch (machine.pc) {\n");
+    for (pc = machine->code_start; pc < machine->code_end; pc++) {
+        if (translation->starts[pc] && translation->leaders[pc]) {
+            fprintf(output, "        case %d: goto b%d;\n", pc, pc);
+        }
+    }
+    fprintf(output, "        default: goto interpret;\n    }\n");
+
+    fprintf(output, "\ninterpret:\n");
+    fprintf(output, "    machine.instruction_count = executed;\n");
+    fprintf(output, "    run_program(&machine, max_steps - executed);\n");
+    fprintf(output, "\nfinish:\n");
+    fprintf(output, "    (void)src_address;\n    (void)dest_address;\n    (void)value;\n");
+    fprintf(output, "    fflush(stdout);\n");
+    fprintf(output, "    flush_diagnostics(stderr);\n");
+    fprintf(output, "    free_program(&machine);\n");
+    fprintf(output, "    return (machine.halted && error_flag == 0) ? 0 : 1;\n}\n");
+}
+
+/* Formats the address a direct or matrix operand refers to */
+void format_address(const SimOperand *operand, const char *temp, char *text) {
+    if (operand->mode == 2) {
+        strcpy(text, temp);
+    } else {
+        sprintf(text, "%d", operand->address);
+    }
+}
+
+/* Formats a C expression for the value of an operand */
+void format_read(const SimOperand *operand, const char *temp, char *text) {
+    switch (operand->mode) {
+        case 0:
+            sprintf(text, "(%d)", operand->value);
+            break;
+        case 1:
+            sprintf(text, "sx(machine.memory[%d])", operand->address);
+            break;
+        case 2:
+            sprintf(text, "sx(machine.memory[%s])", temp);
+            break;
+        case 3:
+            sprintf(text, "machine.registers[%d]", operand->reg);
+            break;
+        default:
+            strcpy(text, "0");
+            break;
+    }
+}
+
+/* Writes text as a C string literal */
+void write_c_string(FILE *output, const char *text) {
+    fputc('"', output);
+    for (; *text != '\0'; text++) {
+        if (*text == '"' || *text == '\\') {
+            fputc('\\', output);
+        }
+        fputc(*text, output);
+    }
+    fputc('"', output);
+}
+
+/*
+ * build_translation - Compiles the translated program against the
+ * simulator runtime in runtime_dir
+ * Only the compiler command goes through the shell, so that --cc can carry
+ * options; the file names reach it as "$@" and are never parsed by the shell
+ * Returns: 1 on success, 0 if the compiler failed
+ */
+int build_translation(const char *compiler, const char *runtime_dir, const char *c_file, const char *executable) {
+    char *script;
+    char *include_option;
+    char *library;
+    char *arguments[11];
+    pid_t child;
+    int status = -1;
+
+    script = (char *)malloc(strlen(compiler) + 8);
+    include_option = (char *)malloc(strlen(runtime_dir) + 3);
+    library = (char *)malloc(strlen(runtime_dir) + strlen(RUNTIME_LIBRARY) + 2);
+    if (script == NULL || include_option == NULL || library == NULL) {
+        free(script);
+        free(include_option);
+        free(library);
+        print_error(c_file, 0, "Memory allocation failed");
+        return 0;
+    }
+    sprintf(script, "%s \"$@\"", compiler);
+    sprintf(include_option, "-I%s", runtime_dir);
+    sprintf(library, "%s/%s", runtime_dir, RUNTIME_LIBRARY);
+
+    arguments[0] = "sh";
+    arguments[1] = "-c";
+    arguments[2] = script;
+    arguments[3] = "sh";            /* $0 of the script */
+    arguments[4] = include_option;
+    arguments[5] = "-o";
+    arguments[6] = (char *)executable;
+    arguments[7] = (char *)c_file;
+    arguments[8] = library;
+    arguments[9] = "-lpthread";
+    arguments[10] = NULL;
+
+    fflush(stdout);
+    child = fork();
+    if (child == 0) {
+        execvp(arguments[0], arguments);
+        _exit(127);
+    }
+    while (child > 0 && waitpid(child, &status, 0) < 0 && errno == EINTR) {
+        ;
+    }
+    free(script);
+    free(include_option);
+    free(library);
+
+    if (child <= 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        print_error(c_file, 0, "Compiling the translated program failed");
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * print_translate_usage - Prints usage information for the translator
+ */
+void print_translate_usage(const char *program_name) {
+    printf("Usage: %s [options] <name>\n", program_name);
+    printf("\nDescription:\n");
+    printf("  Translates name.ob (with name.ext, and name.am for labels and matrix\n");
+    printf("  dimensions) to name%s.c and builds it into name%s, which runs the\n", NATIVE_SUFFIX, NATIVE_SUFFIX);
+    printf("  program like sim does but natively. Stores into the code, runtime\n");
+    printf("  errors and the step limit are handed to the linked interpreter.\n");
+    printf("  The translated program takes --steps N like sim.\n");
+    printf("\nOptions:\n");
+    printf("  --output NAME   Name of the program to build (NAME.c is the C source)\n");
+    printf("  --cc COMMAND    Compiler command (default \"%s\")\n", DEFAULT_COMPILER);
+    printf("  --runtime DIR   Directory with simulator.h and %s\n", RUNTIME_LIBRARY);
+    printf("                  (default: the directory of this program)\n");
+    printf("  --no-build      Only write the C source\n");
+}
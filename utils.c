@@ -10,6 +10,11 @@
 #include <ctype.h>
 #include "utils.h"
 #include "data_structures.h"
+#include "diagnostics.h"
+#include "symbol_names.h"
+
+
+static int token_name_id(const char *token);
 
 
 const char *reserved_instructions[16] = {
@@ -17,8 +22,8 @@ const char *reserved_instructions[16] = {
     "dec", "jmp", "bne", "red", "prn", "jsr", "rts", "stop"
 };
 
-const char *reserved_directives[5] = {
-    ".data", ".string", ".mat", ".entry", ".extern"
+const char *reserved_directives[7] = {
+    ".data", ".string", ".mat", ".entry", ".extern", ".incbin", ".fill"
 };
 
 const char *reserved_registers[8] = {
@@ -27,15 +32,37 @@ const char *reserved_registers[8] = {
 
 
 
+/*
+ * Interns the symbol name a token refers to: the whole token, or the part
+ * before '[' of a matrix operand. Immediates, registers, strings and
+ * over-long names get NO_NAME_ID; they can never be symbols.
+ */
+static int token_name_id(const char *token) {
+    char name[MAX_SYMBOL_NAME];
+    size_t length = strcspn(token, "[");
+    
+    if (!isalpha((unsigned char)token[0]) || length >= MAX_SYMBOL_NAME) {
+        return NO_NAME_ID;
+    }
+    memcpy(name, token, length);
+    name[length] = '\0';
+    if (get_register_number(name) != -1) {
+        return NO_NAME_ID;
+    }
+    return intern_name(name);
+}
+
+
 /*
  * Parses a single line of assembly code into its components
  */
 ParsedLine* parse_line(char *line) {
     ParsedLine *parsed;
     char line_copy[MAX_LINE_LENGTH];
-    char tokens[MAX_TOKENS][MAX_SYMBOL_NAME];
+    char tokens[MAX_TOKENS][MAX_LINE_LENGTH];
     int token_count;
     int token_index = 0;
+    const char *values;
     
 
     parsed = (ParsedLine *)malloc(sizeof(ParsedLine));
@@ -48,6 +75,10 @@ ParsedLine* parse_line(char *line) {
     parsed->command = NULL;
     parsed->operand1 = NULL;
     parsed->operand2 = NULL;
+    parsed->values = NULL;
+    parsed->label_id = NO_NAME_ID;
+    parsed->operand1_id = NO_NAME_ID;
+    parsed->operand2_id = NO_NAME_ID;
     parsed->is_error = 0;
     parsed->is_empty = 0;
     parsed->is_directive = 0;
@@ -77,6 +108,7 @@ ParsedLine* parse_line(char *line) {
         if (parsed->label != NULL) {
             strcpy(parsed->label, tokens[0]);
         }
+        parsed->label_id = token_name_id(tokens[0]);
         token_index = 1;
     }
     
@@ -92,12 +124,27 @@ ParsedLine* parse_line(char *line) {
         token_index++;
     }
     
+    /* Value lists and file names are kept whole; they may be longer than the token limit */
+    if (parsed->command != NULL &&
+        (strcmp(parsed->command, ".data") == 0 || strcmp(parsed->command, ".mat") == 0 ||
+         strcmp(parsed->command, ".incbin") == 0)) {
+        values = skip_tokens(line, token_index);
+        values += strspn(values, " \t\n\r");
+        parsed->values = (char *)malloc(strlen(values) + 1);
+        if (parsed->values != NULL) {
+            strcpy(parsed->values, values);
+            trim_whitespace(parsed->values);
+        }
+        return parsed;
+    }
+    
 
     if (token_index < token_count) {
         parsed->operand1 = (char *)malloc(strlen(tokens[token_index]) + 1);
         if (parsed->operand1 != NULL) {
             strcpy(parsed->operand1, tokens[token_index]);
         }
+        parsed->operand1_id = token_name_id(tokens[token_index]);
         token_index++;
     }
     
@@ -106,6 +153,7 @@ ParsedLine* parse_line(char *line) {
         if (parsed->operand2 != NULL) {
             strcpy(parsed->operand2, tokens[token_index]);
         }
+        parsed->operand2_id = token_name_id(tokens[token_index]);
         token_index++;
     }
     
@@ -138,32 +186,59 @@ void free_parsed_line(ParsedLine *parsed) {
         free(parsed->operand2);
     }
     
+    if (parsed->values != NULL) {
+        free(parsed->values);
+    }
+    
     free(parsed);
 }
 
 
-int tokenize_line(char *line, char tokens[][MAX_SYMBOL_NAME], int max_tokens) {
+/* Splits a line on whitespace and commas; scans by hand (not strtok) so passes can run on several threads */
+int tokenize_line(char *line, char tokens[][MAX_LINE_LENGTH], int max_tokens) {
     char *token;
     int count = 0;
-    char *delimiters = " \t\n\r,";
+    size_t length;
+    const char *delimiters = " \t\n\r,";
     
 
     line = trim_whitespace(line);
     
 
-    token = strtok(line, delimiters);
-    
-    while (token != NULL && count < max_tokens) {
+    while (count < max_tokens) {
+        line += strspn(line, delimiters);
+        if (*line == '\0') {
+            break;
+        }
+        
+        token = line;
+        length = strcspn(line, delimiters);
+        line += length;
+        if (*line != '\0') {
+            *line = '\0';
+            line++;
+        }
 
         strcpy(tokens[count], trim_whitespace(token));
         count++;
-        token = strtok(NULL, delimiters);
     }
     
     return count;
 }
 
 
+/* Returns the text after the first @count tokens of @line, split as tokenize_line does */
+const char* skip_tokens(const char *line, int count) {
+    const char *delimiters = " \t\n\r,";
+    
+    while (count-- > 0) {
+        line += strspn(line, delimiters);
+        line += strcspn(line, delimiters);
+    }
+    return line;
+}
+
+
 char* trim_whitespace(char *str) {
     char *end;
     
@@ -208,6 +283,34 @@ int is_comment_line(const char *line) {
 
 
 
+/* Checks if a line ends with a comma, meaning its value list goes on to the next line */
+int ends_with_comma(const char *line) {
+    const char *end = line + strlen(line);
+    
+    while (end > line && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    
+    return (end > line && end[-1] == ',');
+}
+
+
+/*
+ * djb2 string hash, kept to 32 bits so that it is the same on every host;
+ * archives store tables laid out by it
+ */
+unsigned long string_hash(const char *text) {
+    unsigned long hash = 5381;
+    
+    for (; *text != '\0'; text++) {
+        hash = ((hash << 5) + hash + (unsigned char)*text) & 0xFFFFFFFFUL;
+    }
+    return hash;
+}
+
+
+
+
 int is_valid_label(const char *name) {
     int i;
     
@@ -240,7 +343,7 @@ int is_reserved_word(const char *word) {
     }
     
 
-    for (i = 0; i < 5; i++) {
+    for (i = 0; i < 7; i++) {
         if (strcmp(word, reserved_directives[i]) == 0) {
             return 1;
         }
@@ -277,6 +380,70 @@ int is_valid_integer(const char *str, int *value) {
 
 
 
+/*
+ * Scans a comma separated list of integers in one pass, storing each one
+ * as a 10-bit word. A trailing comma is allowed and sets @continues.
+ * Returns: SCAN_OK, SCAN_INVALID or SCAN_OVERFLOW; @count is set in all cases
+ */
+int scan_value_list(const char *text, unsigned int *output, int capacity, int *count, int *continues) {
+    const char *p = text;
+    long value;
+    int negative;
+    
+    *count = 0;
+    *continues = 0;
+    
+    while (isspace((unsigned char)*p)) p++;
+    
+    while (*p != '\0') {
+        negative = (*p == '-');
+        if (*p == '-' || *p == '+') {
+            p++;
+        }
+        if (!isdigit((unsigned char)*p)) {
+            return SCAN_INVALID;
+        }
+        
+        value = 0;
+        while (isdigit((unsigned char)*p)) {
+            value = value * 10 + (*p - '0');
+            if (value > 512) {
+                return SCAN_INVALID;
+            }
+            p++;
+        }
+        if (negative) {
+            value = -value;
+        }
+        if (value > 511) {
+            return SCAN_INVALID;
+        }
+        
+        if (*count >= capacity) {
+            return SCAN_OVERFLOW;
+        }
+        output[(*count)++] = (unsigned int)(value & 0x3FF); /* 10-bit value */
+        
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0') {
+            break;
+        }
+        if (*p != ',') {
+            return SCAN_INVALID;
+        }
+        p++;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0') {
+            *continues = 1;
+        }
+    }
+    
+    return SCAN_OK;
+}
+
+
+
+
 int get_instruction_opcode(const char *instruction) {
     int i;
     
@@ -319,103 +486,6 @@ int get_addressing_mode(const char *operand) {
     return -1;
 }
 
-/* Checks if addressing modes are valid for instruction */
-int is_valid_addressing_for_instruction(int opcode, int src_mode, int dest_mode) {
-    static const int valid_src_modes[16] = {
-        0xF, 
-        0xF, 
-        0xF, 
-        0xF,
-        0x0, 
-        0x0, 
-        0x6, 
-        0x0, 
-        0x0, 
-        0x0, 
-        0x0, 
-        0x0, 
-        0x0, 
-        0x0, 
-        0x0, 
-        0x0
-    };
-    
-    static const int valid_dest_modes[16] = {
-        0xE, 
-        0xF, 
-        0xE, 
-        0xE, 
-        0xE, 
-        0xE, 
-        0xE, 
-        0xE, 
-        0xE, 
-        0xE, 
-        0xE, 
-        0xE, 
-        0xF, 
-        0xE,
-        0x0, 
-        0x0   
-    };
-    
-    if (opcode < 0 || opcode > 15) {
-        return 0;
-    }
-    
-    if (src_mode != -1) {
-        if (!(valid_src_modes[opcode] & (1 << src_mode))) {
-            return 0;
-        }
-    } else {
-        if (valid_src_modes[opcode] != 0x0) {
-            return 0;
-        }
-    }
-    
-    if (dest_mode != -1) {
-        if (!(valid_dest_modes[opcode] & (1 << dest_mode))) {
-            return 0;
-        }
-    } else {
-        if (valid_dest_modes[opcode] != 0x0) {
-            return 0;
-        }
-    }
-    
-    return 1;
-}
-
-/* Calculates the length (L) of an instruction */
-int calculate_instruction_length(int opcode, int src_mode, int dest_mode) {
-    int length = 1; 
-    
-
-    if (src_mode != -1) {
-        if (src_mode == 0 || src_mode == 1) {
-            length++;
-        } else if (src_mode == 2) {
-            length += 2;
-        } else if (src_mode == 3) {
-            if (dest_mode != 3) {
-                length++;
-            }
-        }
-    }
-    
-    if (dest_mode != -1) {
-        if (dest_mode == 0 || dest_mode == 1) {
-            length++;
-        } else if (dest_mode == 2) {
-            length += 2;
-        } else if (dest_mode == 3) {
-            length++;
-        }
-    }
-    
-    return length;
-}
-
 
 
 void create_output_filename(const char *input_filename, const char *new_extension, char *output_filename) {
@@ -432,6 +502,36 @@ void create_output_filename(const char *input_filename, const char *new_extensio
 }
 
 
+/*
+ * Reads a whole file into a malloc'd buffer with a terminating '\0'
+ * Returns: the text (the caller frees it; @size receives its length), or
+ * NULL if the file cannot be opened or read
+ */
+char* read_whole_file(const char *filename, size_t *size) {
+    FILE *file;
+    long length;
+    char *text;
+    
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    if (fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < 0) {
+        fclose(file);
+        return NULL;
+    }
+    rewind(file);
+    
+    text = (char *)malloc((size_t)length + 1);
+    if (text != NULL) {
+        *size = fread(text, 1, (size_t)length, file);
+        text[*size] = '\0';
+    }
+    fclose(file);
+    return text;
+}
+
+
 
 
 void to_base4(unsigned int number, char *result) {
@@ -447,6 +547,26 @@ void to_base4(unsigned int number, char *result) {
     result[5] = '\0';
 }
 
+/* Converts a base 4 string written with the digits a-d back to a number */
+int from_base4(const char *digits, unsigned int *number) {
+    unsigned int value = 0;
+    
+    if (digits == NULL || *digits == '\0') {
+        return 0;
+    }
+    
+    while (*digits) {
+        if (*digits < 'a' || *digits > 'd') {
+            return 0;
+        }
+        value = (value << 2) | (unsigned int)(*digits - 'a');
+        digits++;
+    }
+    
+    *number = value;
+    return 1;
+}
+
 
 int get_register_number(const char *register_name) {
     if (register_name == NULL || strlen(register_name) != 2) {
@@ -465,9 +585,9 @@ int get_register_number(const char *register_name) {
 
 
 
+/* Records an error in the diagnostics buffer; it is written out when the file is done */
 void print_error(const char *filename, int line_number, const char *error_message) {
     extern int error_flag;
     
-    fprintf(stderr, "Error in file %s, line %d: %s\n", filename, line_number, error_message);
-    error_flag = 1;
+    report_error(filename, line_number, error_message, &error_flag);
 }
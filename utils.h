@@ -14,12 +14,20 @@
 #define COMMENT_CHAR ';'     /* Character that starts a comment */
 #define LABEL_DELIMITER ':'  /* Character that marks end of label */
 
+#define SCAN_OK 0            /* Value list scanned */
+#define SCAN_INVALID -1      /* Malformed value or separator */
+#define SCAN_OVERFLOW -2     /* More values than the output can hold */
+
 
 typedef struct {
     char *label;
     char *command;
     char *operand1;
     char *operand2;
+    char *values;       /* Raw operand text of a .data, .mat or .incbin directive */
+    int label_id;       /* Interned name of the label, operands' symbol names; */
+    int operand1_id;    /* NO_NAME_ID where the field names no symbol */
+    int operand2_id;
     int is_error;
     int is_empty;
     int is_directive;
@@ -28,7 +36,7 @@ typedef struct {
 
 
 extern const char *reserved_instructions[16];
-extern const char *reserved_directives[5];
+extern const char *reserved_directives[7];
 extern const char *reserved_registers[8];
 
 
@@ -40,7 +48,10 @@ ParsedLine* parse_line(char *line);
 void free_parsed_line(ParsedLine *parsed);
 
 
-int tokenize_line(char *line, char tokens[][MAX_SYMBOL_NAME], int max_tokens);
+int tokenize_line(char *line, char tokens[][MAX_LINE_LENGTH], int max_tokens);
+
+
+const char* skip_tokens(const char *line, int count);
 
 
 char* trim_whitespace(char *str);
@@ -52,6 +63,12 @@ int is_empty_line(const char *line);
 int is_comment_line(const char *line);
 
 
+int ends_with_comma(const char *line);
+
+
+unsigned long string_hash(const char *text);
+
+
 
 
 
@@ -65,6 +82,9 @@ int is_reserved_word(const char *word);
 int is_valid_integer(const char *str, int *value);
 
 
+int scan_value_list(const char *text, unsigned int *output, int capacity, int *count, int *continues);
+
+
 
 
 int get_instruction_opcode(const char *instruction);
@@ -73,20 +93,20 @@ int get_instruction_opcode(const char *instruction);
 int get_addressing_mode(const char *operand);
 
 
-int is_valid_addressing_for_instruction(int opcode, int src_mode, int dest_mode);
 
 
-int calculate_instruction_length(int opcode, int src_mode, int dest_mode);
+void create_output_filename(const char *input_filename, const char *new_extension, char *output_filename);
 
 
+char* read_whole_file(const char *filename, size_t *size);
 
 
-void create_output_filename(const char *input_filename, const char *new_extension, char *output_filename);
 
 
+void to_base4(unsigned int number, char *result);
 
 
-void to_base4(unsigned int number, char *result);
+int from_base4(const char *digits, unsigned int *number);
 
 
 int get_register_number(const char *register_name);